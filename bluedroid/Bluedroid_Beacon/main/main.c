@@ -17,12 +17,37 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_bt_defs.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#if SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
 
 #define ADV_CONFIG_FLAG      (1 << 0)
 #define SCAN_RSP_CONFIG_FLAG (1 << 1)
 #define URI_PREFIX_HTTPS     (0x17)
 
+/* Beacon scheduler: several frames, each wanted on air every period_ms.
+ * With BLE 5.0 features every frame gets its own advertising set (legacy
+ * PDUs, so any scanner sees them) running at that interval. Otherwise the
+ * single legacy advertiser is time-sliced: every BEACON_SLOT_MS the most
+ * overdue frame is put on air. Telemetry frames are rewritten in place from
+ * live data before they go out. */
+#define BEACON_SLOT_MS          250     // legacy: time each frame stays on air
+#define BEACON_ADV_INTERVAL     0xA0    // legacy: 100 ms, about two events per slot
+
+#define INFO_PERIOD_MS          3000
+#define IBEACON_PERIOD_MS       1000
+#define EDDYSTONE_UID_PERIOD_MS 1000
+#define EDDYSTONE_TLM_PERIOD_MS 5000
+#define SENSOR_PERIOD_MS        2000
+
+#define IBEACON_MEASURED_POWER  (-59)   // RSSI at 1 m
+#define EDDYSTONE_TX_POWER      (-20)   // RSSI at 0 m
+#define ESPRESSIF_COMPANY_ID    0x02E5
+
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 
 static const char *DEMO_TAG = "BLE_BEACON";
@@ -33,8 +58,8 @@ static esp_bd_addr_t local_addr;
 static uint8_t local_addr_type;
 
 static esp_ble_adv_params_t adv_params = {
-    .adv_int_min = 0x20,  // 20ms
-    .adv_int_max = 0x20,  // 20ms
+    .adv_int_min = BEACON_ADV_INTERVAL,
+    .adv_int_max = BEACON_ADV_INTERVAL,
     .adv_type = ADV_TYPE_SCAN_IND,
     .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
     .channel_map = ADV_CHNL_ALL,
@@ -55,6 +80,280 @@ static uint8_t scan_rsp_raw_data[] = {
     0x11, ESP_BLE_AD_TYPE_URI, URI_PREFIX_HTTPS, '/', '/', 'e', 's', 'p', 'r', 'e', 's', 's', 'i', 'f', '.', 'c', 'o', 'm',
 };
 
+// iBeacon: proximity UUID, major, minor, measured power
+static uint8_t ibeacon_raw_data[] = {
+    0x02, ESP_BLE_AD_TYPE_FLAG, 0x06,
+    0x1A, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, 0x4C, 0x00, 0x02, 0x15,
+    0xFD, 0xA5, 0x06, 0x93, 0xA4, 0xE2, 0x4F, 0xB1, 0xAF, 0xCF, 0xC6, 0xEB, 0x07, 0x64, 0x78, 0x25,
+    0x00, 0x01,                 // major
+    0x00, 0x01,                 // minor
+    (uint8_t)IBEACON_MEASURED_POWER,
+};
+
+// Eddystone-UID: namespace, instance (filled with the local address)
+static uint8_t eddystone_uid_raw_data[] = {
+    0x02, ESP_BLE_AD_TYPE_FLAG, 0x06,
+    0x03, ESP_BLE_AD_TYPE_16SRV_CMPL, 0xAA, 0xFE,
+    0x17, ESP_BLE_AD_TYPE_SERVICE_DATA, 0xAA, 0xFE,
+    0x00, (uint8_t)EDDYSTONE_TX_POWER,
+    0xED, 0xD1, 0xEB, 0xEA, 0xC0, 0x4E, 0x5D, 0xEF, 0xA0, 0x17,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,                 // RFU
+};
+#define EDDYSTONE_UID_INSTANCE  23
+
+// Eddystone-TLM (unencrypted): battery, temperature, PDU count, uptime
+static uint8_t eddystone_tlm_raw_data[] = {
+    0x02, ESP_BLE_AD_TYPE_FLAG, 0x06,
+    0x03, ESP_BLE_AD_TYPE_16SRV_CMPL, 0xAA, 0xFE,
+    0x11, ESP_BLE_AD_TYPE_SERVICE_DATA, 0xAA, 0xFE,
+    0x20, 0x00,
+    0x00, 0x00,                 // battery mV, 0 = not measured
+    0x80, 0x00,                 // temperature 8.8 C, 0x8000 = not measured
+    0x00, 0x00, 0x00, 0x00,     // advertising PDUs since boot
+    0x00, 0x00, 0x00, 0x00,     // uptime, 0.1 s
+};
+#define TLM_TEMP                15
+#define TLM_ADV_CNT             17
+#define TLM_SEC_CNT             21
+
+// Sensor telemetry, manufacturer data: sequence, temperature 0.01 C, free heap in bytes, uptime in s
+static uint8_t sensor_raw_data[] = {
+    0x02, ESP_BLE_AD_TYPE_FLAG, 0x06,
+    0x0F, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, ESPRESSIF_COMPANY_ID & 0xFF, ESPRESSIF_COMPANY_ID >> 8,
+    0x01,                       // frame version
+    0x00,                       // sequence
+    0x00, 0x80,                 // temperature, 0x8000 = not measured
+    0x00, 0x00, 0x00, 0x00,     // free heap
+    0x00, 0x00, 0x00, 0x00,     // uptime
+};
+#define SENSOR_SEQ              8
+#define SENSOR_TEMP             9
+#define SENSOR_HEAP             11
+#define SENSOR_UPTIME           15
+
+typedef struct {
+    const char *name;
+    uint8_t *data;
+    uint8_t len;
+    uint32_t period_ms;
+    void (*update)(void);       // refresh live fields in place before sending, may be NULL
+    int64_t due_us;
+} beacon_frame_t;
+
+static void eddystone_tlm_update(void);
+static void sensor_update(void);
+
+static beacon_frame_t beacon_frames[] = {
+    { "info",          adv_raw_data,           sizeof(adv_raw_data),           INFO_PERIOD_MS,          NULL },
+    { "iBeacon",       ibeacon_raw_data,       sizeof(ibeacon_raw_data),       IBEACON_PERIOD_MS,       NULL },
+    { "Eddystone-UID", eddystone_uid_raw_data, sizeof(eddystone_uid_raw_data), EDDYSTONE_UID_PERIOD_MS, NULL },
+    { "Eddystone-TLM", eddystone_tlm_raw_data, sizeof(eddystone_tlm_raw_data), EDDYSTONE_TLM_PERIOD_MS, eddystone_tlm_update },
+    { "sensor",        sensor_raw_data,        sizeof(sensor_raw_data),        SENSOR_PERIOD_MS,        sensor_update },
+};
+#define BEACON_FRAME_NUM (sizeof(beacon_frames) / sizeof(beacon_frames[0]))
+#define BEACON_INFO_FRAME 0     // the only scannable frame, with scan_rsp_raw_data
+
+static esp_timer_handle_t beacon_timer;
+static bool adv_started = false;
+static uint8_t sensor_seq = 0;
+#if SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t temp_sensor = NULL;
+#endif
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+static SemaphoreHandle_t gap_sem = NULL;
+#endif
+
+static void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    put_be16(p, v >> 16);
+    put_be16(p + 2, v & 0xFFFF);
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+static bool read_temperature(float *celsius)
+{
+#if SOC_TEMP_SENSOR_SUPPORTED
+    return temp_sensor && temperature_sensor_get_celsius(temp_sensor, celsius) == ESP_OK;
+#else
+    return false;
+#endif
+}
+
+// Advertising PDUs since boot, from each frame's share of the air time
+static uint32_t beacon_adv_count(int64_t now_us)
+{
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    uint64_t count = 0;
+    for (int i = 0; i < BEACON_FRAME_NUM; i++) {
+        count += now_us / 1000 / beacon_frames[i].period_ms;
+    }
+    return (uint32_t)count;
+#else
+    return (uint32_t)(now_us / 1000 * 8 / (BEACON_ADV_INTERVAL * 5));
+#endif
+}
+
+static void eddystone_tlm_update(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    float t;
+
+    put_be16(&eddystone_tlm_raw_data[TLM_TEMP], read_temperature(&t) ? (uint16_t)(int16_t)(t * 256) : 0x8000);
+    put_be32(&eddystone_tlm_raw_data[TLM_ADV_CNT], beacon_adv_count(now_us));
+    put_be32(&eddystone_tlm_raw_data[TLM_SEC_CNT], (uint32_t)(now_us / 100000));
+}
+
+static void sensor_update(void)
+{
+    float t;
+
+    sensor_raw_data[SENSOR_SEQ] = sensor_seq++;
+    put_le16(&sensor_raw_data[SENSOR_TEMP], read_temperature(&t) ? (uint16_t)(int16_t)(t * 100) : 0x8000);
+    put_le32(&sensor_raw_data[SENSOR_HEAP], (uint32_t)esp_get_free_heap_size());
+    put_le32(&sensor_raw_data[SENSOR_UPTIME], (uint32_t)(esp_timer_get_time() / 1000000));
+}
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+#define GAP_WAIT() xSemaphoreTake(gap_sem, pdMS_TO_TICKS(1000))
+
+// Every BEACON_SLOT_MS: refresh the telemetry sets that are due
+static void beacon_tick(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    for (int i = 0; i < BEACON_FRAME_NUM; i++) {
+        beacon_frame_t *f = &beacon_frames[i];
+        if (f->update && now_us >= f->due_us) {
+            f->update();
+            esp_ble_gap_config_ext_adv_data_raw(i, f->len, f->data);
+            f->due_us = now_us + f->period_ms * 1000LL;
+        }
+    }
+}
+
+// One legacy PDU advertising set per frame at the frame's own interval
+static esp_err_t beacon_start(void)
+{
+    esp_ble_gap_ext_adv_t ext_adv[BEACON_FRAME_NUM];
+    esp_err_t ret;
+
+    gap_sem = xSemaphoreCreateBinary();
+    if (gap_sem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < BEACON_FRAME_NUM; i++) {
+        beacon_frame_t *f = &beacon_frames[i];
+        uint32_t interval = f->period_ms * 8 / 5;   // 0.625 ms units
+        esp_ble_gap_ext_adv_params_t params = {
+            .type = i == BEACON_INFO_FRAME ? ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_SCAN : ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_NONCONN,
+            .interval_min = interval,
+            .interval_max = interval,
+            .channel_map = ADV_CHNL_ALL,
+            .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+            .filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+            .tx_power = EXT_ADV_TX_PWR_NO_PREFERENCE,
+            .primary_phy = ESP_BLE_GAP_PHY_1M,
+            .max_skip = 0,
+            .secondary_phy = ESP_BLE_GAP_PHY_1M,
+            .sid = i,
+            .scan_req_notif = false,
+        };
+
+        if (f->update) {
+            f->update();
+        }
+        ret = esp_ble_gap_ext_adv_set_params(i, &params);
+        if (ret == ESP_OK) {
+            GAP_WAIT();
+            ret = esp_ble_gap_config_ext_adv_data_raw(i, f->len, f->data);
+        }
+        if (ret == ESP_OK) {
+            GAP_WAIT();
+        }
+        if (ret == ESP_OK && i == BEACON_INFO_FRAME) {
+            ret = esp_ble_gap_config_ext_scan_rsp_data_raw(i, sizeof(scan_rsp_raw_data), scan_rsp_raw_data);
+            if (ret == ESP_OK) {
+                GAP_WAIT();
+            }
+        }
+        if (ret) {
+            ESP_LOGE(DEMO_TAG, "config advertising set %d (%s) failed, error code = %x", i, f->name, ret);
+            return ret;
+        }
+        f->due_us = esp_timer_get_time() + f->period_ms * 1000LL;
+        ext_adv[i] = (esp_ble_gap_ext_adv_t) { .instance = i, .duration = 0, .max_events = 0 };
+    }
+
+    ret = esp_ble_gap_ext_adv_start(BEACON_FRAME_NUM, ext_adv);
+    if (ret) {
+        return ret;
+    }
+    return esp_timer_start_periodic(beacon_timer, BEACON_SLOT_MS * 1000);
+}
+#else
+// Every BEACON_SLOT_MS: put the most overdue frame on air
+static void beacon_tick(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    beacon_frame_t *next = &beacon_frames[0];
+
+    for (int i = 1; i < BEACON_FRAME_NUM; i++) {
+        if (beacon_frames[i].due_us < next->due_us) {
+            next = &beacon_frames[i];
+        }
+    }
+
+    // A frame that fell behind restarts from now instead of catching up
+    next->due_us += next->period_ms * 1000LL;
+    if (next->due_us < now_us) {
+        next->due_us = now_us + next->period_ms * 1000LL;
+    }
+    if (next->update) {
+        next->update();
+    }
+    esp_ble_gap_config_adv_data_raw(next->data, next->len);
+}
+
+static esp_err_t beacon_start(void)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    // Staggered start so the frames do not all fall due together
+    for (int i = 0; i < BEACON_FRAME_NUM; i++) {
+        beacon_frames[i].due_us = now_us + i * BEACON_SLOT_MS * 1000LL;
+    }
+
+    adv_config_done |= ADV_CONFIG_FLAG;
+    adv_config_done |= SCAN_RSP_CONFIG_FLAG;
+    beacon_tick(NULL);
+
+    esp_err_t ret = esp_ble_gap_config_scan_rsp_data_raw(scan_rsp_raw_data, sizeof(scan_rsp_raw_data));
+    if (ret) {
+        ESP_LOGE(DEMO_TAG, "config scan rsp data failed, error code = %x", ret);
+    }
+    return esp_timer_start_periodic(beacon_timer, BEACON_SLOT_MS * 1000);
+}
+#endif
+
 void app_main(void)
 {
     esp_err_t ret;
@@ -107,15 +406,6 @@ void app_main(void)
         return;
     }
 
-    //config adv data
-    adv_config_done |= ADV_CONFIG_FLAG;
-    adv_config_done |= SCAN_RSP_CONFIG_FLAG;
-    ret = esp_ble_gap_config_adv_data_raw(adv_raw_data, sizeof(adv_raw_data));
-    if (ret) {
-        ESP_LOGE(DEMO_TAG, "config adv data failed, error code = %x", ret);
-        return;
-    }
-
     ret = esp_ble_gap_get_local_used_addr(local_addr, &local_addr_type);
     if (ret) {
         ESP_LOGE(DEMO_TAG, "get local used address failed, error code = %x", ret);
@@ -128,9 +418,26 @@ void app_main(void)
     scan_rsp_raw_data[5] = local_addr[2];
     scan_rsp_raw_data[6] = local_addr[1];
     scan_rsp_raw_data[7] = local_addr[0];
-    ret = esp_ble_gap_config_scan_rsp_data_raw(scan_rsp_raw_data, sizeof(scan_rsp_raw_data));
+    memcpy(&eddystone_uid_raw_data[EDDYSTONE_UID_INSTANCE], local_addr, sizeof(esp_bd_addr_t));
+
+#if SOC_TEMP_SENSOR_SUPPORTED
+    temperature_sensor_config_t temp_cfg = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    if (temperature_sensor_install(&temp_cfg, &temp_sensor) != ESP_OK || temperature_sensor_enable(temp_sensor) != ESP_OK) {
+        ESP_LOGW(DEMO_TAG, "temperature sensor unavailable, telemetry without temperature");
+        temp_sensor = NULL;
+    }
+#endif
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = beacon_tick,
+        .name = "beacon",
+    };
+    ret = esp_timer_create(&timer_args, &beacon_timer);
+    if (ret == ESP_OK) {
+        ret = beacon_start();
+    }
     if (ret) {
-        ESP_LOGE(DEMO_TAG, "config scan rsp data failed, error code = %x", ret);
+        ESP_LOGE(DEMO_TAG, "beacon start failed, error code = %x", ret);
     }
 }
 
@@ -140,28 +447,29 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
     case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
         ESP_LOGI(DEMO_TAG, "Advertising data set, status %d", param->adv_data_cmpl.status);
         adv_config_done &= (~ADV_CONFIG_FLAG);
-        if (adv_config_done == 0) {
+        if (adv_config_done == 0 && !adv_started) {
             esp_ble_gap_start_advertising(&adv_params);
         }
         break;
     case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
-        ESP_LOGI(DEMO_TAG, "Advertising data raw set, status %d", param->adv_data_raw_cmpl.status);
+        // Raised for every frame the scheduler puts on air
+        ESP_LOGD(DEMO_TAG, "Advertising data raw set, status %d", param->adv_data_raw_cmpl.status);
         adv_config_done &= (~ADV_CONFIG_FLAG);
-        if (adv_config_done == 0) {
+        if (adv_config_done == 0 && !adv_started) {
             esp_ble_gap_start_advertising(&adv_params);
         }
         break;
     case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
         ESP_LOGI(DEMO_TAG, "Scan response data set, status %d", param->scan_rsp_data_cmpl.status);
         adv_config_done &= (~SCAN_RSP_CONFIG_FLAG);
-        if (adv_config_done == 0) {
+        if (adv_config_done == 0 && !adv_started) {
             esp_ble_gap_start_advertising(&adv_params);
         }
         break;
     case ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT:
         ESP_LOGI(DEMO_TAG, "Scan response data raw set, status %d", param->scan_rsp_data_raw_cmpl.status);
         adv_config_done &= (~SCAN_RSP_CONFIG_FLAG);
-        if (adv_config_done == 0) {
+        if (adv_config_done == 0 && !adv_started) {
             esp_ble_gap_start_advertising(&adv_params);
         }
         break;
@@ -170,8 +478,35 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             ESP_LOGE(DEMO_TAG, "Advertising start failed, status %d", param->adv_start_cmpl.status);
             break;
         }
-        ESP_LOGI(DEMO_TAG, "Advertising start successfully");
+        adv_started = true;
+        ESP_LOGI(DEMO_TAG, "Advertising start successfully, %d frames every %d ms slot",
+                 (int)BEACON_FRAME_NUM, BEACON_SLOT_MS);
+        break;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_EXT_ADV_SET_PARAMS_COMPLETE_EVT:
+        ESP_LOGI(DEMO_TAG, "Advertising set %d params set, status %d",
+                 param->ext_adv_set_params.instance, param->ext_adv_set_params.status);
+        xSemaphoreGive(gap_sem);
+        break;
+    case ESP_GAP_BLE_EXT_ADV_DATA_SET_COMPLETE_EVT:
+        // Raised again for every telemetry refresh
+        ESP_LOGD(DEMO_TAG, "Advertising set %d data set, status %d",
+                 param->ext_adv_data_set.instance, param->ext_adv_data_set.status);
+        xSemaphoreGive(gap_sem);
+        break;
+    case ESP_GAP_BLE_EXT_SCAN_RSP_DATA_SET_COMPLETE_EVT:
+        ESP_LOGI(DEMO_TAG, "Advertising set %d scan response set, status %d",
+                 param->scan_rsp_set.instance, param->scan_rsp_set.status);
+        xSemaphoreGive(gap_sem);
+        break;
+    case ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT:
+        if (param->ext_adv_start.status != ESP_BT_STATUS_SUCCESS) {
+            ESP_LOGE(DEMO_TAG, "Advertising sets start failed, status %d", param->ext_adv_start.status);
+            break;
+        }
+        ESP_LOGI(DEMO_TAG, "Advertising start successfully, %d sets", param->ext_adv_start.instance_num);
         break;
+#endif
     default:
         break;
     }
@@ -24,14 +24,27 @@
 #include "heart_rate.h"
 #include "led.h"
 
-#define PROFILE_NUM 2
+#define PROFILE_NUM 3
 #define HEART_PROFILE_APP_ID 0
 #define AUTO_IO_PROFILE_APP_ID 1
+#define THROUGHPUT_PROFILE_APP_ID 2
 #define HEART_RATE_SVC_UUID 0x180D
 #define HEART_RATE_CHAR_UUID 0x2A37
 #define HEART_NUM_HANDLE 4
 #define AUTO_IO_SVC_UUID 0x1815
 #define AUTO_IO_NUM_HANDLE 3
+#define THROUGHPUT_NUM_HANDLE 4
+
+/* Throughput test: once the client enables notifications on the stream
+ * characteristic, notifications of MTU - 3 bytes go out back-to-back,
+ * paced by the controller's free ACL buffers and the stack's congestion
+ * events. Each one starts with a
+ * 32-bit sequence number so the client can count losses. */
+#define LOCAL_MTU                   500
+#define THROUGHPUT_MAX_PAYLOAD      (LOCAL_MTU - 3)
+#define THROUGHPUT_TX_OCTETS        251     // data length extension, the LE maximum
+#define THROUGHPUT_REPORT_MS        1000
+#define THROUGHPUT_CONGEST_WAIT_MS  10
 
 #define ADV_CONFIG_FLAG      (1 << 0)
 #define SCAN_RSP_CONFIG_FLAG (1 << 1)
@@ -54,6 +67,7 @@ struct gatts_profile_inst {
 ///Declare the static function
 static void heart_gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void auto_io_gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+static void throughput_gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void example_write_event_env(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 
 static const char *GATTS_TAG = "GATTS_DEMO";
@@ -65,6 +79,16 @@ static bool indicate_enabled = false;
 static bool hrs_create_cmpl = false;  // Heart Rate Service
 static uint8_t adv_config_done = 0;
 
+static uint8_t throughput_val[THROUGHPUT_MAX_PAYLOAD] = {0};
+static TaskHandle_t throughput_task_hdl = NULL;
+static volatile bool throughput_enabled = false;
+static volatile bool throughput_congested = false;
+static volatile uint16_t throughput_mtu = 23;
+static volatile uint16_t throughput_conn_int = 0;    // 1.25 ms units
+static volatile uint32_t throughput_sent_pkts = 0;   // handed to the controller
+static volatile uint32_t throughput_sent_bytes = 0;  // payload of those
+static volatile uint32_t throughput_dropped = 0;     // refused by the stack
+
 static esp_attr_value_t heart_rate_attr = {
     .attr_max_len = 2,
     .attr_len     = sizeof(heart_rate_val),
@@ -77,6 +101,20 @@ static esp_attr_value_t led_status_attr = {
     .attr_value   = led_status,
 };
 
+static esp_attr_value_t throughput_attr = {
+    .attr_max_len = THROUGHPUT_MAX_PAYLOAD,
+    .attr_len     = 4,
+    .attr_value   = throughput_val,
+};
+
+static const uint8_t throughput_svc_uuid[] = {
+    0x10, 0x4a, 0x8e, 0x5c, 0x1b, 0x6f, 0x2a, 0x9d, 0x52, 0x4f, 0x1e, 0x7c, 0x01, 0x00, 0x6a, 0x3b
+};
+
+static const uint8_t throughput_chr_uuid[] = {
+    0x10, 0x4a, 0x8e, 0x5c, 0x1b, 0x6f, 0x2a, 0x9d, 0x52, 0x4f, 0x1e, 0x7c, 0x02, 0x00, 0x6a, 0x3b
+};
+
 static const uint8_t led_chr_uuid[] = {
     0x23, 0xd1, 0xbc, 0xea, 0x5f, 0x78, 0x23, 0x15, 0xde, 0xef, 0x12, 0x12, 0x25, 0x15, 0x00, 0x00
 };
@@ -115,6 +153,10 @@ static struct gatts_profile_inst gl_profile_tab[PROFILE_NUM] = {
         .gatts_cb = auto_io_gatts_profile_event_handler,
         .gatts_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
     },
+    [THROUGHPUT_PROFILE_APP_ID] = {
+        .gatts_cb = throughput_gatts_profile_event_handler,
+        .gatts_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
+    },
 };
 
 static void heart_rate_task(void* param)
@@ -134,6 +176,79 @@ static void heart_rate_task(void* param)
     }
 }
 
+static uint16_t throughput_payload_len(void)
+{
+    uint16_t len = throughput_mtu - 3;
+    return len > sizeof(throughput_val) ? sizeof(throughput_val) : len;
+}
+
+static void throughput_report(uint32_t pkts, uint32_t bytes, uint32_t dropped, uint32_t elapsed_ms)
+{
+    uint32_t kbps = (uint32_t)((uint64_t)bytes * 8 / elapsed_ms);
+    uint32_t events = throughput_conn_int ? (uint32_t)((uint64_t)elapsed_ms * 4 / (throughput_conn_int * 5)) : 0;
+
+    // notifications per connection event in hundredths
+    uint32_t per_event_x100 = events ? pkts * 100 / events : 0;
+    ESP_LOGI(GATTS_TAG, "Throughput %" PRIu32 " kbit/s, %" PRIu32 " notifications (%" PRIu32 ".%02" PRIu32 " per event), "
+             "%" PRIu32 " dropped, MTU %d, interval %d.%02d ms",
+             kbps, pkts, per_event_x100 / 100, per_event_x100 % 100, dropped, throughput_mtu,
+             throughput_conn_int * 5 / 4, throughput_conn_int * 125 % 100);
+}
+
+static void throughput_task(void* param)
+{
+    uint32_t seq = 0;
+    uint32_t last_pkts = 0, last_bytes = 0, last_dropped = 0;
+    TickType_t last_report = xTaskGetTickCount();
+
+    ESP_LOGI(GATTS_TAG, "Throughput Task Start");
+    for (int i = 4; i < sizeof(throughput_val); i++) {
+        throughput_val[i] = i & 0xff;
+    }
+
+    while (1) {
+        if (!throughput_enabled) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_pkts = throughput_sent_pkts;
+            last_bytes = throughput_sent_bytes;
+            last_dropped = throughput_dropped;
+            last_report = xTaskGetTickCount();
+            continue;
+        }
+
+        int free_pkts = throughput_congested ? 0 :
+                        esp_ble_get_cur_sendable_packets_num(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].conn_id);
+        if (free_pkts <= 0) {
+            // woken when the congestion clears, otherwise poll for free buffers
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(THROUGHPUT_CONGEST_WAIT_MS));
+        }
+        for (; free_pkts > 0 && throughput_enabled && !throughput_congested; free_pkts--) {
+            uint16_t len = throughput_payload_len();
+            memcpy(throughput_val, &seq, sizeof(seq));
+            if (esp_ble_gatts_send_indicate(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].gatts_if,
+                                            gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].conn_id,
+                                            gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].char_handle,
+                                            len, throughput_val, false) != ESP_OK) {
+                throughput_dropped++;
+                vTaskDelay(1);
+                break;
+            }
+            seq++;
+        }
+
+        TickType_t now = xTaskGetTickCount();
+        if (now - last_report >= pdMS_TO_TICKS(THROUGHPUT_REPORT_MS)) {
+            uint32_t pkts = throughput_sent_pkts, bytes = throughput_sent_bytes, dropped = throughput_dropped;
+            throughput_report(pkts - last_pkts, bytes - last_bytes, dropped - last_dropped,
+                              (now - last_report) * portTICK_PERIOD_MS);
+            last_pkts = pkts;
+            last_bytes = bytes;
+            last_dropped = dropped;
+            last_report = now;
+        }
+    }
+}
+
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
     switch (event) {
@@ -164,6 +279,9 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
                  param->update_conn_params.conn_int,
                  param->update_conn_params.latency,
                  param->update_conn_params.timeout);
+        if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+            throughput_conn_int = param->update_conn_params.conn_int;
+        }
         break;
     case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
         ESP_LOGI(GATTS_TAG, "Packet length update, status %d, rx %d, tx %d",
@@ -171,6 +289,12 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
                  param->pkt_data_length_cmpl.params.rx_len,
                  param->pkt_data_length_cmpl.params.tx_len);
         break;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+        ESP_LOGI(GATTS_TAG, "PHY update, status %d, tx %d, rx %d",
+                 param->phy_update.status, param->phy_update.tx_phy, param->phy_update.rx_phy);
+        break;
+#endif
     default:
         break;
     }
@@ -405,6 +529,105 @@ static void auto_io_gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_
     }
 }
 
+static void throughput_gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_GATTS_REG_EVT:
+        ESP_LOGI(GATTS_TAG, "GATT server register, status %d, app_id %d", param->reg.status, param->reg.app_id);
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_id.is_primary = true;
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_id.id.inst_id = 0x00;
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_id.id.uuid.len = ESP_UUID_LEN_128;
+        memcpy(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_id.id.uuid.uuid.uuid128, throughput_svc_uuid, ESP_UUID_LEN_128);
+        esp_ble_gatts_create_service(gatts_if, &gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_id, THROUGHPUT_NUM_HANDLE);
+        break;
+    case ESP_GATTS_CREATE_EVT:
+        ESP_LOGI(GATTS_TAG, "Service create, status %d, service_handle %d", param->create.status, param->create.service_handle);
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_handle = param->create.service_handle;
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].char_uuid.len = ESP_UUID_LEN_128;
+        memcpy(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].char_uuid.uuid.uuid128, throughput_chr_uuid, ESP_UUID_LEN_128);
+        esp_ble_gatts_start_service(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_handle);
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].property = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+        esp_err_t ret = esp_ble_gatts_add_char(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_handle, &gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].char_uuid,
+                            ESP_GATT_PERM_READ,
+                            gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].property,
+                            &throughput_attr, NULL);
+        if (ret) {
+            ESP_LOGE(GATTS_TAG, "add char failed, error code = %x", ret);
+        }
+        break;
+    case ESP_GATTS_ADD_CHAR_EVT:
+        ESP_LOGI(GATTS_TAG, "Characteristic add, status %d, attr_handle %d",
+                 param->add_char.status, param->add_char.attr_handle);
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].char_handle = param->add_char.attr_handle;
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].descr_uuid.len = ESP_UUID_LEN_16;
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].descr_uuid.uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+        ret = esp_ble_gatts_add_char_descr(gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].service_handle, &gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].descr_uuid,
+                            ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, NULL, NULL);
+        if (ret) {
+            ESP_LOGE(GATTS_TAG, "add char descr failed, error code = %x", ret);
+        }
+        break;
+    case ESP_GATTS_ADD_CHAR_DESCR_EVT:
+        ESP_LOGI(GATTS_TAG, "Descriptor add, status %d, attr_handle %u",
+                 param->add_char_descr.status, param->add_char_descr.attr_handle);
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].descr_handle = param->add_char_descr.attr_handle;
+        break;
+    case ESP_GATTS_WRITE_EVT:
+        if (gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].descr_handle == param->write.handle && param->write.len == 2) {
+            uint16_t descr_value = param->write.value[1]<<8 | param->write.value[0];
+            throughput_enabled = descr_value == 0x0001;
+            ESP_LOGI(GATTS_TAG, "Throughput stream %s, payload %d bytes",
+                     throughput_enabled ? "start" : "stop", throughput_payload_len());
+            if (throughput_task_hdl) {
+                xTaskNotifyGive(throughput_task_hdl);
+            }
+        }
+        example_write_event_env(gatts_if, param);
+        break;
+    case ESP_GATTS_MTU_EVT:
+        ESP_LOGI(GATTS_TAG, "MTU exchange, MTU %d", param->mtu.mtu);
+        throughput_mtu = param->mtu.mtu;
+        break;
+    case ESP_GATTS_START_EVT:
+        ESP_LOGI(GATTS_TAG, "Service start, status %d, service_handle %d", param->start.status, param->start.service_handle);
+        break;
+    case ESP_GATTS_CONNECT_EVT:
+        gl_profile_tab[THROUGHPUT_PROFILE_APP_ID].conn_id = param->connect.conn_id;
+        throughput_mtu = 23;
+        throughput_conn_int = param->connect.conn_params.interval;
+        throughput_congested = false;
+        // The client starts the MTU exchange (local MTU is LOCAL_MTU); ask for
+        // the longest link layer packets and, where the controller has it, 2M PHY
+        esp_ble_gap_set_pkt_data_len(param->connect.remote_bda, THROUGHPUT_TX_OCTETS);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        esp_ble_gap_set_preferred_phy(param->connect.remote_bda, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+#endif
+        break;
+    case ESP_GATTS_DISCONNECT_EVT:
+        throughput_enabled = false;
+        throughput_congested = false;
+        break;
+    case ESP_GATTS_CONGEST_EVT:
+        throughput_congested = param->congest.congested;
+        if (!throughput_congested && throughput_task_hdl) {
+            xTaskNotifyGive(throughput_task_hdl);
+        }
+        break;
+    case ESP_GATTS_CONF_EVT:
+        // Raised for every notification once the stack has handled it;
+        // CONGESTED means it was queued and filled the channel, not lost
+        if (param->conf.status == ESP_GATT_OK || param->conf.status == ESP_GATT_CONGESTED) {
+            throughput_sent_pkts++;
+            throughput_sent_bytes += throughput_payload_len();
+        } else {
+            throughput_dropped++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
 {
     if (event == ESP_GATTS_REG_EVT) {
@@ -499,12 +722,19 @@ void app_main(void)
         return;
     }
 
-    ret = esp_ble_gatt_set_local_mtu(500);
+    ret = esp_ble_gatts_app_register(THROUGHPUT_PROFILE_APP_ID);
+    if (ret) {
+        ESP_LOGE(GATTS_TAG, "app register error, error code = %x", ret);
+        return;
+    }
+
+    ret = esp_ble_gatt_set_local_mtu(LOCAL_MTU);
     if (ret) {
         ESP_LOGE(GATTS_TAG, "set local  MTU failed, error code = %x", ret);
     }
 
     xTaskCreate(heart_rate_task, "Heart Rate", 2 * 1024, NULL, 5, NULL);
+    xTaskCreate(throughput_task, "Throughput", 3 * 1024, NULL, 4, &throughput_task_hdl);
 }
 
 void example_write_event_env(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
@@ -205,12 +205,6 @@ void ble_hid_demo_task_mouse(void *pvParameters)
 #endif
 
 #if CONFIG_EXAMPLE_HID_DEVICE_ROLE && CONFIG_EXAMPLE_HID_DEVICE_ROLE == 2
-#define CASE(a, b, c)  \
-                case a: \
-				buffer[0] = b;  \
-				buffer[2] = c; \
-                break;\
-
 // USB keyboard codes
 #define USB_HID_MODIFIER_LEFT_CTRL      0x01
 #define USB_HID_MODIFIER_LEFT_SHIFT     0x02
@@ -219,15 +213,7 @@ void ble_hid_demo_task_mouse(void *pvParameters)
 #define USB_HID_MODIFIER_RIGHT_SHIFT    0x20
 #define USB_HID_MODIFIER_RIGHT_ALT      0x40
 
-#define USB_HID_SPACE                   0x2C
-#define USB_HID_DOT                     0x37
-#define USB_HID_NEWLINE                 0x28
-#define USB_HID_FSLASH                  0x38
-#define USB_HID_BSLASH                  0x31
-#define USB_HID_COMMA                   0x36
-#define USB_HID_DOT                     0x37
-
-const unsigned char keyboardReportMap[] = { //7 bytes input (modifiers, resrvd, keys*5), 1 byte output
+const unsigned char keyboardReportMap[] = { //8 bytes input (modifiers, resrvd, keys*6), 1 byte output
     0x05, 0x01,        // Usage Page (Generic Desktop Ctrls)
     0x09, 0x06,        // Usage (Keyboard)
     0xA1, 0x01,        // Collection (Application)
@@ -252,7 +238,7 @@ const unsigned char keyboardReportMap[] = { //7 bytes input (modifiers, resrvd,
     0x95, 0x01,        //   Report Count (1)
     0x75, 0x03,        //   Report Size (3)
     0x91, 0x03,        //   Output (Const,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
-    0x95, 0x05,        //   Report Count (5)
+    0x95, 0x06,        //   Report Count (6)
     0x75, 0x08,        //   Report Size (8)
     0x15, 0x00,        //   Logical Minimum (0)
     0x25, 0x65,        //   Logical Maximum (101)
@@ -265,83 +251,108 @@ const unsigned char keyboardReportMap[] = { //7 bytes input (modifiers, resrvd,
     // 65 bytes
 };
 
-static void char_to_code(uint8_t *buffer, char ch)
+#define KEYBOARD_RPT_LEN                8
+#define KEYBOARD_RPT_KEYS               6       // key array slots, 6KRO
+#define KEYBOARD_RPT_DELAY_MS           15      // between reports, about one connection interval
+
+typedef struct
 {
-	// Check if lower or upper case
-	if(ch >= 'a' && ch <= 'z')
-	{
-		buffer[0] = 0;
-		// convert ch to HID letter, starting at a = 4
-		buffer[2] = (uint8_t)(4 + (ch - 'a'));
-	}
-	else if(ch >= 'A' && ch <= 'Z')
-	{
-		// Add left shift
-		buffer[0] = USB_HID_MODIFIER_LEFT_SHIFT;
-		// convert ch to lower case
-		ch = ch - ('A'-'a');
-		// convert ch to HID letter, starting at a = 4
-		buffer[2] = (uint8_t)(4 + (ch - 'a'));
-	}
-	else if(ch >= '0' && ch <= '9') // Check if number
-	{
-		buffer[0] = 0;
-		// convert ch to HID number, starting at 1 = 30, 0 = 39
-		if(ch == '0')
-		{
-			buffer[2] = 39;
-		}
-		else
-		{
-			buffer[2] = (uint8_t)(30 + (ch - '1'));
-		}
-	}
-	else // not a letter nor a number
-	{
-		switch(ch)
-		{
-            CASE(' ', 0, USB_HID_SPACE);
-			CASE('.', 0,USB_HID_DOT);
-            CASE('\n', 0, USB_HID_NEWLINE);
-			CASE('?', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_FSLASH);
-			CASE('/', 0 ,USB_HID_FSLASH);
-			CASE('\\', 0, USB_HID_BSLASH);
-			CASE('|', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_BSLASH);
-			CASE(',', 0, USB_HID_COMMA);
-			CASE('<', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_COMMA);
-			CASE('>', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_COMMA);
-			CASE('@', USB_HID_MODIFIER_LEFT_SHIFT, 31);
-			CASE('!', USB_HID_MODIFIER_LEFT_SHIFT, 30);
-			CASE('#', USB_HID_MODIFIER_LEFT_SHIFT, 32);
-			CASE('$', USB_HID_MODIFIER_LEFT_SHIFT, 33);
-			CASE('%', USB_HID_MODIFIER_LEFT_SHIFT, 34);
-			CASE('^', USB_HID_MODIFIER_LEFT_SHIFT,35);
-			CASE('&', USB_HID_MODIFIER_LEFT_SHIFT, 36);
-			CASE('*', USB_HID_MODIFIER_LEFT_SHIFT, 37);
-			CASE('(', USB_HID_MODIFIER_LEFT_SHIFT, 38);
-			CASE(')', USB_HID_MODIFIER_LEFT_SHIFT, 39);
-			CASE('-', 0, 0x2D);
-			CASE('_', USB_HID_MODIFIER_LEFT_SHIFT, 0x2D);
-			CASE('=', 0, 0x2E);
-			CASE('+', USB_HID_MODIFIER_LEFT_SHIFT, 39);
-			CASE(8, 0, 0x2A); // backspace
-			CASE('\t', 0, 0x2B);
-			default:
-				buffer[0] = 0;
-				buffer[2] = 0;
-		}
-	}
+    uint8_t modifier;
+    uint8_t keycode;        // 0 = not typeable
+} key_code_t;
+
+// ASCII to (modifier, usage) on a US layout
+#define SHIFT USB_HID_MODIFIER_LEFT_SHIFT
+static const key_code_t ascii_to_key[128] = {
+    ['\b'] = {     0, 0x2A },   ['\t'] = {     0, 0x2B },   ['\n'] = {     0, 0x28 },   [' '] = {     0, 0x2C },
+    ['!'] = { SHIFT, 0x1E },    ['"'] = { SHIFT, 0x34 },    ['#'] = { SHIFT, 0x20 },    ['$'] = { SHIFT, 0x21 },
+    ['%'] = { SHIFT, 0x22 },    ['&'] = { SHIFT, 0x24 },    ['\''] = {     0, 0x34 },   ['('] = { SHIFT, 0x26 },
+    [')'] = { SHIFT, 0x27 },    ['*'] = { SHIFT, 0x25 },    ['+'] = { SHIFT, 0x2E },    [','] = {     0, 0x36 },
+    ['-'] = {     0, 0x2D },    ['.'] = {     0, 0x37 },    ['/'] = {     0, 0x38 },    ['0'] = {     0, 0x27 },
+    ['1'] = {     0, 0x1E },    ['2'] = {     0, 0x1F },    ['3'] = {     0, 0x20 },    ['4'] = {     0, 0x21 },
+    ['5'] = {     0, 0x22 },    ['6'] = {     0, 0x23 },    ['7'] = {     0, 0x24 },    ['8'] = {     0, 0x25 },
+    ['9'] = {     0, 0x26 },    [':'] = { SHIFT, 0x33 },    [';'] = {     0, 0x33 },    ['<'] = { SHIFT, 0x36 },
+    ['='] = {     0, 0x2E },    ['>'] = { SHIFT, 0x37 },    ['?'] = { SHIFT, 0x38 },    ['@'] = { SHIFT, 0x1F },
+    ['A'] = { SHIFT, 0x04 },    ['B'] = { SHIFT, 0x05 },    ['C'] = { SHIFT, 0x06 },    ['D'] = { SHIFT, 0x07 },
+    ['E'] = { SHIFT, 0x08 },    ['F'] = { SHIFT, 0x09 },    ['G'] = { SHIFT, 0x0A },    ['H'] = { SHIFT, 0x0B },
+    ['I'] = { SHIFT, 0x0C },    ['J'] = { SHIFT, 0x0D },    ['K'] = { SHIFT, 0x0E },    ['L'] = { SHIFT, 0x0F },
+    ['M'] = { SHIFT, 0x10 },    ['N'] = { SHIFT, 0x11 },    ['O'] = { SHIFT, 0x12 },    ['P'] = { SHIFT, 0x13 },
+    ['Q'] = { SHIFT, 0x14 },    ['R'] = { SHIFT, 0x15 },    ['S'] = { SHIFT, 0x16 },    ['T'] = { SHIFT, 0x17 },
+    ['U'] = { SHIFT, 0x18 },    ['V'] = { SHIFT, 0x19 },    ['W'] = { SHIFT, 0x1A },    ['X'] = { SHIFT, 0x1B },
+    ['Y'] = { SHIFT, 0x1C },    ['Z'] = { SHIFT, 0x1D },    ['['] = {     0, 0x2F },    ['\\'] = {     0, 0x31 },
+    [']'] = {     0, 0x30 },    ['^'] = { SHIFT, 0x23 },    ['_'] = { SHIFT, 0x2D },    ['`'] = {     0, 0x35 },
+    ['a'] = {     0, 0x04 },    ['b'] = {     0, 0x05 },    ['c'] = {     0, 0x06 },    ['d'] = {     0, 0x07 },
+    ['e'] = {     0, 0x08 },    ['f'] = {     0, 0x09 },    ['g'] = {     0, 0x0A },    ['h'] = {     0, 0x0B },
+    ['i'] = {     0, 0x0C },    ['j'] = {     0, 0x0D },    ['k'] = {     0, 0x0E },    ['l'] = {     0, 0x0F },
+    ['m'] = {     0, 0x10 },    ['n'] = {     0, 0x11 },    ['o'] = {     0, 0x12 },    ['p'] = {     0, 0x13 },
+    ['q'] = {     0, 0x14 },    ['r'] = {     0, 0x15 },    ['s'] = {     0, 0x16 },    ['t'] = {     0, 0x17 },
+    ['u'] = {     0, 0x18 },    ['v'] = {     0, 0x19 },    ['w'] = {     0, 0x1A },    ['x'] = {     0, 0x1B },
+    ['y'] = {     0, 0x1C },    ['z'] = {     0, 0x1D },    ['{'] = { SHIFT, 0x2F },    ['|'] = { SHIFT, 0x31 },
+    ['}'] = { SHIFT, 0x30 },    ['~'] = { SHIFT, 0x35 },
+};
+#undef SHIFT
+
+static void send_keyboard_report(const uint8_t *buffer)
+{
+    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 1, (uint8_t *)buffer, KEYBOARD_RPT_LEN);
+    vTaskDelay(pdMS_TO_TICKS(KEYBOARD_RPT_DELAY_MS));
 }
 
-void send_keyboard(char c)
+/*
+ * Type a string with as few reports as possible: up to KEYBOARD_RPT_KEYS
+ * characters that share a modifier go down together in one report, and the
+ * next report replaces them, which the host sees as releasing the old keys
+ * and pressing the new ones. An all-up report is only needed when a key
+ * repeats (it must come up before it can go down again) or the modifier
+ * changes. Hosts report keys pressed in one report in array order.
+ */
+void send_keyboard_string(const char *str, size_t len)
 {
-    static uint8_t buffer[8] = {0};
-    char_to_code(buffer, c);
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 1, buffer, 8);
-    /* send the keyrelease event with sufficient delay */
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    memset(buffer, 0, sizeof(uint8_t) * 8);
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 1, buffer, 8);
+    uint8_t buffer[KEYBOARD_RPT_LEN] = {0};
+    uint8_t held[KEYBOARD_RPT_KEYS] = {0};
+    int n_held = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        uint8_t next[KEYBOARD_RPT_LEN] = {0};
+        int n = 0;
+
+        for (; i < len && n < KEYBOARD_RPT_KEYS; i++) {
+            uint8_t ch = (uint8_t)str[i];
+            if (ch > 0x7F || !ascii_to_key[ch].keycode) {
+                continue;
+            }
+            const key_code_t *key = &ascii_to_key[ch];
+            if (n && (key->modifier != next[0] || memchr(&next[2], key->keycode, n))) {
+                break;
+            }
+            next[0] = key->modifier;
+            next[2 + n++] = key->keycode;
+        }
+        if (!n) {
+            continue;
+        }
+
+        // Release first if a key stays down or the modifier changes
+        bool release = n_held && buffer[0] != next[0];
+        for (int k = 0; k < n && !release; k++) {
+            release = memchr(held, next[2 + k], n_held) != NULL;
+        }
+        if (release) {
+            memset(buffer, 0, sizeof(buffer));
+            send_keyboard_report(buffer);
+        }
+
+        memcpy(buffer, next, sizeof(buffer));
+        memcpy(held, &next[2], n);
+        n_held = n;
+        send_keyboard_report(buffer);
+    }
+
+    if (n_held) {
+        memset(buffer, 0, sizeof(buffer));
+        send_keyboard_report(buffer);
+    }
 }
 
 void ble_hid_demo_task_kbd(void *pvParameters)
@@ -351,14 +362,21 @@ void ble_hid_demo_task_kbd(void *pvParameters)
                                       "########################################################################\n";
                                     /* TODO : Add support for function keys and ctrl, alt, esc, etc. */
     printf("%s\n", help_string);
-    char c;
+    char line[64];
+    size_t len = 0;
     while (1) {
-        c = fgetc(stdin);
-
-        if(c != 255) {
-            send_keyboard(c);
+        // Collect what has been typed so far and send it as one string
+        int c = fgetc(stdin);
+        if (c != EOF && c != 255) {
+            line[len++] = (char)c;
+        }
+        if (len && (c == EOF || c == 255 || c == '\n' || len == sizeof(line))) {
+            send_keyboard_string(line, len);
+            len = 0;
+        }
+        if (c == EOF || c == 255) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 }
 #endif
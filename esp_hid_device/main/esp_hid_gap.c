@@ -33,11 +33,32 @@ static const char *TAG = "ESP_HID_GAP";
 //static const char * gap_bt_prop_type_names[5] = {"","BDNAME","COD","RSSI","EIR"};
 
 #if !CONFIG_BT_NIMBLE_ENABLED
-static esp_hid_scan_result_t *bt_scan_results = NULL;
-static size_t num_bt_scan_results = 0;
-
-static esp_hid_scan_result_t *ble_scan_results = NULL;
-static size_t num_ble_scan_results = 0;
+// Scan results are collected per transport in a fixed pool of entries,
+// indexed by an open addressing table keyed by BD address, so a repeated
+// advertisement costs one hash lookup and no allocation. RSSI is averaged
+// over all reports of a device. When the pool is full a new device takes
+// the place of the weakest one, keeping the SCAN_STORE_SIZE strongest.
+// esp_hid_scan() hands out the usual result list, strongest first.
+#define SCAN_STORE_SIZE     32      // devices per transport
+#define SCAN_INDEX_SIZE     64      // hash slots, power of two, larger than SCAN_STORE_SIZE
+#define SCAN_NAME_MAX       32      // longer names are cut
+#define SCAN_SLOT_EMPTY     0xFF
+
+typedef struct {
+    esp_hid_scan_result_t result;   // name and next unused
+    char name[SCAN_NAME_MAX + 1];
+    int32_t rssi_sum;
+    uint16_t rssi_count;
+} scan_entry_t;
+
+typedef struct {
+    scan_entry_t entry[SCAN_STORE_SIZE];
+    uint8_t index[SCAN_INDEX_SIZE]; // entry number or SCAN_SLOT_EMPTY
+    uint8_t count;
+} scan_store_t;
+
+static scan_store_t bt_scan_store;
+static scan_store_t ble_scan_store;
 #endif
 
 static SemaphoreHandle_t bt_hidh_cb_semaphore = NULL;
@@ -134,112 +155,206 @@ void esp_hid_scan_results_free(esp_hid_scan_result_t *results)
         free(r);
     }
 }
+
+static int scan_entry_rssi(const scan_entry_t *e)
+{
+    return e->rssi_count ? e->rssi_sum / e->rssi_count : INT8_MIN;
+}
+
+static void scan_store_reset(scan_store_t *s)
+{
+    memset(s->index, SCAN_SLOT_EMPTY, sizeof(s->index));
+    s->count = 0;
+}
+
+// Copy the store out as a result list, strongest first, in front of tail
+static esp_hid_scan_result_t *scan_store_to_list(const scan_store_t *s, esp_hid_scan_result_t *tail, size_t *num)
+{
+    uint8_t order[SCAN_STORE_SIZE];
+    int n = s->count;
+
+    // Insertion sort, weakest first
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        while (j > 0 && scan_entry_rssi(&s->entry[order[j - 1]]) > scan_entry_rssi(&s->entry[i])) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    // Prepending weakest first leaves the strongest at the head
+    for (int i = 0; i < n; i++) {
+        const scan_entry_t *e = &s->entry[order[i]];
+        esp_hid_scan_result_t *r = (esp_hid_scan_result_t *)malloc(sizeof(esp_hid_scan_result_t));
+        if (r == NULL) {
+            ESP_LOGE(TAG, "Malloc esp_hid_scan_result_t failed!");
+            continue;
+        }
+        *r = e->result;
+        r->rssi = scan_entry_rssi(e);
+        r->name = NULL;
+        if (e->name[0]) {
+            r->name = strdup(e->name);
+        }
+        r->next = tail;
+        tail = r;
+        (*num)++;
+    }
+    return tail;
+}
 #endif
 
 #if (CONFIG_BT_HID_DEVICE_ENABLED || CONFIG_BT_BLE_ENABLED)
-static esp_hid_scan_result_t *find_scan_result(esp_bd_addr_t bda, esp_hid_scan_result_t *results)
+static uint32_t scan_hash(const esp_bd_addr_t bda)
 {
-    esp_hid_scan_result_t *r = results;
-    while (r) {
-        if (memcmp(bda, r->bda, sizeof(esp_bd_addr_t)) == 0) {
-            return r;
+    // FNV-1a over the six address bytes
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(esp_bd_addr_t); i++) {
+        h = (h ^ bda[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Slot holding bda, or the empty slot where it would go
+static int scan_slot(const scan_store_t *s, const esp_bd_addr_t bda)
+{
+    int slot = scan_hash(bda) & (SCAN_INDEX_SIZE - 1);
+    while (s->index[slot] != SCAN_SLOT_EMPTY
+            && memcmp(s->entry[s->index[slot]].result.bda, bda, sizeof(esp_bd_addr_t)) != 0) {
+        slot = (slot + 1) & (SCAN_INDEX_SIZE - 1);
+    }
+    return slot;
+}
+
+static scan_entry_t *scan_store_find(scan_store_t *s, const esp_bd_addr_t bda)
+{
+    int slot = scan_slot(s, bda);
+    return s->index[slot] == SCAN_SLOT_EMPTY ? NULL : &s->entry[s->index[slot]];
+}
+
+// Linear probing removal: move later entries of the cluster back into the
+// hole so lookups never stop early
+static void scan_store_unlink(scan_store_t *s, int hole)
+{
+    int slot = hole;
+    s->index[hole] = SCAN_SLOT_EMPTY;
+    while (1) {
+        slot = (slot + 1) & (SCAN_INDEX_SIZE - 1);
+        if (s->index[slot] == SCAN_SLOT_EMPTY) {
+            return;
+        }
+        int home = scan_hash(s->entry[s->index[slot]].result.bda) & (SCAN_INDEX_SIZE - 1);
+        // Entry may move if its home is not cyclically within (hole, slot]
+        if (((slot - home) & (SCAN_INDEX_SIZE - 1)) >= ((slot - hole) & (SCAN_INDEX_SIZE - 1))) {
+            s->index[hole] = s->index[slot];
+            s->index[slot] = SCAN_SLOT_EMPTY;
+            hole = slot;
         }
-        r = r->next;
     }
-    return NULL;
+}
+
+static void scan_entry_add_rssi(scan_entry_t *e, int rssi)
+{
+    // BR/EDR inquiry results without an RSSI report 0
+    if (rssi != 0) {
+        e->rssi_sum += rssi;
+        e->rssi_count++;
+    }
+}
+
+static void scan_entry_set_name(scan_entry_t *e, const uint8_t *name, uint8_t name_len)
+{
+    if (e->name[0] == 0 && name && name_len) {
+        if (name_len > SCAN_NAME_MAX) {
+            name_len = SCAN_NAME_MAX;
+        }
+        memcpy(e->name, name, name_len);
+        e->name[name_len] = 0;
+    }
+}
+
+// New entry for bda; with the pool full it takes the place of the weakest
+// device, or NULL if that one is stronger than rssi
+static scan_entry_t *scan_store_insert(scan_store_t *s, const esp_bd_addr_t bda, int rssi)
+{
+    int e = s->count;
+
+    if (s->count < SCAN_STORE_SIZE) {
+        s->count++;
+    } else {
+        e = 0;
+        for (int i = 1; i < SCAN_STORE_SIZE; i++) {
+            if (scan_entry_rssi(&s->entry[i]) < scan_entry_rssi(&s->entry[e])) {
+                e = i;
+            }
+        }
+        if (rssi == 0 || rssi <= scan_entry_rssi(&s->entry[e])) {
+            return NULL;
+        }
+        scan_store_unlink(s, scan_slot(s, s->entry[e].result.bda));
+    }
+
+    scan_entry_t *entry = &s->entry[e];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->result.bda, bda, sizeof(esp_bd_addr_t));
+    s->index[scan_slot(s, bda)] = e;
+    return entry;
 }
 #endif /* (CONFIG_BT_HID_DEVICE_ENABLED || CONFIG_BT_BLE_ENABLED) */
 
 #if CONFIG_BT_HID_DEVICE_ENABLED
 static void add_bt_scan_result(esp_bd_addr_t bda, esp_bt_cod_t *cod, esp_bt_uuid_t *uuid, uint8_t *name, uint8_t name_len, int rssi)
 {
-    esp_hid_scan_result_t *r = find_scan_result(bda, bt_scan_results);
-    if (r) {
+    scan_entry_t *e = scan_store_find(&bt_scan_store, bda);
+    if (e) {
         //Some info may come later
-        if (r->name == NULL && name && name_len) {
-            char *name_s = (char *)malloc(name_len + 1);
-            if (name_s == NULL) {
-                ESP_LOGE(TAG, "Malloc result name failed!");
-                return;
-            }
-            memcpy(name_s, name, name_len);
-            name_s[name_len] = 0;
-            r->name = (const char *)name_s;
-        }
-        if (r->bt.uuid.len == 0 && uuid->len) {
-            memcpy(&r->bt.uuid, uuid, sizeof(esp_bt_uuid_t));
-        }
-        if (rssi != 0) {
-            r->rssi = rssi;
+        scan_entry_set_name(e, name, name_len);
+        if (e->result.bt.uuid.len == 0 && uuid->len) {
+            memcpy(&e->result.bt.uuid, uuid, sizeof(esp_bt_uuid_t));
         }
+        scan_entry_add_rssi(e, rssi);
         return;
     }
 
-    r = (esp_hid_scan_result_t *)malloc(sizeof(esp_hid_scan_result_t));
-    if (r == NULL) {
-        ESP_LOGE(TAG, "Malloc bt_hidh_scan_result_t failed!");
+    e = scan_store_insert(&bt_scan_store, bda, rssi);
+    if (e == NULL) {
         return;
     }
-    r->transport = ESP_HID_TRANSPORT_BT;
-    memcpy(r->bda, bda, sizeof(esp_bd_addr_t));
-    memcpy(&r->bt.cod, cod, sizeof(esp_bt_cod_t));
-    memcpy(&r->bt.uuid, uuid, sizeof(esp_bt_uuid_t));
-    r->usage = esp_hid_usage_from_cod((uint32_t)cod);
-    r->rssi = rssi;
-    r->name = NULL;
-    if (name_len && name) {
-        char *name_s = (char *)malloc(name_len + 1);
-        if (name_s == NULL) {
-            free(r);
-            ESP_LOGE(TAG, "Malloc result name failed!");
-            return;
-        }
-        memcpy(name_s, name, name_len);
-        name_s[name_len] = 0;
-        r->name = (const char *)name_s;
-    }
-    r->next = bt_scan_results;
-    bt_scan_results = r;
-    num_bt_scan_results++;
+    e->result.transport = ESP_HID_TRANSPORT_BT;
+    memcpy(&e->result.bt.cod, cod, sizeof(esp_bt_cod_t));
+    memcpy(&e->result.bt.uuid, uuid, sizeof(esp_bt_uuid_t));
+    e->result.usage = esp_hid_usage_from_cod((uint32_t)cod);
+    scan_entry_set_name(e, name, name_len);
+    scan_entry_add_rssi(e, rssi);
 }
 #endif
 
 #if CONFIG_BT_BLE_ENABLED
 static void add_ble_scan_result(esp_bd_addr_t bda, esp_ble_addr_type_t addr_type, uint16_t appearance, uint8_t *name, uint8_t name_len, int rssi)
 {
-    if (find_scan_result(bda, ble_scan_results)) {
-        ESP_LOGW(TAG, "Result already exists!");
+    scan_entry_t *e = scan_store_find(&ble_scan_store, bda);
+    if (e) {
+        // Every advertisement counts towards the RSSI, a scan response may add the name
+        scan_entry_set_name(e, name, name_len);
+        scan_entry_add_rssi(e, rssi);
         return;
     }
-    esp_hid_scan_result_t *r = (esp_hid_scan_result_t *)malloc(sizeof(esp_hid_scan_result_t));
-    if (r == NULL) {
-        ESP_LOGE(TAG, "Malloc ble_hidh_scan_result_t failed!");
+
+    e = scan_store_insert(&ble_scan_store, bda, rssi);
+    if (e == NULL) {
         return;
     }
-    r->transport = ESP_HID_TRANSPORT_BLE;
-    memcpy(r->bda, bda, sizeof(esp_bd_addr_t));
-    r->ble.appearance = appearance;
-    r->ble.addr_type = addr_type;
-    r->usage = esp_hid_usage_from_appearance(appearance);
-    r->rssi = rssi;
-    r->name = NULL;
-    if (name_len && name) {
-        char *name_s = (char *)malloc(name_len + 1);
-        if (name_s == NULL) {
-            free(r);
-            ESP_LOGE(TAG, "Malloc result name failed!");
-            return;
-        }
-        memcpy(name_s, name, name_len);
-        name_s[name_len] = 0;
-        r->name = (const char *)name_s;
-    }
-    r->next = ble_scan_results;
-    ble_scan_results = r;
-    num_ble_scan_results++;
+    e->result.transport = ESP_HID_TRANSPORT_BLE;
+    e->result.ble.appearance = appearance;
+    e->result.ble.addr_type = addr_type;
+    e->result.usage = esp_hid_usage_from_appearance(appearance);
+    scan_entry_set_name(e, name, name_len);
+    scan_entry_add_rssi(e, rssi);
 }
 #endif /* CONFIG_BT_BLE_ENABLED */
 
+
 #if !CONFIG_BT_NIMBLE_ENABLED
 void print_uuid(esp_bt_uuid_t *uuid)
 {
@@ -343,7 +458,7 @@ static void handle_bt_device_result(struct disc_res_param *disc_res)
     }
     GAP_DBG_PRINTF("\n");
 
-    if (cod->major == ESP_BT_COD_MAJOR_DEV_PERIPHERAL || (find_scan_result(disc_res->bda, bt_scan_results) != NULL)) {
+    if (cod->major == ESP_BT_COD_MAJOR_DEV_PERIPHERAL || (scan_store_find(&bt_scan_store, disc_res->bda) != NULL)) {
         add_bt_scan_result(disc_res->bda, cod, &uuid, name, name_len, rssi);
     }
 }
@@ -1098,10 +1213,8 @@ esp_err_t esp_hid_gap_init(uint8_t mode)
 #if !CONFIG_BT_NIMBLE_ENABLED
 esp_err_t esp_hid_scan(uint32_t seconds, size_t *num_results, esp_hid_scan_result_t **results)
 {
-    if (num_bt_scan_results || bt_scan_results || num_ble_scan_results || ble_scan_results) {
-        ESP_LOGE(TAG, "There are old scan results. Free them first!");
-        return ESP_FAIL;
-    }
+    scan_store_reset(&bt_scan_store);
+    scan_store_reset(&ble_scan_store);
 
 #if CONFIG_BT_BLE_ENABLED
     if (start_ble_scan(seconds) == ESP_OK) {
@@ -1119,21 +1232,8 @@ esp_err_t esp_hid_scan(uint32_t seconds, size_t *num_results, esp_hid_scan_resul
     }
 #endif
 
-    *num_results = num_bt_scan_results + num_ble_scan_results;
-    *results = bt_scan_results;
-    if (num_bt_scan_results) {
-        while (bt_scan_results->next != NULL) {
-            bt_scan_results = bt_scan_results->next;
-        }
-        bt_scan_results->next = ble_scan_results;
-    } else {
-        *results = ble_scan_results;
-    }
-
-    num_bt_scan_results = 0;
-    bt_scan_results = NULL;
-    num_ble_scan_results = 0;
-    ble_scan_results = NULL;
+    *num_results = 0;
+    *results = scan_store_to_list(&bt_scan_store, scan_store_to_list(&ble_scan_store, NULL, num_results), num_results);
     return ESP_OK;
 }
 #endif
@@ -22,6 +22,13 @@
 #include <esp32p4/rom/ets_sys.h>
 #elif CONFIG_IDF_TARGET_ESP8266
 #include <rom/ets_sys.h>
+#elif CONFIG_IDF_TARGET_LINUX
+#include <stdint.h>
+#include <unistd.h>
+static inline void ets_delay_us(uint32_t us)
+{
+    usleep(us);
+}
 #else
 #error "ets_sys: Unknown target"
 #endif
@@ -678,6 +678,10 @@ esp_err_t i2c_dev_read(const i2c_dev_t *dev, const void *out_data, size_t out_si
     if (!dev || !in_data || !in_size)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->read(dev, out_data, out_size, in_data, in_size);
+
     ESP_LOGV(TAG, "[0x%02x at %d] i2c_dev_read called (out_size: %u, in_size: %u)", dev->addr, dev->port, out_size, in_size);
 
     esp_err_t result = i2c_do_operation_with_retry((i2c_dev_t *)dev, // Cast to non-const for i2c_setup_device internal modifications
@@ -694,6 +698,10 @@ esp_err_t i2c_dev_write(const i2c_dev_t *dev, const void *out_reg, size_t out_re
     if ((!out_reg || !out_reg_size) && (!out_data || !out_size))
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->write(dev, out_reg, out_reg_size, out_data, out_size);
+
     ESP_LOGV(TAG, "[0x%02x at %d] i2c_dev_write called (reg_size: %u, data_size: %u)", dev->addr, dev->port, out_reg_size, out_size);
 
     esp_err_t res;
@@ -765,6 +773,10 @@ esp_err_t i2c_dev_check_present(const i2c_dev_t *dev_const)
     if (!dev_const)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->check_present(dev_const);
+
     ESP_LOGV(TAG, "[0x%02x at %d] Probing device presence...", dev_const->addr, dev_const->port);
 
     // Cast to non-const for i2c_setup_port (which may modify internal state)
@@ -46,15 +46,33 @@
 #ifndef __I2CDEV_H__
 #define __I2CDEV_H__
 
-#include <driver/gpio.h>
-#include <driver/i2c.h>
 #include <esp_err.h>
 #include <esp_idf_lib_helpers.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 
+#if HELPER_TARGET_IS_LINUX
+// The Linux target has no GPIO or I2C driver. Provide the few types the
+// descriptor needs; every transfer goes through a backend (see below).
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int gpio_num_t;
+
+typedef enum
+{
+    I2C_NUM_0 = 0,
+    I2C_NUM_1,
+    I2C_NUM_MAX,
+} i2c_port_t;
+#else
+#include <driver/gpio.h>
+#include <driver/i2c.h>
+#endif
+
 // Define missing types for older ESP-IDF versions
-#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
+#if HELPER_TARGET_IS_LINUX || ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
 typedef enum
 {
     I2C_ADDR_BIT_LEN_7 = 0, /*!< I2C 7bit address for slave mode */
@@ -65,6 +83,8 @@ typedef enum
 // Definition for I2CDEV_MAX_STRETCH_TIME
 #if HELPER_TARGET_IS_ESP8266
 #define I2CDEV_MAX_STRETCH_TIME 0xffffffff
+#elif HELPER_TARGET_IS_LINUX
+#define I2CDEV_MAX_STRETCH_TIME 0x00ffffff
 #else
 #include <soc/i2c_reg.h> // For I2C_TIME_OUT_VALUE_V, etc.
 #if defined(I2C_TIME_OUT_VALUE_V)
@@ -74,7 +94,7 @@ typedef enum
 #else
 #define I2CDEV_MAX_STRETCH_TIME 0x00ffffff
 #endif
-#endif /* HELPER_TARGET_IS_ESP8266 */
+#endif /* HELPER_TARGET_IS_ESP8266 || HELPER_TARGET_IS_LINUX */
 
 #ifndef CONFIG_I2CDEV_TIMEOUT
 #define CONFIG_I2CDEV_TIMEOUT 1000 // Default 1 second timeout
@@ -315,6 +335,51 @@ esp_err_t i2c_dev_read_reg(const i2c_dev_t *dev, uint8_t reg, void *data, size_t
  */
 esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg, const void *data, size_t size);
 
+/**
+ * @brief Transfer backend
+ *
+ * By default all transfers go to the ESP-IDF I2C driver. When a backend is
+ * installed with i2cdev_set_backend(), i2c_dev_read(), i2c_dev_write(),
+ * i2c_dev_probe() and i2c_dev_check_present() (and the register helpers built
+ * on top of them) are routed to it instead. Device mutexes keep working the
+ * same way, so drivers built on i2cdev need no changes.
+ *
+ * On the Linux target there is no I2C driver, and the simulated bus from
+ * i2cdev_sim.h is installed by i2cdev_init() unless another backend was set.
+ */
+typedef struct
+{
+    const char *name; //!< Human readable name, used in logs
+
+    /** Same contract as i2c_dev_read() */
+    esp_err_t (*read)(const i2c_dev_t *dev, const void *out_data, size_t out_size, void *in_data, size_t in_size);
+
+    /** Same contract as i2c_dev_write() */
+    esp_err_t (*write)(const i2c_dev_t *dev, const void *out_reg, size_t out_reg_size, const void *out_data, size_t out_size);
+
+    /** Same contract as i2c_dev_check_present() */
+    esp_err_t (*check_present)(const i2c_dev_t *dev);
+} i2cdev_backend_t;
+
+/**
+ * @brief Install a transfer backend
+ *
+ * Should be called before any device is created, typically right after
+ * i2cdev_init(). Passing NULL restores the hardware driver (not available
+ * on the Linux target).
+ *
+ * @param backend Backend, must stay valid while installed. NULL for hardware.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` if a callback is missing
+ */
+esp_err_t i2cdev_set_backend(const i2cdev_backend_t *backend);
+
+/**
+ * @brief Get the installed transfer backend
+ *
+ * @return Installed backend or NULL when the hardware driver is used
+ */
+const i2cdev_backend_t *i2cdev_get_backend(void);
+
 /**
  * @brief Take device mutex with error checking
  */
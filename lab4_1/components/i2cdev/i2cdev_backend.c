@@ -0,0 +1,61 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ruslan V. Uss <unclerus@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file i2cdev_backend.c
+ *
+ * Transfer backend selection, shared by the hardware and host implementations
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+
+#include "i2cdev.h"
+#include <esp_log.h>
+
+static const char *TAG = "i2cdev";
+
+static const i2cdev_backend_t *active_backend = NULL;
+
+esp_err_t i2cdev_set_backend(const i2cdev_backend_t *backend)
+{
+    if (backend && (!backend->read || !backend->write || !backend->check_present))
+        return ESP_ERR_INVALID_ARG;
+
+#if HELPER_TARGET_IS_LINUX
+    if (!backend)
+    {
+        ESP_LOGE(TAG, "No hardware I2C driver on the Linux target");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+
+    active_backend = backend;
+    ESP_LOGI(TAG, "Using %s backend", backend ? (backend->name ? backend->name : "custom") : "hardware");
+
+    return ESP_OK;
+}
+
+const i2cdev_backend_t *i2cdev_get_backend(void)
+{
+    return active_backend;
+}
@@ -0,0 +1,190 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ruslan V. Uss <unclerus@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file i2cdev_host.c
+ *
+ * i2cdev for the ESP-IDF Linux target
+ *
+ * There is no I2C peripheral on the host, so this implementation keeps the
+ * device mutex handling of the hardware versions and hands every transfer to
+ * the installed backend (the simulated bus from i2cdev_sim.h by default).
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+
+#include "i2cdev.h"
+#include "i2cdev_sim.h"
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+static const char *TAG = "i2cdev_host";
+
+static const i2cdev_backend_t *get_backend(void)
+{
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (!backend)
+    {
+        // i2cdev_init() was skipped, fall back to the simulator
+        i2cdev_set_backend(i2cdev_sim_backend());
+        backend = i2cdev_get_backend();
+    }
+    return backend;
+}
+
+esp_err_t i2cdev_init(void)
+{
+    if (!i2cdev_get_backend())
+        return i2cdev_set_backend(i2cdev_sim_backend());
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_done(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_create_mutex(i2c_dev_t *dev)
+{
+#if !CONFIG_I2CDEV_NOLOCK
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    if (dev->mutex)
+    {
+        ESP_LOGW(TAG, "[0x%02x at %d] device mutex already exists (Handle: %p)", dev->addr, dev->port, dev->mutex);
+        return ESP_OK;
+    }
+
+    dev->mutex = xSemaphoreCreateMutex();
+    if (!dev->mutex)
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Could not create device mutex", dev->addr, dev->port);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (dev->addr_bit_len != I2C_ADDR_BIT_LEN_7 && dev->addr_bit_len != I2C_ADDR_BIT_LEN_10)
+        dev->addr_bit_len = I2C_ADDR_BIT_LEN_7;
+#endif
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_delete_mutex(i2c_dev_t *dev)
+{
+#if !CONFIG_I2CDEV_NOLOCK
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    if (dev->mutex)
+    {
+        vSemaphoreDelete(dev->mutex);
+        dev->mutex = NULL;
+    }
+#endif
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_take_mutex(i2c_dev_t *dev)
+{
+#if !CONFIG_I2CDEV_NOLOCK
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!dev->mutex)
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Attempt to take NULL device mutex!", dev->addr, dev->port);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!xSemaphoreTake(dev->mutex, pdMS_TO_TICKS(CONFIG_I2CDEV_TIMEOUT)))
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Could not take device mutex (Timeout after %d ms)", dev->addr, dev->port, CONFIG_I2CDEV_TIMEOUT);
+        return ESP_ERR_TIMEOUT;
+    }
+#endif
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_give_mutex(i2c_dev_t *dev)
+{
+#if !CONFIG_I2CDEV_NOLOCK
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!dev->mutex)
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Attempt to give NULL device mutex!", dev->addr, dev->port);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!xSemaphoreGive(dev->mutex))
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Could not give device mutex (Was it taken?) (Handle: %p)", dev->addr, dev->port, dev->mutex);
+        return ESP_FAIL;
+    }
+#endif
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_check_present(const i2c_dev_t *dev)
+{
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    return get_backend()->check_present(dev);
+}
+
+esp_err_t i2c_dev_probe(const i2c_dev_t *dev, i2c_dev_type_t operation_type)
+{
+    (void)operation_type;
+    return i2c_dev_check_present(dev);
+}
+
+esp_err_t i2c_dev_read(const i2c_dev_t *dev, const void *out_data, size_t out_size, void *in_data, size_t in_size)
+{
+    if (!dev || !in_data || !in_size)
+        return ESP_ERR_INVALID_ARG;
+
+    return get_backend()->read(dev, out_data, out_size, in_data, in_size);
+}
+
+esp_err_t i2c_dev_write(const i2c_dev_t *dev, const void *out_reg, size_t out_reg_size, const void *out_data, size_t out_size)
+{
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+    if ((!out_reg || !out_reg_size) && (!out_data || !out_size))
+        return ESP_ERR_INVALID_ARG;
+
+    return get_backend()->write(dev, out_reg, out_reg_size, out_data, out_size);
+}
+
+esp_err_t i2c_dev_read_reg(const i2c_dev_t *dev, uint8_t reg, void *data, size_t size)
+{
+    return i2c_dev_read(dev, &reg, 1, data, size);
+}
+
+esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg, const void *data, size_t size)
+{
+    return i2c_dev_write(dev, &reg, 1, data, size);
+}
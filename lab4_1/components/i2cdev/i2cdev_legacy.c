@@ -589,6 +589,10 @@ esp_err_t i2c_dev_probe(const i2c_dev_t *dev, i2c_dev_type_t operation_type)
     if (!dev)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->check_present(dev);
+
     SEMAPHORE_TAKE(dev->port);
 
     esp_err_t res = i2c_setup_port((i2c_dev_t *)dev);
@@ -617,6 +621,10 @@ esp_err_t i2c_dev_read(const i2c_dev_t *dev, const void *out_data, size_t out_si
     if (!dev || !in_data || !in_size)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->read(dev, out_data, out_size, in_data, in_size);
+
     SEMAPHORE_TAKE(dev->port);
 
     // Use a local status variable to track errors
@@ -664,6 +672,10 @@ esp_err_t i2c_dev_write(const i2c_dev_t *dev, const void *out_reg, size_t out_re
     if ((!out_reg || !out_reg_size) && (!out_data || !out_size))
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->write(dev, out_reg, out_reg_size, out_data, out_size);
+
     SEMAPHORE_TAKE(dev->port);
 
     // Use a local status variable to track errors
@@ -710,6 +722,10 @@ esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg, const void *out_d
     if (!dev || !out_data || !out_size)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->write(dev, &reg, 1, out_data, out_size);
+
     SEMAPHORE_TAKE(dev->port);
 
     // Use a local status variable to track errors
@@ -748,6 +764,10 @@ esp_err_t i2c_dev_read_reg(const i2c_dev_t *dev, uint8_t reg, void *in_data, siz
     if (!dev || !in_data || !in_size)
         return ESP_ERR_INVALID_ARG;
 
+    const i2cdev_backend_t *backend = i2cdev_get_backend();
+    if (backend)
+        return backend->read(dev, &reg, 1, in_data, in_size);
+
     SEMAPHORE_TAKE(dev->port);
 
     // Use a local status variable to track errors
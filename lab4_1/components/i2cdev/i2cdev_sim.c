@@ -0,0 +1,644 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ruslan V. Uss <unclerus@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file i2cdev_sim.c
+ *
+ * Simulated I2C bus backend for i2cdev
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+
+#include "i2cdev_sim.h"
+#include <esp_log.h>
+#include <ets_sys.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static const char *TAG = "i2cdev_sim";
+
+#define SIM_DEFAULT_CLK_HZ 400000
+
+// Wire cost of the framing around the data bytes, in SCL periods
+#define SIM_BITS_START    1 // START or repeated START
+#define SIM_BITS_STOP     1
+#define SIM_BITS_PER_BYTE 9 // 8 data bits + ACK/NACK
+
+typedef struct
+{
+    bool active;
+    uint8_t start_reg;
+    const uint8_t *frames;
+    size_t frame_size;
+    size_t frame_count;
+    size_t index;
+    uint32_t period_us;
+    uint64_t start_us;
+    bool loop;
+    bool consumed; // per-read scripts: current frame has been read
+} sim_script_t;
+
+struct i2cdev_sim_dev
+{
+    bool used;
+    i2c_port_t port;
+    uint16_t addr;
+    uint8_t ptr; // register pointer
+    uint8_t regs[I2CDEV_SIM_REG_COUNT];
+    uint8_t flags[I2CDEV_SIM_REG_COUNT];
+    i2cdev_sim_read_cb_t read_cb;
+    i2cdev_sim_write_cb_t write_cb;
+    void *cb_ctx;
+    sim_script_t scripts[CONFIG_I2CDEV_SIM_MAX_SCRIPTS];
+    i2cdev_sim_fault_t fault;
+    uint32_t fault_after;
+    uint32_t fault_count;
+};
+
+static SemaphoreHandle_t sim_lock = NULL;
+static StaticSemaphore_t sim_lock_buf;
+static atomic_int sim_lock_state = 0; // 0: not created, 1: being created, 2: ready
+static i2cdev_sim_config_t sim_config = { .default_clk_hz = SIM_DEFAULT_CLK_HZ };
+static struct i2cdev_sim_dev sim_devices[CONFIG_I2CDEV_SIM_MAX_DEVICES];
+static i2cdev_sim_stats_t sim_stats[I2C_NUM_MAX];
+static uint64_t sim_now_ns = 0;
+
+#define CHECK_ARG(VAL)                                                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(VAL))                                                                                                    \
+            return ESP_ERR_INVALID_ARG;                                                                                \
+    }                                                                                                                  \
+    while (0)
+
+// The first caller creates the lock, callers racing with it wait until it is ready
+static esp_err_t sim_lazy_init(void)
+{
+    if (atomic_load_explicit(&sim_lock_state, memory_order_acquire) == 2)
+        return ESP_OK;
+
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&sim_lock_state, &expected, 1))
+    {
+        sim_lock = xSemaphoreCreateRecursiveMutexStatic(&sim_lock_buf);
+        atomic_store_explicit(&sim_lock_state, 2, memory_order_release);
+        return ESP_OK;
+    }
+    while (atomic_load_explicit(&sim_lock_state, memory_order_acquire) != 2)
+        taskYIELD();
+
+    return ESP_OK;
+}
+
+#define SIM_LOCK()                                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        esp_err_t __ = sim_lazy_init();                                                                                \
+        if (__ != ESP_OK)                                                                                              \
+            return __;                                                                                                 \
+        xSemaphoreTakeRecursive(sim_lock, portMAX_DELAY);                                                              \
+    }                                                                                                                  \
+    while (0)
+
+#define SIM_UNLOCK() xSemaphoreGiveRecursive(sim_lock)
+
+static struct i2cdev_sim_dev *find_device(i2c_port_t port, uint16_t addr)
+{
+    for (int i = 0; i < CONFIG_I2CDEV_SIM_MAX_DEVICES; i++)
+        if (sim_devices[i].used && sim_devices[i].port == port && sim_devices[i].addr == addr)
+            return &sim_devices[i];
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scripts
+
+static void script_apply(struct i2cdev_sim_dev *sim, sim_script_t *s)
+{
+    memcpy(&sim->regs[s->start_reg], s->frames + s->index * s->frame_size, s->frame_size);
+}
+
+static void script_seek(struct i2cdev_sim_dev *sim, sim_script_t *s, size_t index)
+{
+    if (index >= s->frame_count)
+        index = s->loop ? index % s->frame_count : s->frame_count - 1;
+    if (index == s->index)
+        return;
+    s->index = index;
+    script_apply(sim, s);
+}
+
+// Bring timed scripts up to the simulated clock
+static void scripts_update_timed(struct i2cdev_sim_dev *sim)
+{
+    uint64_t now_us = sim_now_ns / 1000;
+    for (int i = 0; i < CONFIG_I2CDEV_SIM_MAX_SCRIPTS; i++)
+    {
+        sim_script_t *s = &sim->scripts[i];
+        if (s->active && s->period_us)
+            script_seek(sim, s, (now_us - s->start_us) / s->period_us);
+    }
+}
+
+// Advance per-read scripts whose registers are covered by a read of `len` registers at `reg`
+static void scripts_on_read(struct i2cdev_sim_dev *sim, uint8_t reg, size_t len)
+{
+    for (int i = 0; i < CONFIG_I2CDEV_SIM_MAX_SCRIPTS; i++)
+    {
+        sim_script_t *s = &sim->scripts[i];
+        if (!s->active || s->period_us)
+            continue;
+        size_t end = (size_t)reg + len;
+        size_t s_end = (size_t)s->start_reg + s->frame_size;
+        if (reg >= s_end || end <= s->start_reg)
+            continue;
+        if (s->consumed)
+            script_seek(sim, s, s->index + 1);
+        s->consumed = true;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Register file access
+
+static esp_err_t reg_read(struct i2cdev_sim_dev *sim, uint8_t *value)
+{
+    uint8_t reg = sim->ptr;
+    esp_err_t res = ESP_ERR_NOT_FOUND;
+
+    if (sim->read_cb)
+        res = sim->read_cb(sim, reg, value, sim->cb_ctx);
+    if (res == ESP_ERR_NOT_FOUND)
+    {
+        *value = sim->regs[reg];
+        res = ESP_OK;
+    }
+    if (res != ESP_OK)
+        return res;
+
+    if (sim->flags[reg] & I2CDEV_SIM_REG_CLEAR_ON_READ)
+        sim->regs[reg] = 0;
+    if (!(sim->flags[reg] & I2CDEV_SIM_REG_NO_INC))
+        sim->ptr++;
+
+    return ESP_OK;
+}
+
+static void reg_write(struct i2cdev_sim_dev *sim, uint8_t value)
+{
+    uint8_t reg = sim->ptr;
+
+    if (!(sim->flags[reg] & I2CDEV_SIM_REG_READ_ONLY))
+        sim->regs[reg] = value;
+    if (sim->write_cb)
+        sim->write_cb(sim, reg, value, sim->cb_ctx);
+    if (!(sim->flags[reg] & I2CDEV_SIM_REG_NO_INC))
+        sim->ptr++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Bus model
+
+static uint32_t bus_clk_hz(const i2c_dev_t *dev)
+{
+    if (dev->cfg.master.clk_speed)
+        return dev->cfg.master.clk_speed;
+    return sim_config.default_clk_hz ? sim_config.default_clk_hz : SIM_DEFAULT_CLK_HZ;
+}
+
+static uint32_t addr_bits(const i2c_dev_t *dev)
+{
+    // 10-bit addresses take a second address byte
+    return SIM_BITS_PER_BYTE * (dev->addr_bit_len == I2C_ADDR_BIT_LEN_10 ? 2 : 1);
+}
+
+// Charge a transaction to the clock and the port statistics. Called with the lock held.
+static uint64_t bus_account(const i2c_dev_t *dev, uint32_t bits, size_t rd, size_t wr, esp_err_t res)
+{
+    uint64_t ns = (uint64_t)bits * 1000000000ULL / bus_clk_hz(dev) + sim_config.txn_overhead_ns;
+    if (res == ESP_ERR_TIMEOUT)
+        ns += (uint64_t)CONFIG_I2CDEV_TIMEOUT * 1000000ULL;
+
+    sim_now_ns += ns;
+    if (dev->port < I2C_NUM_MAX)
+    {
+        i2cdev_sim_stats_t *st = &sim_stats[dev->port];
+        st->transactions++;
+        st->bytes_read += rd;
+        st->bytes_written += wr;
+        st->bus_time_ns += ns;
+        if (res != ESP_OK)
+            st->faults++;
+    }
+
+    return ns;
+}
+
+static void bus_wait(uint64_t ns)
+{
+    if (!sim_config.realtime || ns < 1000)
+        return;
+    uint64_t us = ns / 1000;
+    TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+    if (ticks)
+    {
+        vTaskDelay(ticks);
+        us -= (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+    }
+    if (us)
+        ets_delay_us((uint32_t)us);
+}
+
+// Consume one transaction of the device fault budget. Called with the lock held.
+static esp_err_t take_fault(struct i2cdev_sim_dev *sim)
+{
+    if (sim->fault == I2CDEV_SIM_FAULT_NONE)
+        return ESP_OK;
+    if (sim->fault_after)
+    {
+        sim->fault_after--;
+        return ESP_OK;
+    }
+
+    i2cdev_sim_fault_t fault = sim->fault;
+    if (sim->fault_count != UINT32_MAX && --sim->fault_count == 0)
+        sim->fault = I2CDEV_SIM_FAULT_NONE;
+
+    return fault == I2CDEV_SIM_FAULT_TIMEOUT ? ESP_ERR_TIMEOUT : ESP_FAIL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Backend
+
+static esp_err_t sim_read(const i2c_dev_t *dev, const void *out_data, size_t out_size, void *in_data, size_t in_size)
+{
+    if (!dev || !in_data || !in_size)
+        return ESP_ERR_INVALID_ARG;
+
+    SIM_LOCK();
+
+    esp_err_t res;
+    uint32_t bits = SIM_BITS_START + addr_bits(dev);
+    size_t rd = 0, wr = 0;
+    struct i2cdev_sim_dev *sim = find_device(dev->port, dev->addr);
+
+    if (!sim)
+    {
+        res = ESP_ERR_NOT_FOUND; // address NACK, as in i2c_dev_probe()
+        bits += SIM_BITS_STOP;
+        goto out;
+    }
+    if ((res = take_fault(sim)) != ESP_OK)
+    {
+        bits += SIM_BITS_STOP;
+        goto out;
+    }
+
+    if (out_data && out_size)
+    {
+        // write phase sets the register pointer, then a repeated START
+        const uint8_t *out = out_data;
+        sim->ptr = out[0];
+        for (size_t i = 1; i < out_size; i++)
+            reg_write(sim, out[i]);
+        wr = out_size;
+        bits += SIM_BITS_PER_BYTE * out_size + SIM_BITS_START + addr_bits(dev);
+    }
+
+    scripts_update_timed(sim);
+    size_t span = (sim->flags[sim->ptr] & I2CDEV_SIM_REG_NO_INC) ? 1 : in_size;
+    scripts_on_read(sim, sim->ptr, span);
+
+    uint8_t *in = in_data;
+    for (size_t i = 0; i < in_size; i++)
+    {
+        if ((res = reg_read(sim, &in[i])) != ESP_OK)
+            break;
+        rd++;
+    }
+    bits += SIM_BITS_PER_BYTE * rd + SIM_BITS_STOP;
+
+out:;
+    uint64_t ns = bus_account(dev, bits, rd, wr, res);
+    SIM_UNLOCK();
+
+    if (res != ESP_OK)
+        ESP_LOGV(TAG, "[0x%02x at %d] read failed: %s", dev->addr, dev->port, esp_err_to_name(res));
+    bus_wait(ns);
+
+    return res;
+}
+
+static esp_err_t sim_write(const i2c_dev_t *dev, const void *out_reg, size_t out_reg_size, const void *out_data,
+                           size_t out_size)
+{
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+    if ((!out_reg || !out_reg_size) && (!out_data || !out_size))
+        return ESP_ERR_INVALID_ARG;
+
+    SIM_LOCK();
+
+    esp_err_t res;
+    uint32_t bits = SIM_BITS_START + addr_bits(dev);
+    size_t wr = 0;
+    struct i2cdev_sim_dev *sim = find_device(dev->port, dev->addr);
+
+    if (!sim)
+    {
+        res = ESP_ERR_NOT_FOUND;
+        bits += SIM_BITS_STOP;
+        goto out;
+    }
+    if ((res = take_fault(sim)) != ESP_OK)
+    {
+        bits += SIM_BITS_STOP;
+        goto out;
+    }
+
+    // The register address and payload form one byte stream on the wire
+    const uint8_t *parts[2] = { out_reg, out_data };
+    size_t sizes[2] = { out_reg && out_reg_size ? out_reg_size : 0, out_data && out_size ? out_size : 0 };
+    scripts_update_timed(sim);
+    for (int p = 0; p < 2; p++)
+    {
+        for (size_t i = 0; i < sizes[p]; i++, wr++)
+        {
+            if (wr == 0)
+                sim->ptr = parts[p][i];
+            else
+                reg_write(sim, parts[p][i]);
+        }
+    }
+    bits += SIM_BITS_PER_BYTE * wr + SIM_BITS_STOP;
+
+out:;
+    uint64_t ns = bus_account(dev, bits, 0, wr, res);
+    SIM_UNLOCK();
+
+    if (res != ESP_OK)
+        ESP_LOGV(TAG, "[0x%02x at %d] write failed: %s", dev->addr, dev->port, esp_err_to_name(res));
+    bus_wait(ns);
+
+    return res;
+}
+
+static esp_err_t sim_check_present(const i2c_dev_t *dev)
+{
+    if (!dev)
+        return ESP_ERR_INVALID_ARG;
+
+    SIM_LOCK();
+    struct i2cdev_sim_dev *sim = find_device(dev->port, dev->addr);
+    esp_err_t res = sim ? take_fault(sim) : ESP_ERR_NOT_FOUND;
+    uint64_t ns = bus_account(dev, SIM_BITS_START + addr_bits(dev) + SIM_BITS_STOP, 0, 0, res);
+    SIM_UNLOCK();
+
+    bus_wait(ns);
+
+    return res;
+}
+
+static const i2cdev_backend_t sim_backend = {
+    .name = "simulated",
+    .read = sim_read,
+    .write = sim_write,
+    .check_present = sim_check_present,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+esp_err_t i2cdev_sim_init(const i2cdev_sim_config_t *config)
+{
+    SIM_LOCK();
+    memset(sim_devices, 0, sizeof(sim_devices));
+    memset(sim_stats, 0, sizeof(sim_stats));
+    sim_now_ns = 0;
+    if (config)
+        sim_config = *config;
+    else
+        sim_config = (i2cdev_sim_config_t) { .default_clk_hz = SIM_DEFAULT_CLK_HZ };
+    SIM_UNLOCK();
+
+    ESP_LOGD(TAG, "Simulator reset (%" PRIu32 " Hz, %" PRIu32 " ns/txn%s)", sim_config.default_clk_hz,
+             sim_config.txn_overhead_ns, sim_config.realtime ? ", realtime" : "");
+
+    return ESP_OK;
+}
+
+const i2cdev_backend_t *i2cdev_sim_backend(void)
+{
+    return &sim_backend;
+}
+
+esp_err_t i2cdev_sim_add_device(i2c_port_t port, uint16_t addr, i2cdev_sim_dev_t **sim)
+{
+    CHECK_ARG(sim && port < I2C_NUM_MAX);
+
+    SIM_LOCK();
+    if (find_device(port, addr))
+    {
+        SIM_UNLOCK();
+        ESP_LOGE(TAG, "[0x%02x at %d] Address already simulated", addr, port);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < CONFIG_I2CDEV_SIM_MAX_DEVICES; i++)
+    {
+        if (!sim_devices[i].used)
+        {
+            memset(&sim_devices[i], 0, sizeof(sim_devices[i]));
+            sim_devices[i].used = true;
+            sim_devices[i].port = port;
+            sim_devices[i].addr = addr;
+            *sim = &sim_devices[i];
+            SIM_UNLOCK();
+            ESP_LOGD(TAG, "[0x%02x at %d] Simulated device added", addr, port);
+            return ESP_OK;
+        }
+    }
+    SIM_UNLOCK();
+
+    ESP_LOGE(TAG, "[0x%02x at %d] No free simulated device slots", addr, port);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2cdev_sim_remove_device(i2cdev_sim_dev_t *sim)
+{
+    CHECK_ARG(sim);
+
+    SIM_LOCK();
+    sim->used = false;
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_set_reg(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t value)
+{
+    return i2cdev_sim_set_regs(sim, reg, &value, 1);
+}
+
+esp_err_t i2cdev_sim_set_regs(i2cdev_sim_dev_t *sim, uint8_t start_reg, const void *data, size_t size)
+{
+    CHECK_ARG(sim && data && (size_t)start_reg + size <= I2CDEV_SIM_REG_COUNT);
+
+    SIM_LOCK();
+    memcpy(&sim->regs[start_reg], data, size);
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_get_reg(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t *value)
+{
+    CHECK_ARG(sim && value);
+
+    SIM_LOCK();
+    *value = sim->regs[reg];
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_set_reg_flags(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t flags)
+{
+    CHECK_ARG(sim);
+
+    SIM_LOCK();
+    sim->flags[reg] = flags;
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_set_hooks(i2cdev_sim_dev_t *sim, i2cdev_sim_read_cb_t read_cb, i2cdev_sim_write_cb_t write_cb,
+                               void *ctx)
+{
+    CHECK_ARG(sim);
+
+    SIM_LOCK();
+    sim->read_cb = read_cb;
+    sim->write_cb = write_cb;
+    sim->cb_ctx = ctx;
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_load_script(i2cdev_sim_dev_t *sim, uint8_t start_reg, const void *frames, size_t frame_size,
+                                 size_t frame_count, uint32_t period_us, bool loop)
+{
+    CHECK_ARG(sim && frames && frame_size && frame_count);
+    CHECK_ARG((size_t)start_reg + frame_size <= I2CDEV_SIM_REG_COUNT);
+
+    SIM_LOCK();
+    for (int i = 0; i < CONFIG_I2CDEV_SIM_MAX_SCRIPTS; i++)
+    {
+        sim_script_t *s = &sim->scripts[i];
+        if (s->active)
+            continue;
+        *s = (sim_script_t) {
+            .active = true,
+            .start_reg = start_reg,
+            .frames = frames,
+            .frame_size = frame_size,
+            .frame_count = frame_count,
+            .period_us = period_us,
+            .start_us = sim_now_ns / 1000,
+            .loop = loop,
+        };
+        script_apply(sim, s);
+        SIM_UNLOCK();
+        return ESP_OK;
+    }
+    SIM_UNLOCK();
+
+    ESP_LOGE(TAG, "[0x%02x at %d] No free script slots", sim->addr, sim->port);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2cdev_sim_clear_scripts(i2cdev_sim_dev_t *sim)
+{
+    CHECK_ARG(sim);
+
+    SIM_LOCK();
+    memset(sim->scripts, 0, sizeof(sim->scripts));
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+esp_err_t i2cdev_sim_inject_fault(i2cdev_sim_dev_t *sim, i2cdev_sim_fault_t fault, uint32_t after, uint32_t count)
+{
+    CHECK_ARG(sim);
+
+    SIM_LOCK();
+    sim->fault = count ? fault : I2CDEV_SIM_FAULT_NONE;
+    sim->fault_after = after;
+    sim->fault_count = count;
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+void i2cdev_sim_advance_us(uint64_t us)
+{
+    if (sim_lazy_init() != ESP_OK)
+        return;
+    xSemaphoreTakeRecursive(sim_lock, portMAX_DELAY);
+    sim_now_ns += us * 1000;
+    SIM_UNLOCK();
+}
+
+uint64_t i2cdev_sim_now_us(void)
+{
+    if (sim_lazy_init() != ESP_OK)
+        return 0;
+    xSemaphoreTakeRecursive(sim_lock, portMAX_DELAY);
+    uint64_t now = sim_now_ns / 1000;
+    SIM_UNLOCK();
+
+    return now;
+}
+
+esp_err_t i2cdev_sim_get_stats(i2c_port_t port, i2cdev_sim_stats_t *stats)
+{
+    CHECK_ARG(stats && port < I2C_NUM_MAX);
+
+    SIM_LOCK();
+    *stats = sim_stats[port];
+    SIM_UNLOCK();
+
+    return ESP_OK;
+}
+
+void i2cdev_sim_reset_stats(void)
+{
+    if (sim_lazy_init() != ESP_OK)
+        return;
+    xSemaphoreTakeRecursive(sim_lock, portMAX_DELAY);
+    memset(sim_stats, 0, sizeof(sim_stats));
+    SIM_UNLOCK();
+}
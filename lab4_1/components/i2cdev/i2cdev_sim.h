@@ -0,0 +1,320 @@
+/**
+ * @file i2cdev_sim.h
+ * @defgroup i2cdev_sim i2cdev_sim
+ * @{
+ *
+ * Simulated I2C bus backend for i2cdev
+ *
+ * Lets drivers built on i2cdev (and the application code above them) run
+ * without the I2C peripheral, most usefully on the ESP-IDF Linux target for
+ * unit tests and benchmarks on a workstation.
+ *
+ * Every simulated device is a 256-byte register file addressed with an 8-bit
+ * register pointer, the way most sensors behave:
+ *
+ * - a write sets the register pointer from its first byte and stores the
+ *   remaining bytes with auto-increment;
+ * - a read (optionally preceded by a pointer write) returns bytes from the
+ *   pointer with auto-increment.
+ *
+ * On top of that:
+ *
+ * - Register flags model read-only, clear-on-read and non-incrementing
+ *   (FIFO data port) registers.
+ * - Read/write hooks let a test emulate device logic (FIFO contents, banked
+ *   register access, ...).
+ * - Scripts replay a sequence of register "frames" (e.g. accel/gyro samples)
+ *   either one per read transaction or on a simulated sample clock.
+ * - Faults make selected transactions NACK or time out.
+ * - Transfers to an address with no simulated device fail with
+ *   `ESP_ERR_NOT_FOUND` (address NACK), from read, write and probe alike.
+ * - A bus-time model charges every transaction its wire time at the device's
+ *   SCL frequency plus a fixed per-transaction overhead, and accumulates it
+ *   on a simulated clock and per-port statistics. Optionally the caller is
+ *   blocked for that time so benchmarks see realistic bus cost.
+ *
+ * Usage:
+ *
+ *     i2cdev_init();                                   // Linux: installs the simulated backend
+ *     i2cdev_set_backend(i2cdev_sim_backend());        // other targets: opt in explicitly
+ *
+ *     i2cdev_sim_dev_t *imu;
+ *     i2cdev_sim_add_device(I2C_NUM_0, 0x68, &imu);
+ *     i2cdev_sim_set_reg(imu, 0x75, 0x67);             // WHO_AM_I
+ *     i2cdev_sim_inject_fault(imu, I2CDEV_SIM_FAULT_NACK, 10, 1);
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+
+#ifndef __I2CDEV_SIM_H__
+#define __I2CDEV_SIM_H__
+
+#include "i2cdev.h"
+
+#ifndef CONFIG_I2CDEV_SIM_MAX_DEVICES
+#define CONFIG_I2CDEV_SIM_MAX_DEVICES 4 // Simulated devices across all ports
+#endif
+
+#ifndef CONFIG_I2CDEV_SIM_MAX_SCRIPTS
+#define CONFIG_I2CDEV_SIM_MAX_SCRIPTS 2 // Scripts per simulated device
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define I2CDEV_SIM_REG_COUNT 256
+
+/**
+ * Register behaviour flags
+ */
+#define I2CDEV_SIM_REG_READ_ONLY     0x01 //!< Writes are ignored
+#define I2CDEV_SIM_REG_CLEAR_ON_READ 0x02 //!< Value is cleared after it is read
+#define I2CDEV_SIM_REG_NO_INC        0x04 //!< Register pointer does not advance past this register (FIFO data port)
+
+/**
+ * Injected fault type
+ */
+typedef enum
+{
+    I2CDEV_SIM_FAULT_NONE = 0, //!< No fault
+    I2CDEV_SIM_FAULT_NACK,     //!< Device does not acknowledge a data byte, transfer returns `ESP_FAIL`
+    I2CDEV_SIM_FAULT_TIMEOUT,  //!< Bus hangs, transfer returns `ESP_ERR_TIMEOUT` after CONFIG_I2CDEV_TIMEOUT of bus time
+} i2cdev_sim_fault_t;
+
+/**
+ * Simulated bus configuration
+ */
+typedef struct
+{
+    uint32_t default_clk_hz;  //!< SCL frequency used when the descriptor does not set one
+    uint32_t txn_overhead_ns; //!< Fixed driver/ISR cost added to every transaction
+    bool realtime;            //!< Block the caller for the modelled bus time
+} i2cdev_sim_config_t;
+
+/**
+ * Per-port bus statistics
+ */
+typedef struct
+{
+    uint32_t transactions;  //!< Completed or failed transactions
+    uint32_t bytes_read;    //!< Data bytes clocked in
+    uint32_t bytes_written; //!< Data bytes clocked out, including register pointers
+    uint32_t faults;        //!< Transactions that returned an error
+    uint64_t bus_time_ns;   //!< Total modelled bus time
+} i2cdev_sim_stats_t;
+
+/**
+ * Simulated device handle
+ */
+typedef struct i2cdev_sim_dev i2cdev_sim_dev_t;
+
+/**
+ * @brief Register read hook
+ *
+ * Called for every byte read from the device, before the register file is
+ * consulted. Runs with the simulator lock held; it may call the
+ * i2cdev_sim_* register functions on the same device.
+ *
+ * @param sim Simulated device
+ * @param reg Register being read
+ * @param[out] value Value to return
+ * @param ctx User context
+ * @return `ESP_OK` to return `value`, `ESP_ERR_NOT_FOUND` to fall back to the
+ *         register file, any other error fails the transaction with it
+ */
+typedef esp_err_t (*i2cdev_sim_read_cb_t)(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t *value, void *ctx);
+
+/**
+ * @brief Register write hook
+ *
+ * Called for every byte written to the device, after the register file was
+ * updated (or not, for read-only registers). Same locking rules as the read
+ * hook.
+ *
+ * @param sim Simulated device
+ * @param reg Register being written
+ * @param value Written value
+ * @param ctx User context
+ */
+typedef void (*i2cdev_sim_write_cb_t)(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t value, void *ctx);
+
+/**
+ * @brief Reset the simulator
+ *
+ * Removes all devices, zeroes the simulated clock and the statistics and
+ * applies the configuration. Calling it is optional: the simulator starts
+ * with the default configuration (400 kHz, no overhead, not realtime).
+ *
+ * @param config Bus configuration, NULL for defaults
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_init(const i2cdev_sim_config_t *config);
+
+/**
+ * @brief Get the simulated backend, to be passed to i2cdev_set_backend()
+ *
+ * @return Backend descriptor
+ */
+const i2cdev_backend_t *i2cdev_sim_backend(void);
+
+/**
+ * @brief Attach a simulated device to the bus
+ *
+ * The register file starts zeroed with no flags, hooks, scripts or faults.
+ *
+ * @param port I2C port
+ * @param addr Device address
+ * @param[out] sim Simulated device handle
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if the address is
+ *         taken, `ESP_ERR_NO_MEM` if CONFIG_I2CDEV_SIM_MAX_DEVICES is reached
+ */
+esp_err_t i2cdev_sim_add_device(i2c_port_t port, uint16_t addr, i2cdev_sim_dev_t **sim);
+
+/**
+ * @brief Detach a simulated device; transfers to its address will NACK with `ESP_ERR_NOT_FOUND`
+ *
+ * @param sim Simulated device
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_remove_device(i2cdev_sim_dev_t *sim);
+
+/**
+ * @brief Set a register value directly, bypassing flags and hooks
+ *
+ * @param sim Simulated device
+ * @param reg Register
+ * @param value Value
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_set_reg(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t value);
+
+/**
+ * @brief Set consecutive register values directly, bypassing flags and hooks
+ *
+ * @param sim Simulated device
+ * @param start_reg First register
+ * @param data Values
+ * @param size Number of registers, `start_reg + size` must not exceed 256
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_set_regs(i2cdev_sim_dev_t *sim, uint8_t start_reg, const void *data, size_t size);
+
+/**
+ * @brief Get a register value directly, bypassing flags and hooks
+ *
+ * @param sim Simulated device
+ * @param reg Register
+ * @param[out] value Value
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_get_reg(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t *value);
+
+/**
+ * @brief Set behaviour flags of a register
+ *
+ * @param sim Simulated device
+ * @param reg Register
+ * @param flags Bitwise OR of `I2CDEV_SIM_REG_...`
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_set_reg_flags(i2cdev_sim_dev_t *sim, uint8_t reg, uint8_t flags);
+
+/**
+ * @brief Install register hooks
+ *
+ * @param sim Simulated device
+ * @param read_cb Read hook, may be NULL
+ * @param write_cb Write hook, may be NULL
+ * @param ctx User context passed to both hooks
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_set_hooks(i2cdev_sim_dev_t *sim, i2cdev_sim_read_cb_t read_cb, i2cdev_sim_write_cb_t write_cb,
+                               void *ctx);
+
+/**
+ * @brief Replay a sequence of register frames
+ *
+ * A frame is `frame_size` bytes copied to the registers starting at
+ * `start_reg`. The first frame is applied immediately.
+ *
+ * With `period_us == 0` the script advances once per read transaction that
+ * touches its registers, so every read sees a new frame (and reading a
+ * vector axis by axis sees axes from different frames, like real hardware).
+ * Otherwise frames advance every `period_us` of simulated time.
+ *
+ * At the end of the sequence the script restarts if `loop` is set and holds
+ * the last frame otherwise. The frame buffer is not copied and must stay
+ * valid while the script is loaded.
+ *
+ * @param sim Simulated device
+ * @param start_reg First register of a frame
+ * @param frames `frame_count` frames of `frame_size` bytes each
+ * @param frame_size Frame size, `start_reg + frame_size` must not exceed 256
+ * @param frame_count Number of frames
+ * @param period_us Frame period in simulated time, 0 to advance per read
+ * @param loop Restart at the end of the sequence
+ * @return `ESP_OK` on success, `ESP_ERR_NO_MEM` if CONFIG_I2CDEV_SIM_MAX_SCRIPTS are loaded
+ */
+esp_err_t i2cdev_sim_load_script(i2cdev_sim_dev_t *sim, uint8_t start_reg, const void *frames, size_t frame_size,
+                                 size_t frame_count, uint32_t period_us, bool loop);
+
+/**
+ * @brief Unload all scripts of a device, registers keep their last values
+ *
+ * @param sim Simulated device
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_clear_scripts(i2cdev_sim_dev_t *sim);
+
+/**
+ * @brief Make transactions to a device fail
+ *
+ * After `after` more successful transactions, the next `count` transactions
+ * fail with `fault`. Replaces any pending fault on the device.
+ *
+ * @param sim Simulated device
+ * @param fault Fault type, I2CDEV_SIM_FAULT_NONE cancels a pending fault
+ * @param after Transactions to let through first
+ * @param count Transactions to fail, UINT32_MAX for all following ones
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_inject_fault(i2cdev_sim_dev_t *sim, i2cdev_sim_fault_t fault, uint32_t after, uint32_t count);
+
+/**
+ * @brief Let simulated time pass without bus traffic
+ *
+ * Advances timed scripts, like a task sleeping between samples would.
+ *
+ * @param us Microseconds
+ */
+void i2cdev_sim_advance_us(uint64_t us);
+
+/**
+ * @brief Get the simulated clock
+ *
+ * @return Microseconds of bus time and i2cdev_sim_advance_us() since init
+ */
+uint64_t i2cdev_sim_now_us(void);
+
+/**
+ * @brief Get bus statistics of a port
+ *
+ * @param port I2C port
+ * @param[out] stats Statistics
+ * @return `ESP_OK` on success
+ */
+esp_err_t i2cdev_sim_get_stats(i2c_port_t port, i2cdev_sim_stats_t *stats);
+
+/**
+ * @brief Zero the bus statistics of all ports
+ */
+void i2cdev_sim_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __I2CDEV_SIM_H__ */
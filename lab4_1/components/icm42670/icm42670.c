@@ -26,7 +26,6 @@
  * ISC Licensed as described in the file LICENSE
  *
  * Open TODOs:
- * - FIFO reading and handling
  * - APEX functions like pedometer, tilt-detection, low-g detection, freefall detection, ...
  *
  *
@@ -145,6 +144,38 @@ static const char *TAG = "icm42670";
 #define ICM42670_FIFO_BYPASS_BITS  0x01 // ICM42670_REG_FIFO_CONFIG1<0>
 #define ICM42670_FIFO_BYPASS_SHIFT 0    // ICM42670_REG_FIFO_CONFIG1<0>
 
+#define ICM42670_FIFO_WM_H_BITS  0x0F // ICM42670_REG_FIFO_CONFIG3<3:0>
+#define ICM42670_FIFO_WM_H_SHIFT 0    // ICM42670_REG_FIFO_CONFIG3<3:0>
+
+#define ICM42670_FIFO_WM_GT_TH_BITS   0x20 // ICM42670_REG_FIFO_CONFIG5<5>
+#define ICM42670_FIFO_WM_GT_TH_SHIFT  5    // ICM42670_REG_FIFO_CONFIG5<5>
+#define ICM42670_FIFO_HIRES_EN_BITS   0x08 // ICM42670_REG_FIFO_CONFIG5<3>
+#define ICM42670_FIFO_HIRES_EN_SHIFT  3    // ICM42670_REG_FIFO_CONFIG5<3>
+#define ICM42670_FIFO_GYRO_EN_BITS    0x02 // ICM42670_REG_FIFO_CONFIG5<1>
+#define ICM42670_FIFO_GYRO_EN_SHIFT   1    // ICM42670_REG_FIFO_CONFIG5<1>
+#define ICM42670_FIFO_ACCEL_EN_BITS   0x01 // ICM42670_REG_FIFO_CONFIG5<0>
+#define ICM42670_FIFO_ACCEL_EN_SHIFT  0    // ICM42670_REG_FIFO_CONFIG5<0>
+
+#define ICM42670_TMST_RES_BITS  0x08 // ICM42670_REG_TMST_CONFIG1<3>
+#define ICM42670_TMST_RES_SHIFT 3    // ICM42670_REG_TMST_CONFIG1<3>
+#define ICM42670_TMST_EN_BITS   0x01 // ICM42670_REG_TMST_CONFIG1<0>
+#define ICM42670_TMST_EN_SHIFT  0    // ICM42670_REG_TMST_CONFIG1<0>
+
+// FIFO packet header
+#define ICM42670_FIFO_HEADER_MSG_BITS    0x80 // header<7>, FIFO empty
+#define ICM42670_FIFO_HEADER_ACCEL_BITS  0x40 // header<6>
+#define ICM42670_FIFO_HEADER_GYRO_BITS   0x20 // header<5>
+#define ICM42670_FIFO_HEADER_20_BITS     0x10 // header<4>, 20-bit packet
+#define ICM42670_FIFO_HEADER_TMST_BITS   0x0C // header<3:2>
+#define ICM42670_FIFO_HEADER_TMST_ODR    0x08 // header<3:2> = 0b10, ODR timestamp
+
+#define ICM42670_FIFO_PACKET_SMALL_SIZE 8  // packets 1 and 2
+#define ICM42670_FIFO_PACKET_LARGE_SIZE 16 // packet 3
+#define ICM42670_FIFO_INVALID_SAMPLE    (-32768)
+
+// bytes read per I2C transaction when draining the FIFO
+#define ICM42670_FIFO_BURST_SIZE 256
+
 #define ICM42670_ST_INT1_EN_BITS          0x80 // ICM42670_REG_INT_SOURCE0<7>
 #define ICM42670_ST_INT1_EN_SHIFT         7    // ICM42670_REG_INT_SOURCE0<7>
 #define ICM42670_FSYNC_INT1_EN_BITS       0x40 // ICM42670_REG_INT_SOURCE0<6>
@@ -262,17 +293,29 @@ static inline esp_err_t read_register(icm42670_t *dev, uint8_t reg, uint8_t *val
     return i2c_dev_read_reg(&dev->i2c_dev, reg, value, 1);
 }
 
+// sensor data registers are big-endian (SENSOR_DATA_ENDIAN reset value)
+static inline int16_t be16(const uint8_t *buf)
+{
+    return (int16_t)((buf[0] << 8) | buf[1]);
+}
+
+static inline void be16_to_xyz(const uint8_t *buf, icm42670_raw_xyz_t *xyz)
+{
+    xyz->x = be16(buf);
+    xyz->y = be16(buf + 2);
+    xyz->z = be16(buf + 4);
+}
+
 static inline esp_err_t read_register_16(icm42670_t *dev, uint8_t upper_byte_reg, int16_t *value)
 {
     CHECK_ARG(dev && value);
 
-    esp_err_t err;
-    uint8_t reg_0, reg_1;
-    err = read_register(dev, upper_byte_reg, &reg_1);
-    err = read_register(dev, upper_byte_reg + 1, &reg_0);
-    *value = reg_0 | (reg_1 << 8);
+    // both bytes in one burst, so they come from the same sample
+    uint8_t buf[2];
+    CHECK(i2c_dev_read_reg(&dev->i2c_dev, upper_byte_reg, buf, sizeof(buf)));
+    *value = be16(buf);
 
-    return err;
+    return ESP_OK;
 }
 
 static inline esp_err_t manipulate_register(icm42670_t *dev, uint8_t reg_addr, uint8_t mask, uint8_t shift,
@@ -367,7 +410,10 @@ esp_err_t icm42670_init_desc(icm42670_t *dev, uint8_t addr, i2c_port_t port, gpi
     dev->i2c_dev.cfg.sda_io_num = sda_gpio;
     dev->i2c_dev.cfg.scl_io_num = scl_gpio;
     dev->i2c_dev.timeout_ticks = 0; // set to default
-#if HELPER_TARGET_IS_ESP32
+    dev->fifo_packet_size = 0;
+    dev->fifo_tmst_shift = 0;
+    dev->fifo_tmst_started = false;
+#if HELPER_TARGET_IS_ESP32 || HELPER_TARGET_IS_LINUX
     dev->i2c_dev.cfg.master.clk_speed = I2C_FREQ_HZ;
 #endif
 
@@ -499,6 +545,61 @@ esp_err_t icm42670_read_raw_data(icm42670_t *dev, uint8_t data_register, int16_t
     return ESP_OK;
 }
 
+esp_err_t icm42670_read_accel_xyz(icm42670_t *dev, icm42670_raw_xyz_t *accel)
+{
+    CHECK_ARG(dev && accel);
+
+    uint8_t buf[6];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_ACCEL_DATA_X1, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    be16_to_xyz(buf, accel);
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_read_gyro_xyz(icm42670_t *dev, icm42670_raw_xyz_t *gyro)
+{
+    CHECK_ARG(dev && gyro);
+
+    uint8_t buf[6];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_GYRO_DATA_X1, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    be16_to_xyz(buf, gyro);
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_read_accel_gyro(icm42670_t *dev, icm42670_raw_data_t *data)
+{
+    CHECK_ARG(dev && data);
+
+    uint8_t buf[12];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_ACCEL_DATA_X1, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    be16_to_xyz(buf, &data->accel);
+    be16_to_xyz(buf + 6, &data->gyro);
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_read_all(icm42670_t *dev, icm42670_raw_data_t *data)
+{
+    CHECK_ARG(dev && data);
+
+    uint8_t buf[14];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_TEMP_DATA1, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    data->temp = be16(buf);
+    be16_to_xyz(buf + 2, &data->accel);
+    be16_to_xyz(buf + 8, &data->gyro);
+
+    return ESP_OK;
+}
+
 esp_err_t icm42670_read_temperature(icm42670_t *dev, float *temperature)
 {
     CHECK_ARG(dev && temperature);
@@ -535,6 +636,207 @@ esp_err_t icm42670_flush_fifo(icm42670_t *dev)
     return ESP_OK;
 }
 
+esp_err_t icm42670_config_fifo(icm42670_t *dev, icm42670_fifo_config_t config)
+{
+    CHECK_ARG(dev && config.packet <= ICM42670_FIFO_PACKET_ACCEL_GYRO);
+
+    uint8_t packet_size = config.packet == ICM42670_FIFO_PACKET_ACCEL_GYRO ? ICM42670_FIFO_PACKET_LARGE_SIZE
+                                                                           : ICM42670_FIFO_PACKET_SMALL_SIZE;
+    // watermark is set in bytes, as FIFO_COUNT is
+    uint32_t watermark = (uint32_t)config.watermark * packet_size;
+    CHECK_ARG(config.watermark > 0 && watermark <= ICM42670_FIFO_SIZE);
+
+    uint8_t fifo_config5 = 1 << ICM42670_FIFO_WM_GT_TH_SHIFT;
+    if (config.packet != ICM42670_FIFO_PACKET_GYRO)
+        fifo_config5 |= 1 << ICM42670_FIFO_ACCEL_EN_SHIFT;
+    if (config.packet != ICM42670_FIFO_PACKET_ACCEL)
+        fifo_config5 |= 1 << ICM42670_FIFO_GYRO_EN_SHIFT;
+
+    // configuration must only be changed while the FIFO is bypassed
+    CHECK(icm42670_enable_fifo(dev, false));
+    dev->fifo_packet_size = 0;
+
+    CHECK(write_mreg_register(dev, ICM42670_MREG1_RW, ICM42670_REG_FIFO_CONFIG5, fifo_config5));
+    CHECK(manipulate_mreg_register(dev, ICM42670_MREG1_RW, ICM42670_REG_TMST_CONFIG1, ICM42670_TMST_RES_BITS,
+                                   ICM42670_TMST_RES_SHIFT, config.timestamp_resolution));
+    CHECK(manipulate_mreg_register(dev, ICM42670_MREG1_RW, ICM42670_REG_TMST_CONFIG1, ICM42670_TMST_EN_BITS,
+                                   ICM42670_TMST_EN_SHIFT, 1));
+
+    // FIFO count in bytes, big endian
+    CHECK(manipulate_register(dev, ICM42670_REG_INTF_CONFIG0,
+                              ICM42670_FIFO_COUNT_FORMAT_BITS | ICM42670_FIFO_COUNT_ENDIAN_BITS,
+                              ICM42670_FIFO_COUNT_ENDIAN_SHIFT, 1));
+
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, write_register(dev, ICM42670_REG_FIFO_CONFIG2, watermark & 0xFF));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    CHECK(manipulate_register(dev, ICM42670_REG_FIFO_CONFIG3, ICM42670_FIFO_WM_H_BITS, ICM42670_FIFO_WM_H_SHIFT,
+                              watermark >> 8));
+    CHECK(manipulate_register(dev, ICM42670_REG_FIFO_CONFIG1, ICM42670_FIFO_MODE_BITS, ICM42670_FIFO_MODE_SHIFT,
+                              config.mode));
+
+    dev->fifo_packet_size = packet_size;
+    dev->fifo_tmst_shift = config.timestamp_resolution == ICM42670_TMST_RES_16US ? 4 : 0;
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_enable_fifo(icm42670_t *dev, bool enable)
+{
+    CHECK_ARG(dev);
+
+    CHECK(manipulate_register(dev, ICM42670_REG_FIFO_CONFIG1, ICM42670_FIFO_BYPASS_BITS, ICM42670_FIFO_BYPASS_SHIFT,
+                              !enable));
+    if (enable)
+    {
+        CHECK(icm42670_flush_fifo(dev));
+        dev->fifo_tmst_started = false;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_get_fifo_count(icm42670_t *dev, uint16_t *count)
+{
+    CHECK_ARG(dev && count);
+
+    // FIFO_COUNTH must be read first, the burst takes care of that
+    uint8_t buf[2];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_FIFO_COUNTH, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    *count = (uint16_t)((buf[0] << 8) | buf[1]);
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_get_fifo_lost_packets(icm42670_t *dev, uint16_t *count)
+{
+    CHECK_ARG(dev && count);
+
+    uint8_t buf[2];
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_FIFO_LOST_PKT0, buf, sizeof(buf)));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    *count = (uint16_t)((buf[1] << 8) | buf[0]); // LOST_PKT0 is the low byte
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_parse_fifo_packet(const uint8_t *buf, size_t len, icm42670_fifo_sample_t *sample,
+                                     size_t *packet_size)
+{
+    CHECK_ARG(buf && sample && packet_size && len > 0);
+
+    uint8_t header = buf[0];
+    if (header & ICM42670_FIFO_HEADER_MSG_BITS)
+        return ESP_ERR_NOT_FOUND;
+    if (header & ICM42670_FIFO_HEADER_20_BITS)
+        return ESP_ERR_NOT_SUPPORTED;
+
+    bool has_accel = header & ICM42670_FIFO_HEADER_ACCEL_BITS;
+    bool has_gyro = header & ICM42670_FIFO_HEADER_GYRO_BITS;
+    if (!has_accel && !has_gyro)
+        return ESP_ERR_INVALID_RESPONSE;
+
+    size_t size = has_accel && has_gyro ? ICM42670_FIFO_PACKET_LARGE_SIZE : ICM42670_FIFO_PACKET_SMALL_SIZE;
+    if (len < size)
+        return ESP_ERR_INVALID_SIZE;
+
+    // packet 1: accel + temp, packet 2: gyro + temp, packet 3: accel + gyro + temp + timestamp
+    const uint8_t *p = buf + 1;
+    sample->header = header;
+    if (has_accel)
+    {
+        be16_to_xyz(p, &sample->accel);
+        p += 6;
+    }
+    if (has_gyro)
+    {
+        be16_to_xyz(p, &sample->gyro);
+        p += 6;
+    }
+    sample->temp = (int8_t)*p++;
+    sample->accel_valid = has_accel && sample->accel.x != ICM42670_FIFO_INVALID_SAMPLE;
+    sample->gyro_valid = has_gyro && sample->gyro.x != ICM42670_FIFO_INVALID_SAMPLE;
+    sample->timestamp_valid = size == ICM42670_FIFO_PACKET_LARGE_SIZE
+                              && (header & ICM42670_FIFO_HEADER_TMST_BITS) == ICM42670_FIFO_HEADER_TMST_ODR;
+    sample->timestamp = size == ICM42670_FIFO_PACKET_LARGE_SIZE ? (uint16_t)be16(p) : 0;
+    *packet_size = size;
+
+    return ESP_OK;
+}
+
+esp_err_t icm42670_read_fifo(icm42670_t *dev, icm42670_fifo_sample_t *samples, size_t max_samples, size_t *count)
+{
+    CHECK_ARG(dev && samples && count);
+
+    *count = 0;
+    if (!dev->fifo_packet_size)
+    {
+        ESP_LOGE(TAG, "FIFO not configured");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint16_t fifo_bytes;
+    CHECK(icm42670_get_fifo_count(dev, &fifo_bytes));
+
+    size_t packets = fifo_bytes / dev->fifo_packet_size;
+    if (packets > max_samples)
+        packets = max_samples;
+
+    uint8_t buf[ICM42670_FIFO_BURST_SIZE];
+    size_t packets_per_burst = sizeof(buf) / dev->fifo_packet_size;
+    size_t n = 0;
+    bool empty = false;
+    while (n < packets && !empty)
+    {
+        size_t burst = packets - n < packets_per_burst ? packets - n : packets_per_burst;
+
+        // FIFO_DATA does not auto-increment, so one read pops many packets
+        I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+        I2C_DEV_CHECK(&dev->i2c_dev,
+                      i2c_dev_read_reg(&dev->i2c_dev, ICM42670_REG_FIFO_DATA, buf, burst * dev->fifo_packet_size));
+        I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+
+        for (size_t i = 0; i < burst; i++)
+        {
+            icm42670_fifo_sample_t *sample = &samples[n];
+            size_t size;
+            esp_err_t err = icm42670_parse_fifo_packet(buf + i * dev->fifo_packet_size, dev->fifo_packet_size,
+                                                       sample, &size);
+            if (err == ESP_ERR_NOT_FOUND)
+            {
+                empty = true; // FIFO ran empty (e.g. flushed concurrently)
+                break;
+            }
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Invalid FIFO packet header 0x%02x", buf[i * dev->fifo_packet_size]);
+                *count = n;
+                return err;
+            }
+
+            sample->time_us = 0;
+            if (sample->timestamp_valid)
+            {
+                if (dev->fifo_tmst_started)
+                    dev->fifo_time_us += (uint64_t)(uint16_t)(sample->timestamp - dev->fifo_last_tmst)
+                                         << dev->fifo_tmst_shift;
+                else
+                    dev->fifo_time_us = (uint64_t)sample->timestamp << dev->fifo_tmst_shift;
+                dev->fifo_tmst_started = true;
+                dev->fifo_last_tmst = sample->timestamp;
+                sample->time_us = dev->fifo_time_us;
+            }
+            n++;
+        }
+    }
+    *count = n;
+
+    return ESP_OK;
+}
+
 esp_err_t icm42670_set_gyro_fsr(icm42670_t *dev, icm42670_gyro_fsr_t range)
 {
     CHECK_ARG(dev);
@@ -679,6 +981,20 @@ esp_err_t icm42670_enable_wom(icm42670_t *dev, bool enable)
     return manipulate_register(dev, ICM42670_REG_WOM_CONFIG, ICM42670_WOM_EN_BITS, ICM42670_WOM_EN_SHIFT, enable);
 }
 
+esp_err_t icm42670_get_wom_status(icm42670_t *dev, bool *wom)
+{
+    CHECK_ARG(dev && wom);
+
+    // INT_STATUS2 clears on read
+    uint8_t reg;
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, read_register(dev, ICM42670_REG_INT_STATUS2, &reg));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    *wom = reg & (ICM42670_WOM_X_INT_BITS | ICM42670_WOM_Y_INT_BITS | ICM42670_WOM_Z_INT_BITS);
+
+    return ESP_OK;
+}
+
 esp_err_t icm42670_get_mclk_rdy(icm42670_t *dev, bool *mclk_rdy)
 {
     CHECK_ARG(dev && mclk_rdy);
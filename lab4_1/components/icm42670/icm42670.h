@@ -368,12 +368,80 @@ typedef enum
     ICM42670_MREG3_RW = 0x50
 } icm42670_mreg_number_t;
 
+/* Raw 3-axis sample (accel or gyro), sensor LSB */
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} icm42670_raw_xyz_t;
+
+/* Raw sensor data block, all values from the same sample */
+typedef struct
+{
+    int16_t temp; // only filled by icm42670_read_all()
+    icm42670_raw_xyz_t accel;
+    icm42670_raw_xyz_t gyro;
+} icm42670_raw_data_t;
+
+#define ICM42670_FIFO_SIZE 2304 // FIFO size in bytes
+
+/* FIFO behaviour when full */
+typedef enum
+{
+    ICM42670_FIFO_MODE_STREAM = 0,      // oldest packets are overwritten
+    ICM42670_FIFO_MODE_STOP_ON_FULL = 1 // new packets are dropped
+} icm42670_fifo_mode_t;
+
+/* FIFO packet format */
+typedef enum
+{
+    ICM42670_FIFO_PACKET_ACCEL = 0,     // packet 1: header, accel, temp (8 bytes)
+    ICM42670_FIFO_PACKET_GYRO = 1,      // packet 2: header, gyro, temp (8 bytes)
+    ICM42670_FIFO_PACKET_ACCEL_GYRO = 2 // packet 3: header, accel, gyro, temp, timestamp (16 bytes)
+} icm42670_fifo_packet_t;
+
+/* Timestamp resolution */
+typedef enum
+{
+    ICM42670_TMST_RES_1US = 0,
+    ICM42670_TMST_RES_16US = 1
+} icm42670_tmst_res_t;
+
+/* FIFO configuration */
+typedef struct
+{
+    icm42670_fifo_mode_t mode;
+    icm42670_fifo_packet_t packet;
+    uint16_t watermark; // FIFO threshold interrupt level in packets, at least 1
+    icm42670_tmst_res_t timestamp_resolution;
+} icm42670_fifo_config_t;
+
+/* Sample parsed from a FIFO packet */
+typedef struct
+{
+    uint8_t header;          // raw packet header
+    bool accel_valid;        // accel contains a sample
+    bool gyro_valid;         // gyro contains a sample
+    bool timestamp_valid;    // timestamp and time_us are set (packet 3 only)
+    icm42670_raw_xyz_t accel;
+    icm42670_raw_xyz_t gyro;
+    int8_t temp;             // degree C = temp / 2.0 + 25
+    uint16_t timestamp;      // raw 16-bit ODR timestamp, in units of the timestamp resolution
+    uint64_t time_us;        // unwrapped timestamp, only set by icm42670_read_fifo()
+} icm42670_fifo_sample_t;
+
 /**
  * Device descriptor
  */
 typedef struct
 {
     i2c_dev_t i2c_dev;
+    uint8_t fifo_packet_size;   // bytes per FIFO packet, 0 if the FIFO is not configured
+    uint8_t fifo_tmst_shift;    // log2 of the timestamp resolution in us
+    bool fifo_tmst_started;     // fifo_time_us holds a timestamp
+    uint16_t fifo_last_tmst;    // last raw FIFO timestamp
+    uint64_t fifo_time_us;      // unwrapped time of the last FIFO sample
     // TODO: add more vars for configuration
 } icm42670_t;
 
@@ -460,6 +528,54 @@ esp_err_t icm42670_read_temperature(icm42670_t *dev, float *temperature);
  */
 esp_err_t icm42670_read_raw_data(icm42670_t *dev, uint8_t data_register, int16_t *data);
 
+/**
+ * @brief Read the three accelerometer axes in one burst
+ *
+ * Reads ACCEL_DATA_X1..ACCEL_DATA_Z0 (6 bytes) in a single I2C transaction,
+ * so all axes belong to the same sample.
+ *
+ * @param dev Device descriptor
+ * @param[out] accel raw accelerometer data
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_read_accel_xyz(icm42670_t *dev, icm42670_raw_xyz_t *accel);
+
+/**
+ * @brief Read the three gyro axes in one burst
+ *
+ * Reads GYRO_DATA_X1..GYRO_DATA_Z0 (6 bytes) in a single I2C transaction,
+ * so all axes belong to the same sample.
+ *
+ * @param dev Device descriptor
+ * @param[out] gyro raw gyro data
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_read_gyro_xyz(icm42670_t *dev, icm42670_raw_xyz_t *gyro);
+
+/**
+ * @brief Read accelerometer and gyro in one burst
+ *
+ * Reads ACCEL_DATA_X1..GYRO_DATA_Z0 (12 bytes) in a single I2C transaction.
+ * `data->temp` is left untouched.
+ *
+ * @param dev Device descriptor
+ * @param[out] data raw accelerometer and gyro data
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_read_accel_gyro(icm42670_t *dev, icm42670_raw_data_t *data);
+
+/**
+ * @brief Read temperature, accelerometer and gyro in one burst
+ *
+ * Reads TEMP_DATA1..GYRO_DATA_Z0 (14 bytes) in a single I2C transaction.
+ * Temperature in degree C is `temp / 128.0 + 25`.
+ *
+ * @param dev Device descriptor
+ * @param[out] data raw temperature, accelerometer and gyro data
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_read_all(icm42670_t *dev, icm42670_raw_data_t *data);
+
 /**
  * @brief Performs a soft-reset
  *
@@ -476,6 +592,87 @@ esp_err_t icm42670_reset(icm42670_t *dev);
  */
 esp_err_t icm42670_flush_fifo(icm42670_t *dev);
 
+/**
+ * @brief Configure the FIFO
+ *
+ * Puts the FIFO in bypass, selects the packet format, watermark, full
+ * behaviour and timestamp resolution, and switches the FIFO count to bytes.
+ * Enable the FIFO with icm42670_enable_fifo() afterwards. Requires MCLK.
+ *
+ * @param dev Device descriptor
+ * @param config struct of type icm42670_fifo_config_t
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_config_fifo(icm42670_t *dev, icm42670_fifo_config_t config);
+
+/**
+ * @brief Enable or bypass the FIFO
+ *
+ * Enabling flushes the FIFO and restarts timestamp unwrapping.
+ *
+ * @param dev Device descriptor
+ * @param enable true to enable, false to bypass
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_enable_fifo(icm42670_t *dev, bool enable);
+
+/**
+ * @brief Get the number of bytes in the FIFO
+ *
+ * @param dev Device descriptor
+ * @param[out] count FIFO fill level in bytes
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_get_fifo_count(icm42670_t *dev, uint16_t *count);
+
+/**
+ * @brief Get the number of packets lost to a full FIFO
+ *
+ * @param dev Device descriptor
+ * @param[out] count lost packets
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_get_fifo_lost_packets(icm42670_t *dev, uint16_t *count);
+
+/**
+ * @brief Parse one FIFO packet
+ *
+ * Understands packets 1 to 3. Axes holding the invalid marker (-32768) are
+ * reported as not valid. `time_us` is not touched.
+ *
+ * @param buf packet data
+ * @param len bytes available in `buf`
+ * @param[out] sample parsed sample
+ * @param[out] packet_size size of the packet in bytes
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FOUND` if the header marks the
+ *         FIFO as empty, `ESP_ERR_INVALID_SIZE` if `buf` holds a partial
+ *         packet, `ESP_ERR_NOT_SUPPORTED` for 20-bit packets
+ */
+esp_err_t icm42670_parse_fifo_packet(const uint8_t *buf, size_t len, icm42670_fifo_sample_t *sample,
+                                     size_t *packet_size);
+
+/**
+ * @brief Drain the FIFO
+ *
+ * Reads the FIFO count once, then reads as many complete packets as fit in
+ * `samples`, several packets per I2C transaction, and parses them. Packet 3
+ * timestamps are unwrapped into `time_us` by adding the delta to the
+ * previous sample, so how often the FIFO is drained does not matter. What
+ * does is the spacing of consecutive samples: it must stay below one 16-bit
+ * timestamp wrap (65.5 ms at 1 us resolution, 1.05 s at 16 us), i.e. the ODR
+ * must be above 15.3 Hz (1 us) or 1 Hz (16 us), and no packets may be lost
+ * in between. A FIFO overflow (overwritten packets in stream mode, dropped
+ * ones in stop-on-full mode, see icm42670_get_fifo_lost_packets()) can
+ * produce a larger gap, which then unwraps short by whole wraps.
+ *
+ * @param dev Device descriptor
+ * @param[out] samples sample buffer
+ * @param max_samples size of `samples`
+ * @param[out] count number of samples read
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if the FIFO is not configured
+ */
+esp_err_t icm42670_read_fifo(icm42670_t *dev, icm42670_fifo_sample_t *samples, size_t max_samples, size_t *count);
+
 /**
  * @brief Set the measurement FSR (Full Scale Range) of the gyro
  *
@@ -588,6 +785,18 @@ esp_err_t icm42670_config_wom(icm42670_t *dev, icm42670_wom_config_t config);
  */
 esp_err_t icm42670_enable_wom(icm42670_t *dev, bool enable);
 
+/**
+ * @brief Check whether Wake on Motion triggered since the last call
+ *
+ * Reads (and thereby clears) the WoM flags of INT_STATUS2, so motion can be
+ * polled when the interrupt pin is not connected.
+ *
+ * @param dev Device descriptor
+ * @param[out] wom true if any axis exceeded its WoM threshold
+ * @return `ESP_OK` on success
+ */
+esp_err_t icm42670_get_wom_status(icm42670_t *dev, bool *wom);
+
 /**
  * @brief Get the status of the internal clock
  *
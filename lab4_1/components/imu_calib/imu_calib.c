@@ -0,0 +1,222 @@
+/**
+ * @file imu_calib.c
+ *
+ * IMU bias / scale calibration, see imu_calib.h
+ */
+
+#include <string.h>
+#include <nvs.h>
+#include "imu_calib.h"
+
+#define NVS_KEY        "calib"
+#define NVS_VERSION    1
+
+// six-position: gravity axis must carry > 0.9 g, the others < 0.42 g (~25 deg)
+#define FACE_MAIN_PERMILLE  900
+#define FACE_OTHER_PERMILLE 420
+// accepted accelerometer scale error
+#define SCALE_MIN  (IMU_CALIB_SCALE_ONE * 9 / 10)
+#define SCALE_MAX  (IMU_CALIB_SCALE_ONE * 11 / 10)
+
+typedef struct
+{
+    uint8_t version;
+    imu_calib_t cal;
+} calib_blob_t;
+
+static inline int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+static inline int32_t iabs(int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+void imu_calib_init(imu_calib_t *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+    for (int i = 0; i < 3; i++)
+        cal->accel_scale[i] = IMU_CALIB_SCALE_ONE;
+}
+
+void imu_calib_apply(const imu_calib_t *cal, int16_t accel[3], int16_t gyro[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (accel)
+            accel[i] = sat16(((int32_t)(accel[i] - cal->accel_bias[i]) * cal->accel_scale[i]) >> 14);
+        if (gyro)
+            gyro[i] = sat16((int32_t)gyro[i] - cal->gyro_bias[i]);
+    }
+}
+
+esp_err_t imu_calib_load(imu_calib_t *cal, const char *nvs_namespace)
+{
+    if (!cal || !nvs_namespace)
+        return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READONLY, &h);
+    if (err != ESP_OK)
+        return err;
+
+    calib_blob_t blob;
+    size_t len = sizeof(blob);
+    err = nvs_get_blob(h, NVS_KEY, &blob, &len);
+    nvs_close(h);
+    if (err != ESP_OK)
+        return err;
+    if (len != sizeof(blob) || blob.version != NVS_VERSION)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    *cal = blob.cal;
+    return ESP_OK;
+}
+
+esp_err_t imu_calib_save(const imu_calib_t *cal, const char *nvs_namespace)
+{
+    if (!cal || !nvs_namespace)
+        return ESP_ERR_INVALID_ARG;
+
+    calib_blob_t blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = NVS_VERSION;
+    blob.cal = *cal;
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &h);
+    if (err != ESP_OK)
+        return err;
+    err = nvs_set_blob(h, NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK)
+        err = nvs_commit(h);
+    nvs_close(h);
+    return err;
+}
+
+static void still_restart(imu_still_t *s)
+{
+    s->count = 0;
+    memset(s->accel_sum, 0, sizeof(s->accel_sum));
+    memset(s->gyro_sum, 0, sizeof(s->gyro_sum));
+}
+
+void imu_calib_still_init(imu_still_t *s, uint16_t window, uint16_t gyro_p2p, uint16_t accel_p2p)
+{
+    memset(s, 0, sizeof(*s));
+    s->window = window ? window : 1;
+    s->gyro_p2p = gyro_p2p;
+    s->accel_p2p = accel_p2p;
+}
+
+bool imu_calib_still_feed(imu_still_t *s, const int16_t accel[3], const int16_t gyro[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (!s->count || accel[i] < s->accel_min[i])
+            s->accel_min[i] = accel[i];
+        if (!s->count || accel[i] > s->accel_max[i])
+            s->accel_max[i] = accel[i];
+        s->accel_sum[i] += accel[i];
+        if (gyro)
+        {
+            if (!s->count || gyro[i] < s->gyro_min[i])
+                s->gyro_min[i] = gyro[i];
+            if (!s->count || gyro[i] > s->gyro_max[i])
+                s->gyro_max[i] = gyro[i];
+            s->gyro_sum[i] += gyro[i];
+        }
+    }
+
+    // give up on the window as soon as it moves, the next one starts fresh
+    for (int i = 0; i < 3; i++)
+    {
+        if (s->accel_max[i] - s->accel_min[i] > s->accel_p2p
+                || (gyro && s->gyro_max[i] - s->gyro_min[i] > s->gyro_p2p))
+        {
+            still_restart(s);
+            return false;
+        }
+    }
+
+    if (++s->count < s->window)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        s->accel_mean[i] = (int16_t)(s->accel_sum[i] / s->window);
+        s->gyro_mean[i] = gyro ? (int16_t)(s->gyro_sum[i] / s->window) : 0;
+    }
+    still_restart(s);
+    return true;
+}
+
+bool imu_calib_update_gyro_bias(imu_calib_t *cal, const imu_still_t *s, uint16_t min_change)
+{
+    bool changed = !(cal->flags & IMU_CALIB_GYRO_BIAS);
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (iabs(s->gyro_mean[i] - cal->gyro_bias[i]) >= min_change)
+            changed = true;
+        cal->gyro_bias[i] = s->gyro_mean[i];
+    }
+    cal->flags |= IMU_CALIB_GYRO_BIAS;
+
+    return changed;
+}
+
+void imu_calib_six_pos_init(imu_six_pos_t *p, uint16_t lsb_per_g)
+{
+    memset(p, 0, sizeof(*p));
+    p->lsb_per_g = lsb_per_g;
+}
+
+int imu_calib_six_pos_add(imu_six_pos_t *p, const int16_t accel_mean[3])
+{
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+        if (iabs(accel_mean[i]) > iabs(accel_mean[axis]))
+            axis = i;
+
+    if (iabs(accel_mean[axis]) * 1000 < (int32_t)p->lsb_per_g * FACE_MAIN_PERMILLE)
+        return -1;
+    for (int i = 0; i < 3; i++)
+        if (i != axis && iabs(accel_mean[i]) * 1000 > (int32_t)p->lsb_per_g * FACE_OTHER_PERMILLE)
+            return -1;
+
+    int face = axis * 2 + (accel_mean[axis] < 0);
+    memcpy(p->face[face], accel_mean, sizeof(p->face[face]));
+    p->done |= 1 << face;
+
+    return face;
+}
+
+esp_err_t imu_calib_six_pos_solve(const imu_six_pos_t *p, imu_calib_t *cal)
+{
+    if (p->done != 0x3f)
+        return ESP_ERR_INVALID_STATE;
+
+    int16_t bias[3];
+    uint16_t scale[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int32_t up = p->face[i * 2][i];
+        int32_t down = p->face[i * 2 + 1][i];
+        int32_t span = up - down; // 2 g
+
+        bias[i] = (int16_t)((up + down) / 2);
+        int32_t q = (int32_t)(((int64_t)2 * p->lsb_per_g * IMU_CALIB_SCALE_ONE + span / 2) / span);
+        if (q < SCALE_MIN || q > SCALE_MAX)
+            return ESP_ERR_INVALID_RESPONSE;
+        scale[i] = (uint16_t)q;
+    }
+
+    memcpy(cal->accel_bias, bias, sizeof(bias));
+    memcpy(cal->accel_scale, scale, sizeof(scale));
+    cal->flags |= IMU_CALIB_ACCEL;
+
+    return ESP_OK;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file imu_calib.h
+ * @defgroup imu_calib imu_calib
+ * @{
+ *
+ * Accelerometer / gyro calibration for raw ICM-42670 style samples
+ *
+ * - Gyro bias from a stationary window: a still device reads zero rate in
+ *   any orientation, so the mean of a quiet window is the bias. Run it at
+ *   boot and again whenever the device is found still.
+ * - Accelerometer offset and scale from six positions (each axis up and
+ *   down): offset = (up + down) / 2, scale = 2 g / (up - down).
+ *
+ * Corrections are applied in fixed point, scale in Q14:
+ *
+ *     accel' = (accel - accel_bias) * accel_scale >> 14
+ *     gyro'  = gyro - gyro_bias
+ *
+ * Results are stored in NVS as one blob per namespace.
+ */
+
+#ifndef __IMU_CALIB_H__
+#define __IMU_CALIB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMU_CALIB_SCALE_ONE (1 << 14)
+
+#define IMU_CALIB_GYRO_BIAS  (1 << 0) // gyro_bias is measured
+#define IMU_CALIB_ACCEL      (1 << 1) // accel_bias and accel_scale are measured
+
+/* Calibration, applied to raw samples */
+typedef struct
+{
+    uint8_t flags;           // IMU_CALIB_GYRO_BIAS | IMU_CALIB_ACCEL
+    int16_t accel_bias[3];   // LSB
+    uint16_t accel_scale[3]; // Q14, IMU_CALIB_SCALE_ONE = 1.0
+    int16_t gyro_bias[3];    // LSB
+} imu_calib_t;
+
+/* Stationary detector, fed with raw samples */
+typedef struct
+{
+    uint16_t window;       // samples per decision
+    uint16_t gyro_p2p;     // max peak-to-peak gyro within a window, LSB
+    uint16_t accel_p2p;    // max peak-to-peak accelerometer within a window, LSB
+    uint16_t count;
+    int32_t accel_sum[3];
+    int32_t gyro_sum[3];
+    int16_t accel_min[3], accel_max[3];
+    int16_t gyro_min[3], gyro_max[3];
+    int16_t accel_mean[3]; // means of the last still window
+    int16_t gyro_mean[3];
+} imu_still_t;
+
+/* Six-position accelerometer calibration */
+typedef struct
+{
+    uint16_t lsb_per_g;
+    uint8_t done;          // bit per face: +X, -X, +Y, -Y, +Z, -Z
+    int16_t face[6][3];    // mean accelerometer reading per face
+} imu_six_pos_t;
+
+/**
+ * @brief Reset a calibration to zero bias and unit scale
+ *
+ * @param cal Calibration
+ */
+void imu_calib_init(imu_calib_t *cal);
+
+/**
+ * @brief Correct one sample in place
+ *
+ * @param cal Calibration
+ * @param[in,out] accel raw accelerometer X, Y, Z, may be NULL
+ * @param[in,out] gyro raw gyro X, Y, Z, may be NULL
+ */
+void imu_calib_apply(const imu_calib_t *cal, int16_t accel[3], int16_t gyro[3]);
+
+/**
+ * @brief Load a calibration from NVS
+ *
+ * `cal` is left untouched if nothing valid is stored.
+ *
+ * @param cal Calibration
+ * @param nvs_namespace NVS namespace
+ * @return `ESP_OK` on success, `ESP_ERR_NVS_NOT_FOUND` if nothing is stored
+ */
+esp_err_t imu_calib_load(imu_calib_t *cal, const char *nvs_namespace);
+
+/**
+ * @brief Store a calibration in NVS
+ *
+ * @param cal Calibration
+ * @param nvs_namespace NVS namespace
+ * @return `ESP_OK` on success
+ */
+esp_err_t imu_calib_save(const imu_calib_t *cal, const char *nvs_namespace);
+
+/**
+ * @brief Initialize a stationary detector
+ *
+ * @param s Detector
+ * @param window samples per decision
+ * @param gyro_p2p max gyro peak-to-peak while still, LSB
+ * @param accel_p2p max accelerometer peak-to-peak while still, LSB
+ */
+void imu_calib_still_init(imu_still_t *s, uint16_t window, uint16_t gyro_p2p, uint16_t accel_p2p);
+
+/**
+ * @brief Feed one raw sample to a stationary detector
+ *
+ * @param s Detector
+ * @param accel raw accelerometer X, Y, Z
+ * @param gyro raw gyro X, Y, Z, NULL for accelerometer-only use
+ * @return true when a window completed with the device still;
+ *         the window means are in `s->accel_mean` / `s->gyro_mean`
+ */
+bool imu_calib_still_feed(imu_still_t *s, const int16_t accel[3], const int16_t gyro[3]);
+
+/**
+ * @brief Take the gyro bias from the last still window
+ *
+ * @param cal Calibration
+ * @param s Detector that just reported a still window
+ * @param min_change smallest per-axis change, LSB, that counts as a change
+ * @return true if the bias moved by at least `min_change` on some axis
+ *         (or was not measured before), i.e. it is worth saving
+ */
+bool imu_calib_update_gyro_bias(imu_calib_t *cal, const imu_still_t *s, uint16_t min_change);
+
+/**
+ * @brief Start a six-position calibration
+ *
+ * @param p State
+ * @param lsb_per_g nominal accelerometer sensitivity, e.g. 8192 for +-4 g
+ */
+void imu_calib_six_pos_init(imu_six_pos_t *p, uint16_t lsb_per_g);
+
+/**
+ * @brief Record a still accelerometer mean as one of the six faces
+ *
+ * The face is found from the axis carrying gravity; readings that are not
+ * close to axis-aligned (within ~25 degrees) are rejected.
+ *
+ * @param p State
+ * @param accel_mean mean raw accelerometer X, Y, Z over a still window
+ * @return face index 0..5 (+X, -X, +Y, -Y, +Z, -Z), -1 if not axis-aligned
+ */
+int imu_calib_six_pos_add(imu_six_pos_t *p, const int16_t accel_mean[3]);
+
+/**
+ * @brief Compute accelerometer offset and scale once all faces are recorded
+ *
+ * @param p State
+ * @param cal Calibration, accelerometer part is replaced
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if faces are missing,
+ *         `ESP_ERR_INVALID_RESPONSE` if the result is implausible
+ */
+esp_err_t imu_calib_six_pos_solve(const imu_six_pos_t *p, imu_calib_t *cal);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif // __IMU_CALIB_H__
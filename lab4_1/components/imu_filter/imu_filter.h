@@ -0,0 +1,316 @@
+/**
+ * @file imu_filter.h
+ * @defgroup imu_filter imu_filter
+ * @{
+ *
+ * Header-only streaming filters for multi-axis IMU samples
+ *
+ * Every update is O(1) in the window length / filter order:
+ *
+ * - IMU_SMA_DEFINE: simple moving average over any window, running sum
+ *   (integer or floating point samples)
+ * - IMU_EMA_DEFINE: first-order low pass (exponential moving average),
+ *   fixed point, integer samples
+ * - IMU_BIQUAD_DEFINE: second-order IIR section, fixed point, integer samples
+ * - IMU_ONE_EURO_DEFINE: One-Euro filter (cutoff rises with speed, low jitter
+ *   at rest and low lag in motion), floating point samples
+ *
+ * A `*_DEFINE` macro generates a filter type and its functions for one sample
+ * type and axis count, so every consumer shares the implementation while the
+ * compiler sees fixed sizes:
+ *
+ *     IMU_SMA_DEFINE(accel_sma, float, float, 3, 32)  // accel_sma_t, accel_sma_init(), accel_sma_update()
+ *
+ *     static accel_sma_t filt;
+ *     accel_sma_init(&filt);
+ *     float in[3] = { gx, gy, gz }, out[3];
+ *     accel_sma_update(&filt, in, out);
+ *
+ * Use it at file scope; the generated functions are `static inline`.
+ */
+
+#ifndef __IMU_FILTER_H__
+#define __IMU_FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMU_FILTER_PI 3.14159265358979323846
+
+// Fractional bits kept in the EMA and biquad state (on top of the sample LSB)
+#define IMU_FILTER_STATE_FRAC 8
+
+// Q format of the EMA smoothing factor and the biquad coefficients
+#define IMU_EMA_ALPHA_FRAC  15
+#define IMU_BIQUAD_COEF_FRAC 28
+
+/**
+ * @brief EMA smoothing factor for a cutoff frequency
+ *
+ * @param cutoff_hz -3 dB frequency
+ * @param sample_hz sample rate
+ * @return alpha in Q15, for the `*_init()` function of IMU_EMA_DEFINE
+ */
+static inline uint16_t imu_ema_alpha_q15(float cutoff_hz, float sample_hz)
+{
+    float alpha = 1.0f - expf(-2.0f * (float)IMU_FILTER_PI * cutoff_hz / sample_hz);
+    if (alpha < 0.0f)
+        alpha = 0.0f;
+    if (alpha > 1.0f)
+        alpha = 1.0f;
+    return (uint16_t)lrintf(alpha * (1 << IMU_EMA_ALPHA_FRAC));
+}
+
+/**
+ * Biquad coefficients, Q28, normalized to a0 = 1
+ */
+typedef struct
+{
+    int32_t b0, b1, b2;
+    int32_t a1, a2;
+} imu_biquad_coeffs_t;
+
+static inline int32_t imu_biquad_q28(double v)
+{
+    return (int32_t)llrint(v * (double)(1L << IMU_BIQUAD_COEF_FRAC));
+}
+
+/**
+ * @brief Design a second-order Butterworth-style low pass (RBJ cookbook)
+ *
+ * @param[out] c coefficients
+ * @param cutoff_hz -3 dB frequency, below sample_hz / 2
+ * @param sample_hz sample rate
+ * @param q quality factor, 0.7071 for Butterworth
+ */
+static inline void imu_biquad_lowpass(imu_biquad_coeffs_t *c, float cutoff_hz, float sample_hz, float q)
+{
+    double w0 = 2.0 * IMU_FILTER_PI * cutoff_hz / sample_hz;
+    double alpha = sin(w0) / (2.0 * q);
+    double cosw = cos(w0);
+    double a0 = 1.0 + alpha;
+
+    c->b0 = imu_biquad_q28((1.0 - cosw) / 2.0 / a0);
+    c->b1 = imu_biquad_q28((1.0 - cosw) / a0);
+    c->b2 = c->b0;
+    c->a1 = imu_biquad_q28(-2.0 * cosw / a0);
+    c->a2 = imu_biquad_q28((1.0 - alpha) / a0);
+}
+
+// Round a fixed-point state with IMU_FILTER_STATE_FRAC fractional bits to sample LSB
+static inline int32_t imu_filter_state_round(int64_t v)
+{
+    return (int32_t)((v + (1 << (IMU_FILTER_STATE_FRAC - 1))) >> IMU_FILTER_STATE_FRAC);
+}
+
+/**
+ * @brief Simple moving average
+ *
+ * Generates `name##_t`, `name##_init(f)` and `name##_update(f, in, out)`.
+ * Next to the running sum, a second sum collects the samples written
+ * during the current pass over the window. At the wrap it covers exactly
+ * the window and replaces the running sum, so floating point sums cannot
+ * drift, and no update walks the window. Until the window is full the average covers the
+ * samples seen so far.
+ *
+ * @param name     filter name
+ * @param type     sample type
+ * @param acc_type accumulator type, wide enough for `window` samples
+ * @param axes     number of axes
+ * @param window   window length in samples
+ */
+#define IMU_SMA_DEFINE(name, type, acc_type, axes, window)                                                             \
+    typedef struct                                                                                                     \
+    {                                                                                                                  \
+        type buf[(window)][(axes)];                                                                                    \
+        acc_type sum[(axes)];                                                                                          \
+        acc_type lap[(axes)];        /* samples written since the last wrap */                                         \
+        uint32_t idx, n;                                                                                               \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline void name##_init(name##_t *f)                                                                        \
+    {                                                                                                                  \
+        memset(f, 0, sizeof(*f));                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_update(name##_t *f, const type *in, type *out)                                           \
+    {                                                                                                                  \
+        for (int a = 0; a < (axes); a++)                                                                               \
+        {                                                                                                              \
+            f->sum[a] += (acc_type)in[a] - (acc_type)f->buf[f->idx][a];                                                \
+            f->lap[a] += (acc_type)in[a];                                                                              \
+            f->buf[f->idx][a] = in[a];                                                                                 \
+        }                                                                                                              \
+        if (++f->idx == (window))                                                                                      \
+        {                                                                                                              \
+            f->idx = 0;                                                                                                \
+            for (int a = 0; a < (axes); a++)                                                                           \
+            {                                                                                                          \
+                f->sum[a] = f->lap[a];                                                                                 \
+                f->lap[a] = 0;                                                                                         \
+            }                                                                                                          \
+        }                                                                                                              \
+        if (f->n < (window))                                                                                           \
+            f->n++;                                                                                                    \
+        for (int a = 0; a < (axes); a++)                                                                               \
+            out[a] = (type)(f->sum[a] / (acc_type)f->n);                                                               \
+    }
+
+/**
+ * @brief Exponential moving average, fixed point
+ *
+ * Generates `name##_t`, `name##_init(f, alpha_q15)` and
+ * `name##_update(f, in, out)`. `y += alpha * (x - y)` with the state kept at
+ * IMU_FILTER_STATE_FRAC extra fractional bits; the first sample seeds the
+ * state. Get alpha from imu_ema_alpha_q15().
+ *
+ * @param name filter name
+ * @param type integer sample type, up to 16 bits
+ * @param axes number of axes
+ */
+#define IMU_EMA_DEFINE(name, type, axes)                                                                               \
+    typedef struct                                                                                                     \
+    {                                                                                                                  \
+        int32_t y[(axes)];                                                                                             \
+        uint16_t alpha;                                                                                                \
+        bool primed;                                                                                                   \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline void name##_init(name##_t *f, uint16_t alpha_q15)                                                    \
+    {                                                                                                                  \
+        memset(f, 0, sizeof(*f));                                                                                      \
+        f->alpha = alpha_q15;                                                                                          \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_update(name##_t *f, const type *in, type *out)                                           \
+    {                                                                                                                  \
+        for (int a = 0; a < (axes); a++)                                                                               \
+        {                                                                                                              \
+            int32_t x = (int32_t)in[a] * (1 << IMU_FILTER_STATE_FRAC);                                                 \
+            if (!f->primed)                                                                                            \
+                f->y[a] = x;                                                                                           \
+            else                                                                                                       \
+                f->y[a] += (int32_t)(((int64_t)(x - f->y[a]) * f->alpha) >> IMU_EMA_ALPHA_FRAC);                       \
+            out[a] = (type)imu_filter_state_round(f->y[a]);                                                            \
+        }                                                                                                              \
+        f->primed = true;                                                                                              \
+    }
+
+/**
+ * @brief Second-order IIR section (direct form I), fixed point
+ *
+ * Generates `name##_t`, `name##_init(f, coeffs)` and
+ * `name##_update(f, in, out)`. Q28 coefficients and a 64-bit accumulator
+ * keep low cutoffs (fc/fs down to ~0.001) accurate; the state starts at
+ * zero. Get coefficients from imu_biquad_lowpass() or fill
+ * imu_biquad_coeffs_t directly; cascade instances for higher orders.
+ *
+ * @param name filter name
+ * @param type integer sample type, up to 16 bits
+ * @param axes number of axes
+ */
+#define IMU_BIQUAD_DEFINE(name, type, axes)                                                                            \
+    typedef struct                                                                                                     \
+    {                                                                                                                  \
+        imu_biquad_coeffs_t c;                                                                                         \
+        int32_t x1[(axes)], x2[(axes)], y1[(axes)], y2[(axes)];                                                        \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline void name##_init(name##_t *f, const imu_biquad_coeffs_t *coeffs)                                     \
+    {                                                                                                                  \
+        memset(f, 0, sizeof(*f));                                                                                      \
+        f->c = *coeffs;                                                                                                \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_update(name##_t *f, const type *in, type *out)                                           \
+    {                                                                                                                  \
+        for (int a = 0; a < (axes); a++)                                                                               \
+        {                                                                                                              \
+            int32_t x = (int32_t)in[a] * (1 << IMU_FILTER_STATE_FRAC);                                                 \
+            int64_t acc = (int64_t)f->c.b0 * x + (int64_t)f->c.b1 * f->x1[a] + (int64_t)f->c.b2 * f->x2[a]            \
+                          - (int64_t)f->c.a1 * f->y1[a] - (int64_t)f->c.a2 * f->y2[a];                                 \
+            int32_t y = (int32_t)((acc + (1LL << (IMU_BIQUAD_COEF_FRAC - 1))) >> IMU_BIQUAD_COEF_FRAC);               \
+            f->x2[a] = f->x1[a];                                                                                       \
+            f->x1[a] = x;                                                                                              \
+            f->y2[a] = f->y1[a];                                                                                       \
+            f->y1[a] = y;                                                                                              \
+            out[a] = (type)imu_filter_state_round(y);                                                                  \
+        }                                                                                                              \
+    }
+
+/**
+ * @brief One-Euro filter
+ *
+ * Generates `name##_t`, `name##_init(f, min_cutoff_hz, beta, d_cutoff_hz)`
+ * and `name##_update(f, in, dt_s, out)`. Each axis is a first-order low pass
+ * whose cutoff is `min_cutoff_hz + beta * |dx/dt|`, the derivative itself
+ * low passed at `d_cutoff_hz`. Lower `min_cutoff_hz` against jitter at rest,
+ * raise `beta` against lag in fast motion. `dt_s` is the time since the
+ * previous sample; the first sample seeds the state.
+ *
+ * @param name filter name
+ * @param type floating point sample type
+ * @param axes number of axes
+ */
+#define IMU_ONE_EURO_DEFINE(name, type, axes)                                                                          \
+    typedef struct                                                                                                     \
+    {                                                                                                                  \
+        type min_cutoff, beta, d_cutoff;                                                                               \
+        type x[(axes)], dx[(axes)];                                                                                    \
+        bool primed;                                                                                                   \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline void name##_init(name##_t *f, type min_cutoff_hz, type beta, type d_cutoff_hz)                       \
+    {                                                                                                                  \
+        memset(f, 0, sizeof(*f));                                                                                      \
+        f->min_cutoff = min_cutoff_hz;                                                                                 \
+        f->beta = beta;                                                                                                \
+        f->d_cutoff = d_cutoff_hz;                                                                                     \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline type name##_alpha(type cutoff_hz, type dt_s)                                                         \
+    {                                                                                                                  \
+        type tau = (type)1 / ((type)2 * (type)IMU_FILTER_PI * cutoff_hz);                                              \
+        return (type)1 / ((type)1 + tau / dt_s);                                                                       \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_update(name##_t *f, const type *in, type dt_s, type *out)                                \
+    {                                                                                                                  \
+        if (!f->primed || dt_s <= 0)                                                                                   \
+        {                                                                                                              \
+            for (int a = 0; a < (axes); a++)                                                                           \
+            {                                                                                                          \
+                if (!f->primed)                                                                                        \
+                {                                                                                                      \
+                    f->x[a] = in[a];                                                                                   \
+                    f->dx[a] = 0;                                                                                      \
+                }                                                                                                      \
+                out[a] = f->x[a];                                                                                      \
+            }                                                                                                          \
+            f->primed = true;                                                                                          \
+            return;                                                                                                    \
+        }                                                                                                              \
+        type ad = name##_alpha(f->d_cutoff, dt_s);                                                                     \
+        for (int a = 0; a < (axes); a++)                                                                               \
+        {                                                                                                              \
+            type dx = (in[a] - f->x[a]) / dt_s;                                                                        \
+            f->dx[a] += ad * (dx - f->dx[a]);                                                                          \
+            type cutoff = f->min_cutoff + f->beta * (f->dx[a] < 0 ? -f->dx[a] : f->dx[a]);                             \
+            f->x[a] += name##_alpha(cutoff, dt_s) * (in[a] - f->x[a]);                                                 \
+            out[a] = f->x[a];                                                                                          \
+        }                                                                                                              \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif // __IMU_FILTER_H__
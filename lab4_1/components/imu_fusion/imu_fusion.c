@@ -0,0 +1,270 @@
+/**
+ * @file imu_fusion.c
+ *
+ * Complementary and Madgwick orientation filters, see imu_fusion.h
+ */
+
+#include <string.h>
+#include <math.h>
+#include "imu_fusion.h"
+
+#define MDEG_PER_RAD 57295.7795f
+#define Q15          32768
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+// atan(z) for z in [0, 1] (Q15), millidegrees:
+// atan(z) ~ pi/4 z + z (1 - z) (0.2447 + 0.0663 z), error < 0.09 deg
+static int32_t atan_q15_mdeg(int32_t z)
+{
+    int32_t t = (z * (Q15 - z)) >> 15;
+    return ((45000 * z) >> 15) + ((t * (14020 + ((3799 * z) >> 15))) >> 15);
+}
+
+int32_t imu_fusion_atan2_mdeg(int32_t y, int32_t x)
+{
+    if (!x && !y)
+        return 0;
+
+    int64_t ax = x < 0 ? -(int64_t)x : x;
+    int64_t ay = y < 0 ? -(int64_t)y : y;
+    int32_t a;
+    if (ay <= ax)
+        a = atan_q15_mdeg((int32_t)((ay << 15) / ax));
+    else
+        a = 90000 - atan_q15_mdeg((int32_t)((ax << 15) / ay));
+
+    if (x < 0)
+        a = 180000 - a;
+    return y < 0 ? -a : a;
+}
+
+static int32_t wrap_mdeg(int32_t a)
+{
+    while (a > 180000)
+        a -= 360000;
+    while (a <= -180000)
+        a += 360000;
+    return a;
+}
+
+static int32_t wrap_udeg(int32_t a)
+{
+    while (a > 180000000)
+        a -= 360000000;
+    while (a <= -180000000)
+        a += 360000000;
+    return a;
+}
+
+// n / d for d > 0, halves rounded away from zero so that small positive and
+// negative steps are treated alike
+static int64_t div_round(int64_t n, int64_t d)
+{
+    return n >= 0 ? (n + d / 2) / d : -((-n + d / 2) / d);
+}
+
+// v * k, k in Q15, rounded the same way
+static int32_t mul_q15_round(int64_t v, int32_t k)
+{
+    int64_t p = v * k;
+    return (int32_t)(p >= 0 ? (p + (1 << 14)) >> 15 : -((-p + (1 << 14)) >> 15));
+}
+
+static void accel_angles(const int16_t accel[3], int32_t *roll, int32_t *pitch)
+{
+    int32_t yz = (int32_t)isqrt64((int64_t)accel[1] * accel[1] + (int64_t)accel[2] * accel[2]);
+    *roll = imu_fusion_atan2_mdeg(accel[1], accel[2]);
+    *pitch = imu_fusion_atan2_mdeg(-accel[0], yz);
+}
+
+static bool accel_trusted(const imu_fusion_config_t *cfg, const int16_t accel[3])
+{
+    if (!cfg->accel_gate_mg)
+        return true;
+
+    int32_t mag = (int32_t)isqrt64((int64_t)accel[0] * accel[0] + (int64_t)accel[1] * accel[1]
+                                   + (int64_t)accel[2] * accel[2]);
+    int32_t err_mg = (mag - cfg->accel_lsb_per_g) * 1000 / cfg->accel_lsb_per_g;
+    return (err_mg < 0 ? -err_mg : err_mg) <= cfg->accel_gate_mg;
+}
+
+static void complementary_update(imu_fusion_t *f, const int16_t accel[3], const int32_t rate[3], uint32_t dt_us,
+                                 bool use_accel)
+{
+    // small-angle propagation: body X/Y rates drive roll/pitch directly. The
+    // state is in microdegrees: a step of a slow rotation is well under a
+    // millidegree (0.2 dps at 200 Hz) and must still add up
+    int32_t roll = f->roll_udeg + (int32_t)div_round((int64_t)rate[0] * dt_us, 1000);
+    int32_t pitch = f->pitch_udeg + (int32_t)div_round((int64_t)rate[1] * dt_us, 1000);
+
+    if (use_accel)
+    {
+        int32_t roll_acc, pitch_acc;
+        accel_angles(accel, &roll_acc, &pitch_acc);
+
+        // weight of the accelerometer: dt / (tau + dt), Q15
+        uint32_t tau_us = (uint32_t)f->cfg.tau_ms * 1000;
+        int32_t k = (int32_t)(((uint64_t)dt_us << 15) / (tau_us + dt_us));
+        roll += mul_q15_round(wrap_udeg(roll_acc * 1000 - roll), k);
+        pitch += mul_q15_round(pitch_acc * 1000 - pitch, k);
+    }
+
+    f->roll_udeg = wrap_udeg(roll);
+    f->pitch_udeg = pitch > 90000000 ? 90000000 : (pitch < -90000000 ? -90000000 : pitch);
+    f->roll_mdeg = wrap_mdeg((int32_t)div_round(f->roll_udeg, 1000));
+    f->pitch_mdeg = (int32_t)div_round(f->pitch_udeg, 1000);
+}
+
+static void madgwick_seed(imu_fusion_t *f, const int16_t accel[3])
+{
+    int32_t roll, pitch;
+    accel_angles(accel, &roll, &pitch);
+
+    float hr = roll / MDEG_PER_RAD / 2, hp = pitch / MDEG_PER_RAD / 2;
+    float cr = cosf(hr), sr = sinf(hr), cp = cosf(hp), sp = sinf(hp);
+    f->q[0] = cr * cp;
+    f->q[1] = sr * cp;
+    f->q[2] = cr * sp;
+    f->q[3] = -sr * sp;
+}
+
+static void madgwick_update(imu_fusion_t *f, const int16_t accel[3], const int32_t rate[3], uint32_t dt_us)
+{
+    float *q = f->q;
+    float gx = rate[0] / MDEG_PER_RAD, gy = rate[1] / MDEG_PER_RAD, gz = rate[2] / MDEG_PER_RAD;
+    float dt = dt_us * 1e-6f;
+
+    // rate of change of the quaternion from the gyro
+    float qd0 = 0.5f * (-q[1] * gx - q[2] * gy - q[3] * gz);
+    float qd1 = 0.5f * (q[0] * gx + q[2] * gz - q[3] * gy);
+    float qd2 = 0.5f * (q[0] * gy - q[1] * gz + q[3] * gx);
+    float qd3 = 0.5f * (q[0] * gz + q[1] * gy - q[2] * gx);
+
+    float ax = accel[0], ay = accel[1], az = accel[2];
+    float norm = sqrtf(ax * ax + ay * ay + az * az);
+    if (norm > 0)
+    {
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // gradient descent step towards gravity
+        float _2q0 = 2 * q[0], _2q1 = 2 * q[1], _2q2 = 2 * q[2], _2q3 = 2 * q[3];
+        float _4q0 = 4 * q[0], _4q1 = 4 * q[1], _4q2 = 4 * q[2];
+        float _8q1 = 8 * q[1], _8q2 = 8 * q[2];
+        float q0q0 = q[0] * q[0], q1q1 = q[1] * q[1], q2q2 = q[2] * q[2], q3q3 = q[3] * q[3];
+
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4 * q0q0 * q[1] - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2
+                   + _4q1 * az;
+        float s2 = 4 * q0q0 * q[2] + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2
+                   + _4q2 * az;
+        float s3 = 4 * q1q1 * q[3] - _2q1 * ax + 4 * q2q2 * q[3] - _2q2 * ay;
+        float sn = sqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        if (sn > 0)
+        {
+            qd0 -= f->cfg.beta * s0 / sn;
+            qd1 -= f->cfg.beta * s1 / sn;
+            qd2 -= f->cfg.beta * s2 / sn;
+            qd3 -= f->cfg.beta * s3 / sn;
+        }
+    }
+
+    q[0] += qd0 * dt;
+    q[1] += qd1 * dt;
+    q[2] += qd2 * dt;
+    q[3] += qd3 * dt;
+    float qn = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; i++)
+        q[i] /= qn;
+
+    float sp = 2 * (q[0] * q[2] - q[1] * q[3]);
+    sp = sp > 1 ? 1 : (sp < -1 ? -1 : sp);
+    f->roll_mdeg = (int32_t)lrintf(
+        atan2f(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])) * MDEG_PER_RAD);
+    f->pitch_mdeg = (int32_t)lrintf(asinf(sp) * MDEG_PER_RAD);
+}
+
+esp_err_t imu_fusion_init(imu_fusion_t *f, const imu_fusion_config_t *config)
+{
+    if (!f || !config || !config->accel_lsb_per_g || !config->gyro_lsb_per_dps_x10
+            || config->algo > IMU_FUSION_MADGWICK)
+        return ESP_ERR_INVALID_ARG;
+    // tau 0 would drop the gyro altogether, and divide by zero with dt 0
+    if (config->algo == IMU_FUSION_COMPLEMENTARY && !config->tau_ms)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(f, 0, sizeof(*f));
+    f->cfg = *config;
+    imu_fusion_reset(f);
+
+    return ESP_OK;
+}
+
+void imu_fusion_reset(imu_fusion_t *f)
+{
+    f->primed = false;
+    f->roll_mdeg = 0;
+    f->pitch_mdeg = 0;
+    f->roll_udeg = 0;
+    f->pitch_udeg = 0;
+    f->q[0] = 1;
+    f->q[1] = f->q[2] = f->q[3] = 0;
+}
+
+void imu_fusion_update(imu_fusion_t *f, const int16_t accel[3], const int16_t gyro[3], uint32_t dt_us,
+                       imu_fusion_output_t *out)
+{
+    int32_t rate[3];
+    for (int i = 0; i < 3; i++)
+        rate[i] = (int32_t)gyro[i] * 10000 / f->cfg.gyro_lsb_per_dps_x10;
+
+    bool use_accel = accel_trusted(&f->cfg, accel);
+
+    if (!f->primed)
+    {
+        // start from the accelerometer tilt instead of converging from 0
+        accel_angles(accel, &f->roll_mdeg, &f->pitch_mdeg);
+        f->roll_udeg = f->roll_mdeg * 1000;
+        f->pitch_udeg = f->pitch_mdeg * 1000;
+        if (f->cfg.algo == IMU_FUSION_MADGWICK)
+            madgwick_seed(f, accel);
+        f->primed = true;
+        use_accel = true;
+    }
+    else if (f->cfg.algo == IMU_FUSION_MADGWICK)
+    {
+        madgwick_update(f, accel, rate, dt_us);
+        use_accel = true; // Madgwick always blends in gravity, weighted by beta
+    }
+    else
+        complementary_update(f, accel, rate, dt_us, use_accel);
+
+    if (out)
+    {
+        out->roll_mdeg = f->roll_mdeg;
+        out->pitch_mdeg = f->pitch_mdeg;
+        memcpy(out->rate_mdps, rate, sizeof(rate));
+        out->accel_used = use_accel;
+    }
+}
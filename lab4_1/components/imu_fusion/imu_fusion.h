@@ -0,0 +1,121 @@
+/**
+ * @file imu_fusion.h
+ * @defgroup imu_fusion imu_fusion
+ * @{
+ *
+ * Gyro + accelerometer orientation estimate (pitch/roll) for tilt pointers
+ *
+ * Two estimators:
+ *
+ * - Complementary filter, all fixed point: the gyro rate is integrated and
+ *   pulled towards the accelerometer tilt with time constant `tau_ms`.
+ *   Accelerometer samples whose magnitude is far from 1 g (the hand is
+ *   accelerating) are not used for the correction, so quick moves are not
+ *   read as tilt.
+ * - Madgwick gradient descent (6-axis), floating point internally, for a
+ *   quaternion estimate that stays correct at large tilts.
+ *
+ * Both take raw sensor LSB and report fixed point:
+ * angles in millidegrees, body rates in millidegrees per second.
+ *
+ * Axes follow the sensor frame. Roll is about X (`atan2(ay, az)`), pitch is
+ * about Y (`atan2(-ax, sqrt(ay^2 + az^2))`); both are 0 with the board flat.
+ */
+
+#ifndef __IMU_FUSION_H__
+#define __IMU_FUSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Estimator */
+typedef enum
+{
+    IMU_FUSION_COMPLEMENTARY = 0,
+    IMU_FUSION_MADGWICK = 1
+} imu_fusion_algo_t;
+
+/* Fusion configuration */
+typedef struct
+{
+    imu_fusion_algo_t algo;
+    uint16_t accel_lsb_per_g;       // e.g. 8192 for +-4 g
+    uint16_t gyro_lsb_per_dps_x10;  // e.g. 328 for +-1000 dps (32.8 LSB/dps)
+    uint16_t tau_ms;                // complementary: time constant of the accel correction, > 0
+    uint16_t accel_gate_mg;         // complementary: ignore accel if | |a| - 1 g | exceeds this, 0 = never
+    float beta;                     // Madgwick: gain, ~0.05..0.2
+} imu_fusion_config_t;
+
+/* Fusion output */
+typedef struct
+{
+    int32_t roll_mdeg;    // -180000 .. 180000
+    int32_t pitch_mdeg;   // -90000 .. 90000
+    int32_t rate_mdps[3]; // body rates about X, Y, Z
+    bool accel_used;      // the accelerometer corrected this update
+} imu_fusion_output_t;
+
+/* Fusion state */
+typedef struct
+{
+    imu_fusion_config_t cfg;
+    bool primed;
+    int32_t roll_mdeg;
+    int32_t pitch_mdeg;
+    int32_t roll_udeg;  // complementary: the estimate itself, microdegrees
+    int32_t pitch_udeg;
+    float q[4]; // Madgwick quaternion w, x, y, z
+} imu_fusion_t;
+
+/**
+ * @brief Initialize a fusion state
+ *
+ * @param f Fusion state
+ * @param config Configuration
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` for a zero scale, an
+ *         unknown algorithm or a complementary filter with `tau_ms` 0
+ */
+esp_err_t imu_fusion_init(imu_fusion_t *f, const imu_fusion_config_t *config);
+
+/**
+ * @brief Forget the orientation, the next update restarts from the accelerometer
+ *
+ * @param f Fusion state
+ */
+void imu_fusion_reset(imu_fusion_t *f);
+
+/**
+ * @brief Feed one accel + gyro sample
+ *
+ * @param f Fusion state
+ * @param accel raw accelerometer X, Y, Z
+ * @param gyro raw gyro X, Y, Z
+ * @param dt_us time since the previous sample
+ * @param[out] out orientation and rates
+ */
+void imu_fusion_update(imu_fusion_t *f, const int16_t accel[3], const int16_t gyro[3], uint32_t dt_us,
+                       imu_fusion_output_t *out);
+
+/**
+ * @brief Fixed-point atan2
+ *
+ * Max error about 0.1 degree.
+ *
+ * @param y Y
+ * @param x X
+ * @return angle in millidegrees, -180000 .. 180000
+ */
+int32_t imu_fusion_atan2_mdeg(int32_t y, int32_t x);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif // __IMU_FUSION_H__
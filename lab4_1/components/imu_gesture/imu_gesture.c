@@ -0,0 +1,250 @@
+/**
+ * @file imu_gesture.c
+ *
+ * Tap detector and streaming DTW template matcher, see imu_gesture.h
+ */
+
+#include <string.h>
+#include "imu_gesture.h"
+
+#define INF UINT32_MAX
+
+typedef enum
+{
+    TAP_IDLE = 0,
+    TAP_SPIKE,  // jerk above threshold, waiting for it to settle
+    TAP_QUIET,  // settled, waiting for the quiet period
+    TAP_REJECT, // too long or repeated: motion, not a tap; wait for calm
+} tap_phase_t;
+
+static inline uint32_t l1_3(int32_t a, int32_t b, int32_t c)
+{
+    return (uint32_t)((a < 0 ? -a : a) + (b < 0 ? -b : b) + (c < 0 ? -c : c));
+}
+
+static inline uint32_t sat_add(uint32_t a, uint32_t b)
+{
+    return a > INF - b ? INF : a + b;
+}
+
+static void dtw_reset(imu_gesture_t *g, int k)
+{
+    for (int i = 0; i <= IMU_GESTURE_MAX_LEN; i++)
+    {
+        g->col[k].d[i] = i ? INF : 0;
+        g->col[k].s[i] = 0;
+    }
+    g->col[k].best = INF;
+    g->col[k].best_end = 0;
+}
+
+esp_err_t imu_gesture_init(imu_gesture_t *g, const imu_gesture_config_t *config)
+{
+    if (!g || !config || !config->tap_jerk)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(g, 0, sizeof(*g));
+    g->cfg = *config;
+    if (!g->cfg.decimate)
+        g->cfg.decimate = 1;
+    imu_gesture_reset(g);
+
+    return ESP_OK;
+}
+
+void imu_gesture_reset(imu_gesture_t *g)
+{
+    g->primed = false;
+    g->tap_phase = TAP_IDLE;
+    g->tap_count = 0;
+    g->since_tap = -1;
+    g->dec_count = 0;
+    memset(g->dec_sum, 0, sizeof(g->dec_sum));
+    for (int k = 0; k < g->n_templates; k++)
+        dtw_reset(g, k);
+}
+
+esp_err_t imu_gesture_add_template(imu_gesture_t *g, const imu_gesture_template_t *tpl)
+{
+    if (!g || !tpl || !tpl->len || tpl->len > IMU_GESTURE_MAX_LEN)
+        return ESP_ERR_INVALID_ARG;
+    if (g->n_templates >= IMU_GESTURE_MAX_TEMPLATES)
+        return ESP_ERR_NO_MEM;
+
+    g->tpl[g->n_templates] = *tpl;
+    dtw_reset(g, g->n_templates);
+    g->n_templates++;
+
+    return ESP_OK;
+}
+
+// Returns true when a tap was confirmed on this sample
+static bool tap_update(imu_gesture_t *g, const int16_t accel[3], const int16_t gyro[3])
+{
+    const imu_gesture_config_t *c = &g->cfg;
+
+    if (!g->primed)
+    {
+        memcpy(g->prev_accel, accel, sizeof(g->prev_accel));
+        g->primed = true;
+        return false;
+    }
+
+    uint32_t jerk = l1_3(accel[0] - g->prev_accel[0], accel[1] - g->prev_accel[1], accel[2] - g->prev_accel[2]);
+    memcpy(g->prev_accel, accel, sizeof(g->prev_accel));
+    bool calm = jerk <= c->tap_jerk / 2u;
+
+    switch (g->tap_phase)
+    {
+        case TAP_IDLE:
+            if (jerk > c->tap_jerk)
+            {
+                g->tap_count = 0;
+                g->tap_phase = l1_3(gyro[0], gyro[1], gyro[2]) <= c->tap_gyro_max ? TAP_SPIKE : TAP_REJECT;
+            }
+            break;
+        case TAP_SPIKE:
+            if (calm)
+            {
+                g->tap_count = 0;
+                g->tap_phase = TAP_QUIET;
+            }
+            else if (++g->tap_count > c->tap_max_len)
+                g->tap_phase = TAP_REJECT;
+            break;
+        case TAP_QUIET:
+            // ringing below the start threshold is fine, a second spike is a shake
+            if (jerk > c->tap_jerk)
+            {
+                g->tap_count = 0;
+                g->tap_phase = TAP_REJECT;
+            }
+            else if (++g->tap_count >= c->tap_quiet)
+            {
+                g->tap_phase = TAP_IDLE;
+                return true;
+            }
+            break;
+        default: // TAP_REJECT
+            g->tap_count = calm ? g->tap_count + 1 : 0;
+            if (g->tap_count >= c->tap_quiet)
+                g->tap_phase = TAP_IDLE;
+            break;
+    }
+
+    return false;
+}
+
+// One SPRING step for template k; returns true and fills *dist on a match
+static bool dtw_step(imu_gesture_t *g, int k, const int32_t x[3], uint32_t *dist)
+{
+    const imu_gesture_template_t *tpl = &g->tpl[k];
+    uint32_t *d = g->col[k].d, *s = g->col[k].s;
+    uint32_t t = g->t;
+    int m = tpl->len;
+
+    // column update in place: prev_* hold the previous column's cell i-1
+    uint32_t prev_d = 0, prev_s = t; // previous column, row 0 (always free to start)
+    d[0] = 0;
+    s[0] = t;
+    for (int i = 1; i <= m; i++)
+    {
+        uint32_t up_d = d[i - 1], up_s = s[i - 1]; // this column, i-1
+        uint32_t left_d = d[i], left_s = s[i];     // previous column, i
+        uint32_t best = up_d, best_s = up_s;
+        if (left_d < best)
+        {
+            best = left_d;
+            best_s = left_s;
+        }
+        if (prev_d < best)
+        {
+            best = prev_d;
+            best_s = prev_s;
+        }
+        prev_d = left_d;
+        prev_s = left_s;
+
+        d[i] = sat_add(best, l1_3(x[0] - tpl->seq[i - 1][0], x[1] - tpl->seq[i - 1][1], x[2] - tpl->seq[i - 1][2]));
+        s[i] = best_s;
+    }
+
+    bool found = false;
+    uint32_t *cand = &g->col[k].best;
+    if (*cand != INF)
+    {
+        // report once no path can still beat the candidate without overlapping it
+        bool final = true;
+        for (int i = 1; i <= m && final; i++)
+            if (d[i] < *cand && s[i] <= g->col[k].best_end)
+                final = false;
+        if (final)
+        {
+            *dist = *cand / m;
+            found = true;
+            for (int i = 1; i <= m; i++)
+                if (s[i] <= g->col[k].best_end)
+                    d[i] = INF;
+            *cand = INF;
+        }
+    }
+
+    uint32_t eps = tpl->threshold * (uint32_t)m;
+    if (d[m] <= eps && d[m] < *cand)
+    {
+        *cand = d[m];
+        g->col[k].best_end = t;
+    }
+
+    return found;
+}
+
+int imu_gesture_update(imu_gesture_t *g, const int16_t accel[3], const int16_t gyro[3],
+                       imu_gesture_event_t *events, int max_events)
+{
+    int n = 0;
+
+    if (tap_update(g, accel, gyro))
+    {
+        if (g->since_tap >= 0)
+        {
+            if (n < max_events)
+                events[n++] = (imu_gesture_event_t){ .type = IMU_GESTURE_DOUBLE_TAP };
+            g->since_tap = -1;
+        }
+        else
+            g->since_tap = 0;
+    }
+    else if (g->since_tap >= 0 && ++g->since_tap > g->cfg.double_tap_gap)
+    {
+        if (n < max_events)
+            events[n++] = (imu_gesture_event_t){ .type = IMU_GESTURE_TAP };
+        g->since_tap = -1;
+    }
+
+    if (!g->n_templates)
+        return n;
+
+    for (int i = 0; i < 3; i++)
+        g->dec_sum[i] += gyro[i];
+    if (++g->dec_count < g->cfg.decimate)
+        return n;
+
+    int32_t x[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = g->dec_sum[i] / g->cfg.decimate;
+        g->dec_sum[i] = 0;
+    }
+    g->dec_count = 0;
+    g->t++;
+
+    for (int k = 0; k < g->n_templates; k++)
+    {
+        uint32_t dist;
+        if (dtw_step(g, k, x, &dist) && n < max_events)
+            events[n++] = (imu_gesture_event_t){ .type = IMU_GESTURE_TEMPLATE, .id = g->tpl[k].id, .distance = dist };
+    }
+
+    return n;
+}
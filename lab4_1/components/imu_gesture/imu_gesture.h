@@ -0,0 +1,148 @@
+/**
+ * @file imu_gesture.h
+ * @defgroup imu_gesture imu_gesture
+ * @{
+ *
+ * Streaming gesture recognizer over raw accel + gyro samples
+ *
+ * - Tap / double tap: a short accelerometer jerk spike followed by a quiet
+ *   period, with the gyro nearly still (a tap shakes, it does not rotate).
+ *   A single tap is reported once the double-tap window has expired.
+ * - Template gestures (flicks, twists): gyro sequences matched against the
+ *   stream with subsequence DTW (SPRING), so a gesture is found wherever it
+ *   starts without segmenting the stream first.
+ *
+ * Work per sample is bounded: O(1) for taps and one DTW column per template,
+ * i.e. at most IMU_GESTURE_MAX_TEMPLATES * IMU_GESTURE_MAX_LEN cells.
+ *
+ * The ICM-42670-P APEX engine offers pedometer, tilt, freefall and
+ * wake-on-motion, but no tap detector, so taps are detected here from the
+ * FIFO stream.
+ */
+
+#ifndef __IMU_GESTURE_H__
+#define __IMU_GESTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMU_GESTURE_MAX_TEMPLATES 4
+#define IMU_GESTURE_MAX_LEN       32
+// Events one sample can produce: a tap or double tap, plus a match per template
+#define IMU_GESTURE_MAX_EVENTS    (1 + IMU_GESTURE_MAX_TEMPLATES)
+
+/* Event type */
+typedef enum
+{
+    IMU_GESTURE_NONE = 0,
+    IMU_GESTURE_TAP,
+    IMU_GESTURE_DOUBLE_TAP,
+    IMU_GESTURE_TEMPLATE, // `id` tells which template matched
+} imu_gesture_type_t;
+
+/* Recognized gesture */
+typedef struct
+{
+    imu_gesture_type_t type;
+    uint8_t id;        // template id for IMU_GESTURE_TEMPLATE
+    uint32_t distance; // DTW distance of the match, per template step
+} imu_gesture_event_t;
+
+/* Recognizer configuration, all durations in input samples */
+typedef struct
+{
+    uint16_t tap_jerk;        // accel L1 change between samples that starts a tap, LSB
+    uint16_t tap_gyro_max;    // gyro L1 above which a spike is not a tap, LSB
+    uint8_t tap_max_len;      // spike must settle within this many samples
+    uint8_t tap_quiet;        // quiet samples required after the spike
+    uint8_t double_tap_gap;   // max samples between two taps of a double tap
+    uint8_t decimate;         // gyro samples averaged per DTW step, 1 = none
+} imu_gesture_config_t;
+
+/* Gyro template */
+typedef struct
+{
+    uint8_t id;
+    uint8_t len;
+    uint32_t threshold;                       // max DTW distance per step
+    int16_t seq[IMU_GESTURE_MAX_LEN][3];      // gyro X, Y, Z, LSB
+} imu_gesture_template_t;
+
+/* Recognizer state */
+typedef struct
+{
+    imu_gesture_config_t cfg;
+
+    // tap
+    bool primed;
+    int16_t prev_accel[3];
+    uint8_t tap_phase;
+    uint8_t tap_count;
+    int16_t since_tap;        // samples since an unconfirmed single tap, -1 = none
+
+    // DTW
+    uint8_t n_templates;
+    uint8_t dec_count;
+    int32_t dec_sum[3];
+    uint32_t t;               // DTW step counter
+    imu_gesture_template_t tpl[IMU_GESTURE_MAX_TEMPLATES];
+    struct
+    {
+        uint32_t d[IMU_GESTURE_MAX_LEN + 1];
+        uint32_t s[IMU_GESTURE_MAX_LEN + 1];
+        uint32_t best;        // best candidate so far, UINT32_MAX = none
+        uint32_t best_end;
+    } col[IMU_GESTURE_MAX_TEMPLATES];
+} imu_gesture_t;
+
+/**
+ * @brief Initialize a recognizer without templates
+ *
+ * @param g Recognizer
+ * @param config Configuration
+ * @return `ESP_OK` on success
+ */
+esp_err_t imu_gesture_init(imu_gesture_t *g, const imu_gesture_config_t *config);
+
+/**
+ * @brief Forget partial gestures, e.g. after a pause in the stream
+ *
+ * @param g Recognizer
+ */
+void imu_gesture_reset(imu_gesture_t *g);
+
+/**
+ * @brief Add a gyro template
+ *
+ * @param g Recognizer
+ * @param tpl Template, copied; `len` in DTW steps (after decimation)
+ * @return `ESP_OK` on success, `ESP_ERR_NO_MEM` if all slots are used
+ */
+esp_err_t imu_gesture_add_template(imu_gesture_t *g, const imu_gesture_template_t *tpl);
+
+/**
+ * @brief Feed one raw sample
+ *
+ * @param g Recognizer
+ * @param accel raw accelerometer X, Y, Z
+ * @param gyro raw gyro X, Y, Z
+ * @param[out] events recognized gestures
+ * @param max_events size of `events`; IMU_GESTURE_MAX_EVENTS never drops an
+ *        event, smaller buffers drop the ones that do not fit
+ * @return number of events written
+ */
+int imu_gesture_update(imu_gesture_t *g, const int16_t accel[3], const int16_t gyro[3],
+                       imu_gesture_event_t *events, int max_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif // __IMU_GESTURE_H__
@@ -0,0 +1,97 @@
+/**
+ * @file lat_trace.c
+ *
+ * Input latency tracer, see lat_trace.h
+ */
+
+#include <string.h>
+#include "lat_trace.h"
+
+_Static_assert((LAT_TRACE_SLOTS & (LAT_TRACE_SLOTS - 1)) == 0, "LAT_TRACE_SLOTS must be a power of two");
+
+bool lat_trace_init(lat_trace_t *tr, const char *const *names, uint8_t n_points, uint32_t bucket_us)
+{
+    if (!tr || n_points < 2 || n_points > LAT_TRACE_MAX_POINTS || !bucket_us)
+        return false;
+
+    memset(tr, 0, sizeof(*tr));
+    tr->names = names;
+    tr->n_points = n_points;
+    tr->bucket_us = bucket_us;
+
+    return true;
+}
+
+void lat_trace_reset(lat_trace_t *tr)
+{
+    memset(tr->hist, 0, sizeof(tr->hist));
+    memset(tr->max_us, 0, sizeof(tr->max_us));
+}
+
+uint32_t lat_trace_begin(lat_trace_t *tr, int64_t t_us)
+{
+    uint32_t id = ++tr->next_id;
+    if (!id)
+        id = ++tr->next_id;
+
+    lat_trace_slot_t *s = &tr->slot[id & (LAT_TRACE_SLOTS - 1)];
+    s->id = 0; // invalidate while the start time changes
+    s->start_us = t_us;
+    s->id = id;
+
+    return id;
+}
+
+void lat_trace_mark(lat_trace_t *tr, uint32_t id, uint8_t point, int64_t t_us)
+{
+    if (!id || !point || point >= tr->n_points)
+        return;
+
+    const lat_trace_slot_t *s = &tr->slot[id & (LAT_TRACE_SLOTS - 1)];
+    int64_t start_us = s->start_us;
+    if (s->id != id || t_us < start_us)
+        return;
+
+    int64_t d = t_us - start_us;
+    uint32_t us = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    uint32_t b = us / tr->bucket_us;
+
+    tr->hist[point][b < LAT_TRACE_BUCKETS ? b : LAT_TRACE_BUCKETS - 1]++;
+    if (us > tr->max_us[point])
+        tr->max_us[point] = us;
+}
+
+static uint32_t percentile(const lat_trace_t *tr, uint8_t point, uint32_t count, uint32_t pct)
+{
+    // smallest bucket whose cumulative count reaches pct % of the samples
+    uint64_t need = ((uint64_t)count * pct + 99) / 100;
+    uint64_t sum = 0;
+
+    for (int b = 0; b < LAT_TRACE_BUCKETS - 1; b++)
+    {
+        sum += tr->hist[point][b];
+        if (sum >= need)
+        {
+            uint32_t edge = (b + 1) * tr->bucket_us;
+            return edge < tr->max_us[point] ? edge : tr->max_us[point];
+        }
+    }
+
+    return tr->max_us[point];
+}
+
+void lat_trace_stats(const lat_trace_t *tr, uint8_t point, lat_trace_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (point >= tr->n_points)
+        return;
+
+    for (int b = 0; b < LAT_TRACE_BUCKETS; b++)
+        stats->count += tr->hist[point][b];
+    if (!stats->count)
+        return;
+
+    stats->p50_us = percentile(tr, point, stats->count, 50);
+    stats->p99_us = percentile(tr, point, stats->count, 99);
+    stats->max_us = tr->max_us[point];
+}
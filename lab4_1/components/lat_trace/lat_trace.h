@@ -0,0 +1,125 @@
+/**
+ * @file lat_trace.h
+ * @defgroup lat_trace lat_trace
+ * @{
+ *
+ * Input latency tracer
+ *
+ * A trace follows one piece of input through the pipeline: it starts at the
+ * first trace point (e.g. sensor data ready) and every later point records
+ * its distance from that start into a per-point histogram, so each point
+ * reads as "latency from data ready to here".
+ *
+ * Traces in flight live in a fixed ring of LAT_TRACE_SLOTS records indexed
+ * by trace id; a record that is overwritten before its trace finishes just
+ * stops contributing. Nothing allocates and a mark is O(1), so marks can sit
+ * in hot paths.
+ *
+ * Concurrency: each trace point must be marked from one context only (its
+ * histogram has a single writer). Different points may be marked from
+ * different tasks. Summaries read the histograms without locking and may be
+ * off by the samples recorded meanwhile.
+ *
+ * Timestamps are supplied by the caller in microseconds, so the component
+ * has no platform dependencies and builds for the host as well.
+ */
+
+#ifndef __LAT_TRACE_H__
+#define __LAT_TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAT_TRACE_MAX_POINTS  8
+#define LAT_TRACE_SLOTS       64   // traces in flight, power of two
+#define LAT_TRACE_BUCKETS     64   // histogram buckets, the last one is open ended
+
+/* Record of one trace in flight */
+typedef struct
+{
+    volatile uint32_t id;   // 0 = free
+    int64_t start_us;
+} lat_trace_slot_t;
+
+/* Latency summary of one trace point */
+typedef struct
+{
+    uint32_t count;
+    uint32_t p50_us;        // upper edge of the bucket holding the percentile
+    uint32_t p99_us;
+    uint32_t max_us;
+} lat_trace_stats_t;
+
+/* Tracer */
+typedef struct
+{
+    uint8_t n_points;
+    uint32_t bucket_us;
+    const char *const *names;
+    uint32_t next_id;
+    lat_trace_slot_t slot[LAT_TRACE_SLOTS];
+    uint32_t hist[LAT_TRACE_MAX_POINTS][LAT_TRACE_BUCKETS];
+    uint32_t max_us[LAT_TRACE_MAX_POINTS];
+} lat_trace_t;
+
+/**
+ * @brief Initialize a tracer
+ *
+ * @param tr Tracer
+ * @param names Point names, point 0 starts the trace; kept by reference
+ * @param n_points Number of points, at most LAT_TRACE_MAX_POINTS
+ * @param bucket_us Histogram resolution; the range is LAT_TRACE_BUCKETS times this
+ * @return false on invalid arguments
+ */
+bool lat_trace_init(lat_trace_t *tr, const char *const *names, uint8_t n_points, uint32_t bucket_us);
+
+/**
+ * @brief Clear all histograms, traces in flight are kept
+ *
+ * @param tr Tracer
+ */
+void lat_trace_reset(lat_trace_t *tr);
+
+/**
+ * @brief Start a trace at point 0
+ *
+ * Only one context may start traces.
+ *
+ * @param tr Tracer
+ * @param t_us Time of point 0
+ * @return Trace id, never 0
+ */
+uint32_t lat_trace_begin(lat_trace_t *tr, int64_t t_us);
+
+/**
+ * @brief Record a later point of a trace
+ *
+ * Ignored for id 0, unknown or recycled traces and times before the start.
+ *
+ * @param tr Tracer
+ * @param id Trace id from lat_trace_begin()
+ * @param point Point index, 1 .. n_points - 1
+ * @param t_us Time of the point
+ */
+void lat_trace_mark(lat_trace_t *tr, uint32_t id, uint8_t point, int64_t t_us);
+
+/**
+ * @brief Summarise one point
+ *
+ * @param tr Tracer
+ * @param point Point index
+ * @param[out] stats Count, p50, p99 and max latency from point 0
+ */
+void lat_trace_stats(const lat_trace_t *tr, uint8_t point, lat_trace_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif // __LAT_TRACE_H__
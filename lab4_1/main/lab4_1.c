@@ -11,9 +11,12 @@
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_check.h"      // <-- provides ESP_RETURN_ON_ERROR
+#include "nvs_flash.h"
 
 #include "i2cdev.h"         // from esp-idf-lib (manages I2C driver)
 #include "icm42670.h"       // from esp-idf-lib
+#include "imu_filter.h"     // streaming filters, components/imu_filter
+#include "imu_calib.h"      // bias/scale calibration, components/imu_calib
 
 #define TAG           "lab4_1"
 
@@ -26,18 +29,23 @@
 #define ADDR_GND      ICM42670_I2C_ADDR_GND   // 0x68
 #define ADDR_VCC      ICM42670_I2C_ADDR_VCC   // 0x69
 
-// Simple 8-sample moving average for display steadiness
-typedef struct { float bx[8], by[8], bz[8]; int idx, n; } sma8_t;
-static void sma8_init(sma8_t *f){ memset(f,0,sizeof(*f)); }
-static void sma8_push(sma8_t *f, float x, float y, float z){
-    f->bx[f->idx]=x; f->by[f->idx]=y; f->bz[f->idx]=z;
-    f->idx=(f->idx+1)&7; if(f->n<8) f->n++;
-}
-static void sma8_get(const sma8_t *f, float *x, float *y, float *z){
-    int n=f->n?f->n:1; float sx=0,sy=0,sz=0;
-    for(int i=0;i<n;i++){ sx+=f->bx[i]; sy+=f->by[i]; sz+=f->bz[i]; }
-    *x=sx/n; *y=sy/n; *z=sz/n;
-}
+// Calibration, shared with lab4_3 through NVS (same +-4 g / +-1000 dps ranges).
+// Set CALIB_SIX_POSITION to 1 to (re)measure accel offset/scale at boot:
+// rest the board on each of its six faces for ~1 s.
+// The gyro bias is always measured: once at boot if the board is still
+// within CALIB_BOOT_TIMEOUT_MS, then again whenever it rests for a window.
+#define CALIB_NVS_NS          "imu_calib"
+#define CALIB_SIX_POSITION    0
+#define CALIB_STILL_SAMPLES   50    // 1 s at the 50 Hz loop rate
+#define CALIB_STILL_P2P       100   // ~12 mg at 8192 LSB/g
+#define CALIB_GYRO_P2P        40    // ~1.2 dps at 32.8 LSB/dps
+#define CALIB_BOOT_TIMEOUT_MS 3000
+#define GYRO_BIAS_SAVE_LSB    8     // ~0.25 dps
+#define GYRO_LSB_PER_DPS      32.8f // +-1000 dps
+
+// 3-axis, 8-sample moving average over calibrated g (imu_filter), smooths
+// the tilt readout: spans 160 ms at the 50 Hz loop rate, ~70 ms of lag
+IMU_SMA_DEFINE(accel_sma, float, float, 3, 8)
 
 static inline float lsb_per_g(icm42670_accel_fsr_t r){
     switch(r){
@@ -58,6 +66,79 @@ static esp_err_t imu_try_init(icm42670_t *imu, uint8_t addr){
     return ESP_OK;
 }
 
+// Accel for the tilt readout, gyro for the rate readout and its bias
+static esp_err_t imu_configure(icm42670_t *imu, icm42670_accel_fsr_t range){
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_fsr(imu, range), TAG, "accel fsr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_avg(imu, ICM42670_ACCEL_AVG_8X), TAG, "accel avg");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_odr(imu, ICM42670_ACCEL_ODR_200HZ), TAG, "accel odr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_fsr(imu, ICM42670_GYRO_RANGE_1000DPS), TAG, "gyro fsr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_odr(imu, ICM42670_GYRO_ODR_200HZ), TAG, "gyro odr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_pwr_mode(imu, ICM42670_ACCEL_ENABLE_LN_MODE), TAG, "accel pwr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_pwr_mode(imu, ICM42670_GYRO_ENABLE_LN_MODE), TAG, "gyro pwr");
+    return ESP_OK;
+}
+
+// Still window -> fresh gyro bias, persisted only when it moved noticeably
+static void recheck_gyro_bias(imu_calib_t *cal, const imu_still_t *still){
+    if (imu_calib_update_gyro_bias(cal, still, GYRO_BIAS_SAVE_LSB)){
+        ESP_LOGI(TAG, "Gyro bias %d %d %d LSB", cal->gyro_bias[0], cal->gyro_bias[1], cal->gyro_bias[2]);
+        if (imu_calib_save(cal, CALIB_NVS_NS) != ESP_OK)
+            ESP_LOGW(TAG, "Failed to save calibration");
+    }
+}
+
+// Boot-time gyro bias: wait up to CALIB_BOOT_TIMEOUT_MS for one still window,
+// otherwise keep the stored bias and let the recheck in the loop catch up
+static void calibrate_gyro_boot(icm42670_t *imu, imu_calib_t *cal, imu_still_t *still){
+    for (int t = 0; t < CALIB_BOOT_TIMEOUT_MS; t += 20){
+        icm42670_raw_data_t raw;
+        if (icm42670_read_accel_gyro(imu, &raw) == ESP_OK){
+            const int16_t a[3] = { raw.accel.x, raw.accel.y, raw.accel.z };
+            const int16_t g[3] = { raw.gyro.x, raw.gyro.y, raw.gyro.z };
+            if (imu_calib_still_feed(still, a, g)){
+                recheck_gyro_bias(cal, still);
+                return;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    ESP_LOGW(TAG, "Not still at boot, using stored gyro bias");
+}
+
+#if CALIB_SIX_POSITION
+static void calibrate_six_position(icm42670_t *imu, imu_calib_t *cal, uint16_t lsb){
+    static const char *faces[6] = { "+X up", "-X up", "+Y up", "-Y up", "+Z up", "-Z up" };
+    imu_still_t still; imu_calib_still_init(&still, CALIB_STILL_SAMPLES, 0, CALIB_STILL_P2P);
+    imu_six_pos_t six; imu_calib_six_pos_init(&six, lsb);
+
+    ESP_LOGI(TAG, "Six-position calibration: rest the board on each face for 1 s");
+    while (six.done != 0x3f){
+        icm42670_raw_xyz_t raw;
+        if (icm42670_read_accel_xyz(imu, &raw) == ESP_OK){
+            const int16_t a[3] = { raw.x, raw.y, raw.z };
+            if (imu_calib_still_feed(&still, a, NULL)){
+                uint8_t before = six.done;
+                int face = imu_calib_six_pos_add(&six, still.accel_mean);
+                if (face >= 0 && !(before & (1 << face)))
+                    ESP_LOGI(TAG, "Recorded %s (%d/6)", faces[face], __builtin_popcount(six.done));
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+
+    esp_err_t e = imu_calib_six_pos_solve(&six, cal);
+    if (e != ESP_OK){
+        ESP_LOGE(TAG, "Calibration rejected (%s)", esp_err_to_name(e));
+        return;
+    }
+    ESP_LOGI(TAG, "Accel bias %d %d %d LSB, scale %u %u %u (Q14)",
+             cal->accel_bias[0], cal->accel_bias[1], cal->accel_bias[2],
+             cal->accel_scale[0], cal->accel_scale[1], cal->accel_scale[2]);
+    if (imu_calib_save(cal, CALIB_NVS_NS) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to save calibration");
+}
+#endif
+
 static void task_lab4_1(void *arg){
     ESP_LOGI(TAG, "Start (I2C sda=%d scl=%d)", I2C_SDA_GPIO, I2C_SCL_GPIO);
 
@@ -80,24 +161,28 @@ static void task_lab4_1(void *arg){
     }
     ESP_LOGI(TAG, "ICM-42670 detected @0x%02X", addr);
 
-    // Configure accel (modest settings for stability)
+    // Configure accel and gyro (modest settings for stability)
     const icm42670_accel_fsr_t RANGE = ICM42670_ACCEL_RANGE_4G;
-    ESP_ERROR_CHECK(icm42670_set_accel_fsr(&imu, RANGE));
-    ESP_ERROR_CHECK(icm42670_set_accel_avg(&imu, ICM42670_ACCEL_AVG_8X));
-    ESP_ERROR_CHECK(icm42670_set_accel_odr(&imu, ICM42670_ACCEL_ODR_200HZ));
-    ESP_ERROR_CHECK(icm42670_set_accel_pwr_mode(&imu, ICM42670_ACCEL_ENABLE_LN_MODE));
+    ESP_ERROR_CHECK(imu_configure(&imu, RANGE));
+
+    imu_calib_t cal; imu_calib_init(&cal);
+    if (imu_calib_load(&cal, CALIB_NVS_NS) == ESP_OK)
+        ESP_LOGI(TAG, "Loaded calibration (flags 0x%x)", cal.flags);
+#if CALIB_SIX_POSITION
+    calibrate_six_position(&imu, &cal, (uint16_t)lsb_per_g(RANGE));
+#endif
+    imu_still_t still; imu_calib_still_init(&still, CALIB_STILL_SAMPLES, CALIB_GYRO_P2P, CALIB_STILL_P2P);
+    calibrate_gyro_boot(&imu, &cal, &still);
 
     const float inv_lsb_g = 1.0f / lsb_per_g(RANGE);
-    sma8_t filt; sma8_init(&filt);
+    accel_sma_t filt; accel_sma_init(&filt);
 
     int consecutive_fail = 0;
 
     while (1){
-        int16_t rx=0, ry=0, rz=0;
-        esp_err_t e = ESP_OK;
-        e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_X1, &rx);
-        if (e == ESP_OK) e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_Y1, &ry);
-        if (e == ESP_OK) e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_Z1, &rz);
+        // One burst for all six axes: same sample, one I2C transaction
+        icm42670_raw_data_t raw;
+        esp_err_t e = icm42670_read_accel_gyro(&imu, &raw);
 
         if (e != ESP_OK){
             if (++consecutive_fail >= 5){
@@ -107,11 +192,8 @@ static void task_lab4_1(void *arg){
                     uint8_t other = (addr==ADDR_GND)?ADDR_VCC:ADDR_GND;
                     if (imu_try_init(&imu, other) == ESP_OK) addr = other;
                 }
-                // Reapply accel config
-                icm42670_set_accel_fsr(&imu, RANGE);
-                icm42670_set_accel_avg(&imu, ICM42670_ACCEL_AVG_8X);
-                icm42670_set_accel_odr(&imu, ICM42670_ACCEL_ODR_200HZ);
-                icm42670_set_accel_pwr_mode(&imu, ICM42670_ACCEL_ENABLE_LN_MODE);
+                // Reapply accel and gyro config
+                imu_configure(&imu, RANGE);
                 consecutive_fail = 0;
             }
             vTaskDelay(pdMS_TO_TICKS(20));
@@ -120,12 +202,18 @@ static void task_lab4_1(void *arg){
 
         consecutive_fail = 0;
 
-        float gx = rx * inv_lsb_g;
-        float gy = ry * inv_lsb_g;
-        float gz = rz * inv_lsb_g;
+        // Bias is rechecked on raw samples whenever the board rests
+        int16_t a[3] = { raw.accel.x, raw.accel.y, raw.accel.z };
+        int16_t r[3] = { raw.gyro.x, raw.gyro.y, raw.gyro.z };
+        if (imu_calib_still_feed(&still, a, r))
+            recheck_gyro_bias(&cal, &still);
 
-        sma8_push(&filt, gx, gy, gz);
-        float fx, fy, fz; sma8_get(&filt, &fx, &fy, &fz);
+        // Offset/scale correction in raw LSB, then to g and dps
+        imu_calib_apply(&cal, a, r);
+        float g[3] = { a[0] * inv_lsb_g, a[1] * inv_lsb_g, a[2] * inv_lsb_g };
+
+        float f[3]; accel_sma_update(&filt, g, f);
+        float fx = f[0], fy = f[1], fz = f[2];
 
         // Super simple quadrant announcement
         const float th = 0.08f;  // deadband ~0.08 g
@@ -137,12 +225,20 @@ static void task_lab4_1(void *arg){
             if (*vert)  strcpy(msg, vert);
             if (*horiz) { if (*vert) strcat(msg, " "); strcat(msg, horiz); }
         }
-        ESP_LOGI(TAG, "%s (gx=%.3f gy=%.3f gz=%.3f) @0x%02X", msg, fx, fy, fz, addr);
+        ESP_LOGI(TAG, "%s (gx=%.3f gy=%.3f gz=%.3f, rate %.1f %.1f %.1f dps) @0x%02X", msg, fx, fy, fz,
+                 r[0] / GYRO_LSB_PER_DPS, r[1] / GYRO_LSB_PER_DPS, r[2] / GYRO_LSB_PER_DPS, addr);
 
         vTaskDelay(pdMS_TO_TICKS(20)); // ~50Hz print
     }
 }
 
 void app_main(void){
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND){
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
     xTaskCreatePinnedToCore(task_lab4_1, "lab4_1", 4096, NULL, 5, NULL, 0);
 }
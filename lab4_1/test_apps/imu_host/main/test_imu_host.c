@@ -0,0 +1,386 @@
+// Host tests for the forked icm42670 driver on the simulated i2cdev bus, and
+// the components fed from it.
+// Build for the Linux target, see README.md.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "i2cdev.h"
+#include "i2cdev_sim.h"
+#include "icm42670.h"
+#include "imu_filter.h"
+#include "lat_trace.h"
+
+#define IMU_PORT I2C_NUM_0
+#define IMU_ADDR ICM42670_I2C_ADDR_GND
+
+#define WHO_AM_I_VALUE 0x67
+#define MCLK_RDY_BIT   0x08
+
+// FIFO packet 3 header: accel + gyro + ODR timestamp
+#define FIFO_HEADER_ACCEL_GYRO 0x68
+#define FIFO_EMPTY_BYTE        0x80
+#define FIFO_PACKET_SIZE       16
+
+static icm42670_t dev;
+static i2cdev_sim_dev_t *sim;
+
+// Byte FIFO behind FIFO_COUNTH/COUNTL/FIFO_DATA
+typedef struct {
+    uint8_t data[ICM42670_FIFO_SIZE];
+    size_t head, tail;
+    uint16_t count_latch;
+} sim_fifo_t;
+
+static sim_fifo_t fifo;
+
+static esp_err_t fifo_read_hook(i2cdev_sim_dev_t *s, uint8_t reg, uint8_t *value, void *ctx)
+{
+    sim_fifo_t *f = ctx;
+
+    switch (reg) {
+    case ICM42670_REG_FIFO_COUNTH:
+        // The count is latched when the high byte is read, as on the chip
+        f->count_latch = (uint16_t)(f->tail - f->head);
+        *value = f->count_latch >> 8;
+        return ESP_OK;
+    case ICM42670_REG_FIFO_COUNTL:
+        *value = f->count_latch & 0xFF;
+        return ESP_OK;
+    case ICM42670_REG_FIFO_DATA:
+        *value = f->head < f->tail ? f->data[f->head++] : FIFO_EMPTY_BYTE;
+        return ESP_OK;
+    default:
+        return ESP_ERR_NOT_FOUND;
+    }
+}
+
+static void put_be16(uint8_t *p, int16_t v)
+{
+    p[0] = (uint16_t)v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void fifo_push_packet(const icm42670_raw_xyz_t *accel, const icm42670_raw_xyz_t *gyro, uint16_t tmst)
+{
+    uint8_t *p = &fifo.data[fifo.tail];
+
+    p[0] = FIFO_HEADER_ACCEL_GYRO;
+    put_be16(p + 1, accel->x);
+    put_be16(p + 3, accel->y);
+    put_be16(p + 5, accel->z);
+    put_be16(p + 7, gyro->x);
+    put_be16(p + 9, gyro->y);
+    put_be16(p + 11, gyro->z);
+    p[13] = 10; // temp
+    put_be16(p + 14, (int16_t)tmst);
+    fifo.tail += FIFO_PACKET_SIZE;
+}
+
+// FIFO_DATA served from `fifo` instead of the register file
+static void fifo_start(uint16_t watermark)
+{
+    memset(&fifo, 0, sizeof(fifo));
+    i2cdev_sim_set_reg_flags(sim, ICM42670_REG_FIFO_DATA, I2CDEV_SIM_REG_NO_INC);
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_set_hooks(sim, fifo_read_hook, NULL, &fifo));
+
+    icm42670_fifo_config_t config = {
+        .mode = ICM42670_FIFO_MODE_STREAM,
+        .packet = ICM42670_FIFO_PACKET_ACCEL_GYRO,
+        .watermark = watermark,
+        .timestamp_resolution = ICM42670_TMST_RES_1US,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_config_fifo(&dev, config));
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_enable_fifo(&dev, true));
+}
+
+static void set_accel_regs(int16_t x, int16_t y, int16_t z)
+{
+    uint8_t regs[6];
+
+    put_be16(regs, x);
+    put_be16(regs + 2, y);
+    put_be16(regs + 4, z);
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_set_regs(sim, ICM42670_REG_ACCEL_DATA_X1, regs, sizeof(regs)));
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_init(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_add_device(IMU_PORT, IMU_ADDR, &sim));
+    i2cdev_sim_set_reg(sim, ICM42670_REG_WHO_AM_I, WHO_AM_I_VALUE);
+    i2cdev_sim_set_reg(sim, ICM42670_REG_MCLK_RDY, MCLK_RDY_BIT);
+    i2cdev_sim_set_reg_flags(sim, ICM42670_REG_WHO_AM_I, I2CDEV_SIM_REG_READ_ONLY);
+    i2cdev_sim_set_reg_flags(sim, ICM42670_REG_MCLK_RDY, I2CDEV_SIM_REG_READ_ONLY);
+
+    memset(&dev, 0, sizeof(dev));
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init_desc(&dev, IMU_ADDR, IMU_PORT, 0, 0));
+}
+
+void tearDown(void)
+{
+    icm42670_free_desc(&dev);
+}
+
+static void test_init_detects_chip(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+}
+
+static void test_init_rejects_wrong_who_am_i(void)
+{
+    i2cdev_sim_set_reg(sim, ICM42670_REG_WHO_AM_I, 0x00);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, icm42670_init(&dev));
+}
+
+static void test_missing_device_not_found(void)
+{
+    i2cdev_sim_remove_device(sim);
+
+    uint8_t reg;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, i2c_dev_probe(&dev.i2c_dev, I2C_DEV_WRITE));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, i2c_dev_read_reg(&dev.i2c_dev, ICM42670_REG_WHO_AM_I, &reg, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, i2c_dev_write_reg(&dev.i2c_dev, ICM42670_REG_PWR_MGMT0, &reg, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, icm42670_init(&dev));
+}
+
+static void test_accel_burst_read(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    set_accel_regs(1000, -2000, 16384);
+    i2cdev_sim_reset_stats();
+
+    icm42670_raw_xyz_t accel;
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(1000, accel.x);
+    TEST_ASSERT_EQUAL_INT16(-2000, accel.y);
+    TEST_ASSERT_EQUAL_INT16(16384, accel.z);
+
+    // All three axes come from one transaction
+    i2cdev_sim_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_get_stats(IMU_PORT, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.transactions);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.bytes_read);
+}
+
+static void test_script_advances_per_read(void)
+{
+    static const uint8_t frames[3][6] = {
+        { 0x00, 0x01, 0x00, 0x02, 0x00, 0x03 },
+        { 0x00, 0x04, 0x00, 0x05, 0x00, 0x06 },
+        { 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFD },
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_load_script(sim, ICM42670_REG_ACCEL_DATA_X1, frames, sizeof(frames[0]),
+                                                     3, 0, false));
+
+    icm42670_raw_xyz_t accel;
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(1, accel.x);
+    TEST_ASSERT_EQUAL_INT16(3, accel.z);
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(4, accel.x);
+    TEST_ASSERT_EQUAL_INT16(6, accel.z);
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(-1, accel.x);
+    TEST_ASSERT_EQUAL_INT16(-3, accel.z);
+    // Without loop the last frame is held
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(-1, accel.x);
+}
+
+static void test_nack_fails_then_recovers(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    set_accel_regs(1, 2, 3);
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_inject_fault(sim, I2CDEV_SIM_FAULT_NACK, 1, 2));
+
+    icm42670_raw_xyz_t accel;
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL(ESP_FAIL, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL(ESP_FAIL, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+    TEST_ASSERT_EQUAL_INT16(2, accel.y);
+
+    i2cdev_sim_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_get_stats(IMU_PORT, &stats));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.faults);
+}
+
+static void test_timeout_fails_init(void)
+{
+    // WHO_AM_I goes through, the FIFO flush that follows hangs the bus
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_inject_fault(sim, I2CDEV_SIM_FAULT_TIMEOUT, 1, 1));
+    uint64_t before = i2cdev_sim_now_us();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, icm42670_init(&dev));
+    // The hung transfer is charged the full timeout of bus time
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT64((uint64_t)CONFIG_I2CDEV_TIMEOUT * 1000, i2cdev_sim_now_us() - before);
+
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+}
+
+static void test_fifo_timestamps_unwrap(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    fifo_start(4);
+
+    // 10 ms spacing across the 16-bit timestamp wrap
+    const uint16_t step = 10000;
+    uint16_t tmst = 0xFFFF - 2 * step;
+    for (int i = 0; i < 6; i++) {
+        icm42670_raw_xyz_t accel = { i, -i, 16384 };
+        icm42670_raw_xyz_t gyro = { 10 * i, 0, -10 * i };
+        fifo_push_packet(&accel, &gyro, tmst);
+        tmst += step;
+    }
+
+    icm42670_fifo_sample_t samples[8];
+    size_t count;
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_fifo(&dev, samples, 8, &count));
+    TEST_ASSERT_EQUAL(6, count);
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(samples[i].accel_valid);
+        TEST_ASSERT_TRUE(samples[i].gyro_valid);
+        TEST_ASSERT_TRUE(samples[i].timestamp_valid);
+        TEST_ASSERT_EQUAL_INT16(i, samples[i].accel.x);
+        TEST_ASSERT_EQUAL_INT16(-10 * (int)i, samples[i].gyro.z);
+        if (i > 0)
+            TEST_ASSERT_EQUAL_UINT64(step, samples[i].time_us - samples[i - 1].time_us);
+    }
+
+    // The FIFO is drained, a second read returns nothing
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_fifo(&dev, samples, 8, &count));
+    TEST_ASSERT_EQUAL(0, count);
+}
+
+static void test_fifo_needs_mclk(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    i2cdev_sim_set_reg(sim, ICM42670_REG_MCLK_RDY, 0);
+
+    icm42670_fifo_config_t config = {
+        .mode = ICM42670_FIFO_MODE_STREAM,
+        .packet = ICM42670_FIFO_PACKET_ACCEL,
+        .watermark = 1,
+        .timestamp_resolution = ICM42670_TMST_RES_1US,
+    };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, icm42670_config_fifo(&dev, config));
+
+    icm42670_fifo_sample_t sample;
+    size_t count;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, icm42670_read_fifo(&dev, &sample, 1, &count));
+}
+
+IMU_SMA_DEFINE(test_sma, float, float, 3, 4)
+
+static void test_sma_over_driver_samples(void)
+{
+    static const uint8_t frames[4][6] = {
+        { 0x00, 100, 0x00, 0, 0x40, 0x00 },
+        { 0x00, 200, 0x00, 0, 0x40, 0x00 },
+        { 0x01, 44, 0x00, 0, 0x40, 0x00 }, // 300
+        { 0x01, 144, 0x00, 0, 0x40, 0x00 }, // 400
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_sim_load_script(sim, ICM42670_REG_ACCEL_DATA_X1, frames, sizeof(frames[0]),
+                                                     4, 0, false));
+
+    test_sma_t sma;
+    test_sma_init(&sma);
+    float out[3] = { 0 };
+    for (int i = 0; i < 4; i++) {
+        icm42670_raw_xyz_t accel;
+        TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_accel_xyz(&dev, &accel));
+        float in[3] = { accel.x, accel.y, accel.z };
+        test_sma_update(&sma, in, out);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(250.0f, out[0]);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, out[1]);
+    TEST_ASSERT_EQUAL_FLOAT(16384.0f, out[2]);
+}
+
+enum { LAT_READY, LAT_READ, LAT_CONFIRM, LAT_POINTS };
+
+static void test_lat_trace_over_fifo_batches(void)
+{
+    static const char *const names[LAT_POINTS] = { "data ready", "sample read", "confirm" };
+    static lat_trace_t lat;
+    const int batches = 100, per_batch = 4;
+    const uint32_t sample_us = 5000, bucket_us = 250;
+
+    TEST_ASSERT_EQUAL(ESP_OK, icm42670_init(&dev));
+    fifo_start(per_batch);
+    TEST_ASSERT_TRUE(lat_trace_init(&lat, names, LAT_POINTS, bucket_us));
+
+    // The way lab4_3 uses it: a trace per batch starts at the watermark, the
+    // read is marked once the FIFO is drained, the confirm comes later. Time
+    // is the simulated bus clock, so the read point sees the modelled I2C cost
+    uint16_t tmst = 0;
+    uint64_t read_us = 0;
+    for (int b = 0; b < batches; b++) {
+        fifo.head = fifo.tail = 0; // drained by the previous read
+        for (int i = 0; i < per_batch; i++) {
+            icm42670_raw_xyz_t accel = { b, i, 16384 };
+            icm42670_raw_xyz_t gyro = { 0, 0, 0 };
+            fifo_push_packet(&accel, &gyro, tmst);
+            tmst += sample_us;
+            i2cdev_sim_advance_us(sample_us);
+        }
+
+        uint64_t ready_us = i2cdev_sim_now_us();
+        uint32_t id = lat_trace_begin(&lat, ready_us);
+        TEST_ASSERT_TRUE(id != 0);
+
+        icm42670_fifo_sample_t samples[8];
+        size_t count;
+        TEST_ASSERT_EQUAL(ESP_OK, icm42670_read_fifo(&dev, samples, 8, &count));
+        TEST_ASSERT_EQUAL(per_batch, count);
+        lat_trace_mark(&lat, id, LAT_READ, i2cdev_sim_now_us());
+        read_us = i2cdev_sim_now_us() - ready_us;
+
+        // Confirmed 2 ms after data ready, 7 ms for two batches in a hundred
+        lat_trace_mark(&lat, id, LAT_CONFIRM, ready_us + (b % 50 == 49 ? 7000 : 2000));
+    }
+
+    // Every FIFO read costs the same bus time: all percentiles are that time
+    lat_trace_stats_t st;
+    lat_trace_stats(&lat, LAT_READ, &st);
+    TEST_ASSERT_EQUAL_UINT32(batches, st.count);
+    TEST_ASSERT_TRUE(read_us > 0);
+    TEST_ASSERT_EQUAL_UINT32(read_us, st.p50_us);
+    TEST_ASSERT_EQUAL_UINT32(read_us, st.p99_us);
+    TEST_ASSERT_EQUAL_UINT32(read_us, st.max_us);
+
+    // p50 is the upper edge of the 2000 us bucket, p99 lands on the slow pair
+    lat_trace_stats(&lat, LAT_CONFIRM, &st);
+    TEST_ASSERT_EQUAL_UINT32(batches, st.count);
+    TEST_ASSERT_EQUAL_UINT32(2000 + bucket_us, st.p50_us);
+    TEST_ASSERT_EQUAL_UINT32(7000, st.p99_us);
+    TEST_ASSERT_EQUAL_UINT32(7000, st.max_us);
+
+    // A trace that was never started records nothing
+    lat_trace_mark(&lat, 0, LAT_CONFIRM, i2cdev_sim_now_us());
+    lat_trace_stats(&lat, LAT_CONFIRM, &st);
+    TEST_ASSERT_EQUAL_UINT32(batches, st.count);
+}
+
+void app_main(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, i2cdev_init());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_init_detects_chip);
+    RUN_TEST(test_init_rejects_wrong_who_am_i);
+    RUN_TEST(test_missing_device_not_found);
+    RUN_TEST(test_accel_burst_read);
+    RUN_TEST(test_script_advances_per_read);
+    RUN_TEST(test_nack_fails_then_recovers);
+    RUN_TEST(test_timeout_fails_init);
+    RUN_TEST(test_fifo_timestamps_unwrap);
+    RUN_TEST(test_fifo_needs_mclk);
+    RUN_TEST(test_sma_over_driver_samples);
+    RUN_TEST(test_lat_trace_over_fifo_batches);
+    exit(UNITY_END());
+}
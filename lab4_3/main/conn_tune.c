@@ -0,0 +1,133 @@
+// BLE connection parameter tuning, see conn_tune.h
+
+#include <string.h>
+#include "esp_log.h"
+#include "conn_tune.h"
+
+static const char *TAG = "CONN_TUNE";
+
+#define RATE_WINDOW_US  1000000
+
+void conn_tune_init(conn_tune_t *t, const conn_tune_params_t *active, const conn_tune_params_t *idle,
+                    uint32_t interval_us, uint32_t retry_us)
+{
+    memset(t, 0, sizeof(*t));
+    t->active = *active;
+    t->idle = *idle;
+    t->retry_us = retry_us;
+    t->default_interval_us = interval_us;
+    atomic_init(&t->interval_us, interval_us);
+    atomic_init(&t->requested, -1);
+}
+
+void conn_tune_connected(conn_tune_t *t, const esp_bd_addr_t peer)
+{
+    memcpy(t->peer, peer, sizeof(esp_bd_addr_t));
+    atomic_store_explicit(&t->interval_us, t->default_interval_us, memory_order_relaxed);
+    atomic_store_explicit(&t->latency, 0, memory_order_relaxed);
+    atomic_store_explicit(&t->timeout, 0, memory_order_relaxed);
+    atomic_store_explicit(&t->updates, 0, memory_order_relaxed);
+    atomic_store_explicit(&t->rejects, 0, memory_order_relaxed);
+    // Publishes peer to the owning task
+    atomic_fetch_add_explicit(&t->conn_seq, 1, memory_order_release);
+    atomic_store(&t->connected, true);
+}
+
+void conn_tune_disconnected(conn_tune_t *t)
+{
+    atomic_store(&t->connected, false);
+}
+
+void conn_tune_on_update(conn_tune_t *t, const esp_ble_gap_cb_param_t *param)
+{
+    int requested = atomic_load_explicit(&t->requested, memory_order_relaxed);
+    const conn_tune_params_t *want = requested == 1 ? &t->active : &t->idle;
+
+    if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+        atomic_fetch_add_explicit(&t->rejects, 1, memory_order_relaxed);
+        ESP_LOGW(TAG, "Parameter update failed, status %d", param->update_conn_params.status);
+        return;
+    }
+
+    uint32_t interval_us = param->update_conn_params.conn_int * 1250;
+    atomic_store_explicit(&t->interval_us, interval_us, memory_order_relaxed);
+    atomic_store_explicit(&t->latency, param->update_conn_params.latency, memory_order_relaxed);
+    atomic_store_explicit(&t->timeout, param->update_conn_params.timeout, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->updates, 1, memory_order_relaxed);
+    if (requested >= 0 && (param->update_conn_params.conn_int < want->min_int
+            || param->update_conn_params.conn_int > want->max_int
+            || param->update_conn_params.latency > want->latency)) {
+        atomic_fetch_add_explicit(&t->rejects, 1, memory_order_relaxed);
+    }
+    ESP_LOGI(TAG, "Interval %lu.%02lu ms, latency %d, timeout %d ms",
+             (unsigned long)(interval_us / 1000), (unsigned long)(interval_us % 1000 / 10),
+             param->update_conn_params.latency, param->update_conn_params.timeout * 10);
+}
+
+void conn_tune_poll(conn_tune_t *t, bool moving, int64_t now_us)
+{
+    if (!atomic_load(&t->connected)) {
+        return;
+    }
+    uint32_t seq = atomic_load_explicit(&t->conn_seq, memory_order_acquire);
+    if (t->seen_seq != seq) {
+        // New connection: let discovery and encryption settle before asking.
+        // A connection racing the copy bumps conn_seq again and is picked up
+        // on the next poll.
+        t->seen_seq = seq;
+        memcpy(t->seen_peer, t->peer, sizeof(esp_bd_addr_t));
+        atomic_store_explicit(&t->requested, -1, memory_order_relaxed);
+        t->request_us = now_us;
+        t->window_start_us = now_us;
+        t->window_count = 0;
+        t->notify_per_s = 0;
+        return;
+    }
+
+    int want = moving ? 1 : 0;
+    if (want == atomic_load_explicit(&t->requested, memory_order_relaxed) || now_us - t->request_us < (int64_t)t->retry_us) {
+        return;
+    }
+
+    const conn_tune_params_t *p = want ? &t->active : &t->idle;
+    esp_ble_conn_update_params_t conn_params = {
+        .min_int = p->min_int,
+        .max_int = p->max_int,
+        .latency = p->latency,
+        .timeout = p->timeout,
+    };
+    memcpy(conn_params.bda, t->seen_peer, sizeof(esp_bd_addr_t));
+
+    // A refused request is not repeated until the wanted set changes
+    t->request_us = now_us;
+    if (esp_ble_gap_update_conn_params(&conn_params) == ESP_OK) {
+        atomic_store_explicit(&t->requested, want, memory_order_relaxed);
+        ESP_LOGI(TAG, "Requesting %s parameters", want ? "active" : "idle");
+    }
+}
+
+void conn_tune_count_notify(conn_tune_t *t, uint32_t n, int64_t now_us)
+{
+    int64_t elapsed = now_us - t->window_start_us;
+
+    if (elapsed >= RATE_WINDOW_US) {
+        t->notify_per_s = (uint32_t)((int64_t)t->window_count * 1000000 / elapsed);
+        t->window_count = 0;
+        t->window_start_us = now_us;
+    }
+    t->window_count += n;
+    t->notify_total += n;
+}
+
+void conn_tune_get(const conn_tune_t *t, conn_tune_info_t *info)
+{
+    info->connected = atomic_load(&t->connected);
+    info->active = atomic_load_explicit(&t->requested, memory_order_relaxed) == 1;
+    info->interval_us = atomic_load_explicit(&t->interval_us, memory_order_relaxed);
+    info->latency = atomic_load_explicit(&t->latency, memory_order_relaxed);
+    info->timeout_ms = atomic_load_explicit(&t->timeout, memory_order_relaxed) * 10u;
+    info->updates = atomic_load_explicit(&t->updates, memory_order_relaxed);
+    info->rejects = atomic_load_explicit(&t->rejects, memory_order_relaxed);
+    info->notify_per_s = t->notify_per_s;
+    info->notify_total = t->notify_total;
+}
@@ -0,0 +1,101 @@
+// BLE connection parameter tuning
+//
+// The central picks the connection interval, and HID hosts often settle on
+// 30-50 ms, which is what a pointer then feels like. This asks for a short
+// interval with no slave latency while the device is moving and for a
+// relaxed one once it rests, records what the central actually granted and
+// measures the notification rate that goes out over it.
+//
+// Requests and the rate counters belong to one task (the HID task, which
+// calls conn_tune_poll(), conn_tune_count_notify() and conn_tune_get()); the
+// BLE callbacks only record connection events and granted parameters. What
+// they record is atomic: the peer address is written before conn_seq is
+// bumped with release order, and the owning task copies it once it sees the
+// new conn_seq.
+
+#ifndef CONN_TUNE_H__
+#define CONN_TUNE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_gap_ble_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One parameter set, in controller units
+typedef struct {
+    uint16_t min_int;       // 1.25 ms
+    uint16_t max_int;       // 1.25 ms
+    uint16_t latency;       // connection events the peripheral may skip
+    uint16_t timeout;       // supervision timeout, 10 ms
+} conn_tune_params_t;
+
+// What the link runs with and what goes over it
+typedef struct {
+    bool connected;
+    bool active;            // last request was the active set
+    uint32_t interval_us;   // granted by the central
+    uint16_t latency;
+    uint32_t timeout_ms;
+    uint32_t updates;       // parameter updates seen on this connection
+    uint32_t rejects;       // requests the central refused or answered outside the range
+    uint32_t notify_per_s;  // notifications in the last full second
+    uint32_t notify_total;
+} conn_tune_info_t;
+
+typedef struct {
+    conn_tune_params_t active;
+    conn_tune_params_t idle;
+    uint32_t retry_us;          // least time between two requests
+    uint32_t default_interval_us;
+
+    // Written by the BLE callbacks
+    esp_bd_addr_t peer;             // published by conn_seq
+    atomic_bool connected;
+    atomic_uint conn_seq;           // bumped on every connection
+    atomic_uint interval_us;
+    atomic_uint latency;
+    atomic_uint timeout;
+    atomic_uint updates;
+    atomic_uint rejects;
+
+    // Owned by the task calling conn_tune_poll()
+    uint32_t seen_seq;          // connection the owning task has set up
+    esp_bd_addr_t seen_peer;    // peer of seen_seq
+    atomic_int requested;       // -1 none, 0 idle, 1 active; read by the update callback
+    int64_t request_us;
+    uint32_t window_count;
+    int64_t window_start_us;
+    uint32_t notify_per_s;
+    uint32_t notify_total;
+} conn_tune_t;
+
+// interval_us is what is assumed until the central reports its parameters;
+// the first request goes out retry_us into a connection, once the central
+// is done with service discovery
+void conn_tune_init(conn_tune_t *t, const conn_tune_params_t *active, const conn_tune_params_t *idle,
+                    uint32_t interval_us, uint32_t retry_us);
+
+// From the HID connect / disconnect events
+void conn_tune_connected(conn_tune_t *t, const esp_bd_addr_t peer);
+void conn_tune_disconnected(conn_tune_t *t);
+
+// From ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+void conn_tune_on_update(conn_tune_t *t, const esp_ble_gap_cb_param_t *param);
+
+// Request the active or idle set as needed; call regularly from the owning task
+void conn_tune_poll(conn_tune_t *t, bool moving, int64_t now_us);
+
+// Count notifications sent
+void conn_tune_count_notify(conn_tune_t *t, uint32_t n, int64_t now_us);
+
+void conn_tune_get(const conn_tune_t *t, conn_tune_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_TUNE_H__ */
@@ -18,7 +18,14 @@
 #define HID_LED_OUT_RPT_LEN         1
 
 // HID mouse input report length
+#if (HID_MOUSE_HIRES == true)
+#define HID_MOUSE_IN_RPT_LEN        6
+#else
 #define HID_MOUSE_IN_RPT_LEN        5
+#endif
+
+// HID boot mouse input report length
+#define HID_MOUSE_BOOT_IN_RPT_LEN   3
 
 // HID consumer control input report length
 #define HID_CC_IN_RPT_LEN           2
@@ -46,6 +53,56 @@ esp_err_t esp_hidd_register_callbacks(esp_hidd_event_cb_t callbacks)
     return hidd_status;
 }
 
+static bool add_int8(uint8_t *acc, uint8_t v)
+{
+    int32_t sum = (int8_t)*acc + (int8_t)v;
+    if (sum > INT8_MAX || sum < -INT8_MAX) {
+        return false;
+    }
+    *acc = (uint8_t)sum;
+    return true;
+}
+
+#if (HID_MOUSE_HIRES == true)
+static bool add_int16(uint8_t *acc, const uint8_t *v)
+{
+    int32_t sum = (int16_t)(acc[0] | acc[1] << 8) + (int16_t)(v[0] | v[1] << 8);
+    if (sum > INT16_MAX || sum < -INT16_MAX) {
+        return false;
+    }
+    acc[0] = sum & 0xFF;
+    acc[1] = (sum >> 8) & 0xFF;
+    return true;
+}
+#endif
+
+// Two mouse reports with the same buttons combine by adding their motion;
+// a button change, or motion that would no longer fit, keeps them apart
+static bool mouse_report_merge(uint8_t *pending, const uint8_t *next, uint8_t length)
+{
+    uint8_t merged[HID_MOUSE_IN_RPT_LEN];
+
+    if (pending[0] != next[0] || length > sizeof(merged)) {
+        return false;
+    }
+    memcpy(merged, pending, length);
+
+    bool ok;
+    if (length == HID_MOUSE_BOOT_IN_RPT_LEN) {
+        ok = add_int8(&merged[1], next[1]) && add_int8(&merged[2], next[2]);
+    } else {
+#if (HID_MOUSE_HIRES == true)
+        ok = add_int16(&merged[1], &next[1]) && add_int16(&merged[3], &next[3]) && add_int8(&merged[5], next[5]);
+#else
+        ok = add_int8(&merged[1], next[1]) && add_int8(&merged[2], next[2]) && add_int8(&merged[3], next[3]);
+#endif
+    }
+    if (ok) {
+        memcpy(pending, merged, length);
+    }
+    return ok;
+}
+
 esp_err_t esp_hidd_profile_init(void)
 {
      if (hidd_le_env.enabled) {
@@ -55,6 +112,8 @@ esp_err_t esp_hidd_profile_init(void)
     // Reset the hid device target environment
     memset(&hidd_le_env, 0, sizeof(hidd_le_env_t));
     hidd_le_env.enabled = true;
+    // Relative motion waiting out a congestion is summed, not dropped
+    hid_dev_set_merge_cb(HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, mouse_report_merge);
     return ESP_OK;
 }
 
@@ -93,7 +152,7 @@ void esp_hidd_send_consumer_value(uint16_t conn_id, uint8_t key_cmd, bool key_pr
     }
     ESP_LOGD(HID_LE_PRF_TAG, "buffer[0] = %x, buffer[1] = %x", buffer[0], buffer[1]);
     hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
-                        HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT, HID_CC_IN_RPT_LEN, buffer);
+                        HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT, HID_CC_IN_RPT_LEN, buffer, 0);
     return;
 }
 
@@ -114,21 +173,76 @@ void esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask,
 
     ESP_LOGD(HID_LE_PRF_TAG, "the key vaule = %d,%d,%d, %d, %d, %d,%d, %d", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
     hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
-                        HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_KEYBOARD_IN_RPT_LEN, buffer);
+                        HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_KEYBOARD_IN_RPT_LEN, buffer, 0);
     return;
 }
 
 void esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y)
+{
+    esp_hidd_send_mouse_wheel_value(conn_id, mouse_button, mickeys_x, mickeys_y, 0);
+}
+
+static int8_t sat_int8(int32_t v)
+{
+    return v > INT8_MAX ? INT8_MAX : (v < -INT8_MAX ? -INT8_MAX : (int8_t)v);
+}
+
+void esp_hidd_send_mouse_wheel_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y,
+                                     int8_t wheel)
+{
+    esp_hidd_send_mouse_hires_value(conn_id, mouse_button, mickeys_x, mickeys_y,
+                                    sat_int8(wheel * esp_hidd_mouse_wheel_resolution()), 0);
+}
+
+bool esp_hidd_send_mouse_hires_value(uint16_t conn_id, uint8_t mouse_button, int16_t mickeys_x, int16_t mickeys_y,
+                                     int8_t wheel, uint32_t tag)
 {
     uint8_t buffer[HID_MOUSE_IN_RPT_LEN];
 
-    buffer[0] = mouse_button;   // Buttons
-    buffer[1] = mickeys_x;           // X
-    buffer[2] = mickeys_y;           // Y
-    buffer[3] = 0;           // Wheel
-    buffer[4] = 0;           // AC Pan
+    // Boot protocol only knows buttons and 8-bit X/Y, and goes out on the boot mouse characteristic
+    if (hidProtocolMode == HID_PROTOCOL_MODE_BOOT) {
+        buffer[0] = mouse_button;
+        buffer[1] = sat_int8(mickeys_x);
+        buffer[2] = sat_int8(mickeys_y);
+        return hid_dev_send_report(hidd_le_env.gatt_if, conn_id, HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT,
+                                   HID_MOUSE_BOOT_IN_RPT_LEN, buffer, tag) == HID_DEV_TX_SENT;
+    }
 
-    hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
-                        HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, HID_MOUSE_IN_RPT_LEN, buffer);
-    return;
+#if (HID_MOUSE_HIRES == true)
+    buffer[0] = mouse_button;           // Buttons
+    buffer[1] = mickeys_x & 0xFF;       // X
+    buffer[2] = (mickeys_x >> 8) & 0xFF;
+    buffer[3] = mickeys_y & 0xFF;       // Y
+    buffer[4] = (mickeys_y >> 8) & 0xFF;
+    buffer[5] = wheel;                  // Wheel
+#else
+    buffer[0] = mouse_button;           // Buttons
+    buffer[1] = sat_int8(mickeys_x);    // X
+    buffer[2] = sat_int8(mickeys_y);    // Y
+    buffer[3] = wheel;                  // Wheel
+    buffer[4] = 0;                      // AC Pan
+#endif
+
+    return hid_dev_send_report(hidd_le_env.gatt_if, conn_id, HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT,
+                               HID_MOUSE_IN_RPT_LEN, buffer, tag) == HID_DEV_TX_SENT;
+}
+
+int16_t esp_hidd_mouse_max_delta(void)
+{
+#if (HID_MOUSE_HIRES == true)
+    if (hidProtocolMode == HID_PROTOCOL_MODE_REPORT) {
+        return INT16_MAX;
+    }
+#endif
+    return INT8_MAX;
+}
+
+uint8_t esp_hidd_mouse_wheel_resolution(void)
+{
+#if (HID_MOUSE_HIRES == true)
+    if (hidProtocolMode == HID_PROTOCOL_MODE_REPORT && (hidMouseFeature & 0x03)) {
+        return HID_MOUSE_WHEEL_MULTIPLIER;
+    }
+#endif
+    return 1;
 }
@@ -23,6 +23,7 @@ typedef enum {
     ESP_HIDD_EVENT_BLE_DISCONNECT,
     ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT,
     ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE_EVT,
+    ESP_HIDD_EVENT_BLE_REPORT_CONF_EVT,
 } esp_hidd_cb_event_t;
 
 /// HID config status
@@ -106,6 +107,16 @@ typedef union {
         uint8_t length;
         uint8_t *data;
     } led_write;
+
+    /**
+     * @brief ESP_HIDD_EVENT_BLE_REPORT_CONF_EVT, an input report notification has left the stack
+     */
+    struct hidd_report_conf_evt_param {
+        uint16_t conn_id;
+        uint8_t report_id;
+        esp_gatt_status_t status;
+        uint32_t tag;               /*!< tag the report was sent with, 0 if none */
+    } report_conf;
 } esp_hidd_cb_param_t;
 
 
@@ -162,6 +173,40 @@ void esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask,
 
 void esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y);
 
+void esp_hidd_send_mouse_wheel_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y,
+                                     int8_t wheel);
+
+/**
+ * @brief           Send a mouse report with 16-bit X/Y
+ *
+ * @param[in]       wheel: in wheel report units, see esp_hidd_mouse_wheel_resolution()
+ *
+ * @param[in]       tag: returned in ESP_HIDD_EVENT_BLE_REPORT_CONF_EVT for the notification that carries this
+ *                  report, 0 for none. A report held back by congestion keeps its tag; one merged into a held
+ *                  report is confirmed with the held report's tag.
+ *
+ * In boot protocol the report is sent as a boot mouse report: X/Y are saturated to 8 bits and the wheel is dropped.
+ *
+ * @return          true if the report was handed to the stack now, false if it waits for congestion to clear
+ *                  (held or merged) or could not be sent
+ */
+bool esp_hidd_send_mouse_hires_value(uint16_t conn_id, uint8_t mouse_button, int16_t mickeys_x, int16_t mickeys_y,
+                                     int8_t wheel, uint32_t tag);
+
+/**
+ * @brief           Largest X/Y the mouse report carries in the current protocol mode
+ *
+ * @return          32767 for the high resolution report, 127 in boot protocol or with 8-bit reports
+ */
+int16_t esp_hidd_mouse_max_delta(void);
+
+/**
+ * @brief           Wheel report units per detent
+ *
+ * @return          The Resolution Multiplier once the host has enabled it, otherwise 1
+ */
+uint8_t esp_hidd_mouse_wheel_resolution(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,10 +10,63 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
 
 static hid_report_map_t *hid_dev_rpt_tbl;
 static uint8_t hid_dev_rpt_tbl_Len;
 
+// Congestion-aware transmit: while the stack reports congestion, input
+// reports wait in a short queue per report characteristic instead of piling
+// up in the stack's queue and arriving late. A newer report is merged into
+// the last waiting one when the report has a merge callback (relative
+// motion); one that cannot be merged (a button change) takes the next slot,
+// so both are seen in order. Without a merge callback (state reports: keys,
+// consumer) the newest replaces the last waiting one, as it does when the
+// queue is full. Nothing goes out until the congestion clears; then the
+// queues drain oldest first, and reports arriving meanwhile queue behind.
+#define HID_DEV_HOLD_MAX_LEN    8
+#define HID_DEV_HOLD_SLOTS      4
+#define HID_DEV_MERGE_MAX       4
+
+// Every notification handed to the stack is remembered with its tag until
+// its ESP_GATTS_CONF_EVT, which arrives in order per characteristic. The
+// oldest entries are forgotten when confirmations go missing.
+#define HID_DEV_INFLIGHT_MAX    16
+
+typedef struct {
+    uint16_t conn_id;
+    uint8_t length;
+    uint32_t tag;
+    uint8_t data[HID_DEV_HOLD_MAX_LEN];
+} hid_dev_held_t;
+
+typedef struct {
+    hid_dev_held_t slot[HID_DEV_HOLD_SLOTS];
+    uint8_t head;
+    uint8_t len;
+} hid_dev_queue_t;
+
+typedef struct {
+    uint16_t handle;
+    uint32_t tag;
+} hid_dev_inflight_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t type;
+    hid_dev_merge_cb_t cb;
+} hid_dev_merge_t;
+
+static portMUX_TYPE hid_dev_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool hid_dev_congested;
+static bool hid_dev_draining;          // queues are being emptied, new reports join them
+static esp_gatt_if_t hid_dev_gatts_if;
+static hid_dev_queue_t hid_dev_queue[HID_NUM_REPORTS];
+static hid_dev_merge_t hid_dev_merge[HID_DEV_MERGE_MAX];
+static hid_dev_tx_stats_t hid_dev_stats;
+static hid_dev_inflight_t hid_dev_inflight[HID_DEV_INFLIGHT_MAX];
+static uint8_t hid_dev_inflight_len;
+
 static hid_report_map_t *hid_dev_rpt_by_id(uint8_t id, uint8_t type)
 {
     hid_report_map_t *rpt = hid_dev_rpt_tbl;
@@ -27,6 +80,16 @@ static hid_report_map_t *hid_dev_rpt_by_id(uint8_t id, uint8_t type)
     return NULL;
 }
 
+static hid_dev_merge_cb_t hid_dev_merge_cb(uint8_t id, uint8_t type)
+{
+    for (int i = 0; i < HID_DEV_MERGE_MAX; i++) {
+        if (hid_dev_merge[i].cb && hid_dev_merge[i].id == id && hid_dev_merge[i].type == type) {
+            return hid_dev_merge[i].cb;
+        }
+    }
+    return NULL;
+}
+
 void hid_dev_register_reports(uint8_t num_reports, hid_report_map_t *p_report)
 {
     hid_dev_rpt_tbl = p_report;
@@ -34,19 +97,190 @@ void hid_dev_register_reports(uint8_t num_reports, hid_report_map_t *p_report)
     return;
 }
 
-void hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
-                                    uint8_t id, uint8_t type, uint8_t length, uint8_t *data)
+esp_err_t hid_dev_set_merge_cb(uint8_t id, uint8_t type, hid_dev_merge_cb_t cb)
+{
+    for (int i = 0; i < HID_DEV_MERGE_MAX; i++) {
+        if (!hid_dev_merge[i].cb || (hid_dev_merge[i].id == id && hid_dev_merge[i].type == type)) {
+            hid_dev_merge[i].id = id;
+            hid_dev_merge[i].type = type;
+            hid_dev_merge[i].cb = cb;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+// Runs inside hid_dev_tx_lock
+static void hid_dev_inflight_remove(int i)
+{
+    hid_dev_inflight_len--;
+    memmove(&hid_dev_inflight[i], &hid_dev_inflight[i + 1], (hid_dev_inflight_len - i) * sizeof(hid_dev_inflight[0]));
+}
+
+static esp_err_t hid_dev_notify(uint16_t conn_id, const hid_report_map_t *p_rpt, uint8_t length, uint8_t *data,
+                                uint32_t tag)
+{
+    ESP_LOGD(HID_LE_PRF_TAG, "%s(), send the report, handle = %d", __func__, p_rpt->handle);
+
+    // Recorded first: the confirmation can arrive before the call returns
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    if (hid_dev_inflight_len == HID_DEV_INFLIGHT_MAX) {
+        hid_dev_inflight_remove(0);
+    }
+    hid_dev_inflight[hid_dev_inflight_len++] = (hid_dev_inflight_t){ .handle = p_rpt->handle, .tag = tag };
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+
+    esp_err_t err = esp_ble_gatts_send_indicate(hid_dev_gatts_if, conn_id, p_rpt->handle, length, data, false);
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    if (err == ESP_OK) {
+        hid_dev_stats.sent++;
+    } else {
+        // No confirmation will come: forget the newest matching entry
+        hid_dev_stats.dropped++;
+        for (int i = hid_dev_inflight_len - 1; i >= 0; i--) {
+            if (hid_dev_inflight[i].handle == p_rpt->handle && hid_dev_inflight[i].tag == tag) {
+                hid_dev_inflight_remove(i);
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+    return err;
+}
+
+uint32_t hid_dev_confirm(uint16_t handle)
+{
+    uint32_t tag = 0;
+
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    for (int i = 0; i < hid_dev_inflight_len; i++) {
+        if (hid_dev_inflight[i].handle == handle) {
+            tag = hid_dev_inflight[i].tag;
+            hid_dev_inflight_remove(i);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+    return tag;
+}
+
+hid_dev_tx_t hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
+                                 uint8_t id, uint8_t type, uint8_t length, uint8_t *data, uint32_t tag)
 {
     hid_report_map_t *p_rpt;
+    bool send_now = false;
+    hid_dev_tx_t result = HID_DEV_TX_HELD;
 
     // get att handle for report
-    if ((p_rpt = hid_dev_rpt_by_id(id, type)) != NULL) {
-        // if notifications are enabled
-        ESP_LOGD(HID_LE_PRF_TAG, "%s(), send the report, handle = %d", __func__, p_rpt->handle);
-        esp_ble_gatts_send_indicate(gatts_if, conn_id, p_rpt->handle, length, data, false);
+    if ((p_rpt = hid_dev_rpt_by_id(id, type)) == NULL) {
+        return HID_DEV_TX_FAILED;
+    }
+    hid_dev_gatts_if = gatts_if;
+    if (length > HID_DEV_HOLD_MAX_LEN) {
+        return hid_dev_notify(conn_id, p_rpt, length, data, tag) == ESP_OK ? HID_DEV_TX_SENT : HID_DEV_TX_FAILED;
     }
 
-    return;
+    hid_dev_merge_cb_t merge = hid_dev_merge_cb(id, type);
+    hid_dev_queue_t *q = &hid_dev_queue[p_rpt - hid_dev_rpt_tbl];
+
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    if (!hid_dev_congested && !hid_dev_draining) {
+        send_now = true;
+    } else {
+        hid_dev_held_t *tail = q->len ? &q->slot[(q->head + q->len - 1) % HID_DEV_HOLD_SLOTS] : NULL;
+        if (tail && tail->conn_id == conn_id && tail->length == length && merge && merge(tail->data, data, length)) {
+            hid_dev_stats.merged++;
+            if (!tail->tag) {
+                tail->tag = tag;
+            }
+            result = HID_DEV_TX_MERGED;
+        } else {
+            if (!tail || (merge && q->len < HID_DEV_HOLD_SLOTS)) {
+                tail = &q->slot[(q->head + q->len++) % HID_DEV_HOLD_SLOTS];
+                hid_dev_stats.held++;
+            } else {
+                hid_dev_stats.dropped++;
+            }
+            tail->conn_id = conn_id;
+            tail->length = length;
+            tail->tag = tag;
+            memcpy(tail->data, data, length);
+        }
+    }
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+
+    if (send_now) {
+        result = hid_dev_notify(conn_id, p_rpt, length, data, tag) == ESP_OK ? HID_DEV_TX_SENT : HID_DEV_TX_FAILED;
+    }
+    return result;
+}
+
+void hid_dev_set_congested(bool congested)
+{
+    bool drain;
+
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    if (congested && !hid_dev_congested) {
+        hid_dev_stats.congestions++;
+    }
+    hid_dev_congested = congested;
+    drain = !congested && !hid_dev_draining;
+    if (drain) {
+        hid_dev_draining = true;
+    }
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+    if (!drain) {
+        return;
+    }
+
+    // One report at a time, oldest first; stops early if the link congests again
+    while (1) {
+        hid_dev_held_t out;
+        int rpt = -1;
+
+        portENTER_CRITICAL(&hid_dev_tx_lock);
+        for (int i = 0; !hid_dev_congested && i < hid_dev_rpt_tbl_Len && i < HID_NUM_REPORTS; i++) {
+            hid_dev_queue_t *q = &hid_dev_queue[i];
+            if (q->len) {
+                out = q->slot[q->head];
+                q->head = (q->head + 1) % HID_DEV_HOLD_SLOTS;
+                q->len--;
+                rpt = i;
+                break;
+            }
+        }
+        if (rpt < 0) {
+            hid_dev_draining = false;
+        }
+        portEXIT_CRITICAL(&hid_dev_tx_lock);
+
+        if (rpt < 0) {
+            break;
+        }
+        hid_dev_notify(out.conn_id, &hid_dev_rpt_tbl[rpt], out.length, out.data, out.tag);
+    }
+}
+
+void hid_dev_reset_tx(void)
+{
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    hid_dev_congested = false;
+    hid_dev_draining = false;
+    memset(hid_dev_queue, 0, sizeof(hid_dev_queue));
+    hid_dev_inflight_len = 0;
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
+}
+
+bool hid_dev_is_congested(void)
+{
+    return hid_dev_congested;
+}
+
+void hid_dev_get_tx_stats(hid_dev_tx_stats_t *stats)
+{
+    portENTER_CRITICAL(&hid_dev_tx_lock);
+    *stats = hid_dev_stats;
+    portEXIT_CRITICAL(&hid_dev_tx_lock);
 }
 
 void hid_consumer_build_report(uint8_t *buffer, consumer_cmd_t cmd)
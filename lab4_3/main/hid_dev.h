@@ -234,10 +234,55 @@ typedef struct
 
 } hid_dev_cfg_t;
 
+// Merge `next` into the waiting report `pending` (same report, same length);
+// return false, leaving `pending` untouched, if the two cannot be combined.
+// Runs inside a critical section.
+typedef bool (*hid_dev_merge_cb_t)(uint8_t *pending, const uint8_t *next, uint8_t length);
+
+// Transmit counters
+typedef struct
+{
+  uint32_t    sent;             // notifications the stack accepted
+  uint32_t    held;             // reports queued until congestion cleared
+  uint32_t    merged;           // reports merged into a waiting one
+  uint32_t    dropped;          // waiting reports replaced by a newer one, notifications the stack refused
+  uint32_t    congestions;      // times the stack reported congestion
+} hid_dev_tx_stats_t;
+
 void hid_dev_register_reports(uint8_t num_reports, hid_report_map_t *p_report);
 
-void hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
-                                    uint8_t id, uint8_t type, uint8_t length, uint8_t *data);
+// What happened to a report passed to hid_dev_send_report()
+typedef enum
+{
+  HID_DEV_TX_SENT,              // handed to the stack
+  HID_DEV_TX_HELD,              // waits for congestion to clear, then goes out
+  HID_DEV_TX_MERGED,            // merged into a waiting report
+  HID_DEV_TX_FAILED,            // unknown report, or the stack refused it
+} hid_dev_tx_t;
+
+// `tag` travels with the report: a held report keeps it, a merged one leaves
+// the waiting report's tag (or gives it its own if that had none). It comes
+// back from hid_dev_confirm() for the notification that carried the report.
+// 0 for none.
+hid_dev_tx_t hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
+                                 uint8_t id, uint8_t type, uint8_t length, uint8_t *data, uint32_t tag);
+
+// From ESP_GATTS_CONF_EVT: tag of the oldest unconfirmed notification on
+// `handle`, 0 if it had none or is not known
+uint32_t hid_dev_confirm(uint16_t handle);
+
+// Reports without a merge callback keep only the newest one while congested
+esp_err_t hid_dev_set_merge_cb(uint8_t id, uint8_t type, hid_dev_merge_cb_t cb);
+
+// From ESP_GATTS_CONGEST_EVT; clearing sends whatever waited
+void hid_dev_set_congested(bool congested);
+
+// Forget congestion and waiting reports, on connect and disconnect
+void hid_dev_reset_tx(void);
+
+bool hid_dev_is_congested(void);
+
+void hid_dev_get_tx_stats(hid_dev_tx_stats_t *stats);
 
 void hid_consumer_build_report(uint8_t *buffer, consumer_cmd_t cmd);
 
@@ -47,6 +47,36 @@ static const uint8_t hidReportMap[] = {
     0x95, 0x01,  //     Report Count (1)
     0x81, 0x01,  //     Input (Constant) - Padding or Reserved bits
     0x05, 0x01,  //     Usage Page (Generic Desktop)
+#if (HID_MOUSE_HIRES == true)
+    0x09, 0x30,  //     Usage (X)
+    0x09, 0x31,  //     Usage (Y)
+    0x16, 0x01, 0x80, // Logical Minimum (-32767)
+    0x26, 0xFF, 0x7F, // Logical Maximum (32767)
+    0x75, 0x10,  //     Report Size (16)
+    0x95, 0x02,  //     Report Count (2)
+    0x81, 0x06,  //     Input (Data, Variable, Relative) - X & Y coordinate
+    0xA1, 0x02,  //     Collection (Logical)
+    0x09, 0x48,  //       Usage (Resolution Multiplier)
+    0x15, 0x00,  //       Logical Minimum (0)
+    0x25, 0x01,  //       Logical Maximum (1)
+    0x35, 0x01,  //       Physical Minimum (1)
+    0x45, HID_MOUSE_WHEEL_MULTIPLIER, // Physical Maximum (multiplier)
+    0x75, 0x02,  //       Report Size (2)
+    0x95, 0x01,  //       Report Count (1)
+    0xB1, 0x02,  //       Feature (Data, Variable, Absolute)
+    0x35, 0x00,  //       Physical Minimum (0)
+    0x45, 0x00,  //       Physical Maximum (0)
+    0x09, 0x38,  //       Usage (Wheel)
+    0x15, 0x81,  //       Logical Minimum (-127)
+    0x25, 0x7F,  //       Logical Maximum (127)
+    0x75, 0x08,  //       Report Size (8)
+    0x95, 0x01,  //       Report Count (1)
+    0x81, 0x06,  //       Input (Data, Variable, Relative) - Wheel
+    0xC0,        //     End Collection
+    0x75, 0x06,  //     Report Size (6)
+    0x95, 0x01,  //     Report Count (1)
+    0xB1, 0x01,  //     Feature (Constant) - Padding
+#else
     0x09, 0x30,  //     Usage (X)
     0x09, 0x31,  //     Usage (Y)
     0x09, 0x38,  //     Usage (Wheel)
@@ -55,6 +85,7 @@ static const uint8_t hidReportMap[] = {
     0x75, 0x08,  //     Report Size (8)
     0x95, 0x03,  //     Report Count (3)
     0x81, 0x06,  //     Input (Data, Variable, Relative) - X & Y coordinate
+#endif
     0xC0,        //   End Collection
     0xC0,        // End Collection
 
@@ -205,8 +236,10 @@ struct gatts_profile_inst {
 hidd_le_env_t hidd_le_env;
 
 // HID report map length
-uint8_t hidReportMapLen = sizeof(hidReportMap);
+uint16_t hidReportMapLen = sizeof(hidReportMap);
 uint8_t hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
+// Mouse feature report: bits 0-1 are the wheel Resolution Multiplier
+uint8_t hidMouseFeature = 0;
 
 // HID report mapping table
 //static hidRptMap_t  hidRptMap[HID_NUM_REPORTS];
@@ -522,9 +555,9 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                          (uint8_t *)&char_prop_read_write}},
     // Report Characteristic Value
     [HIDD_LE_IDX_REPORT_VAL]                      = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
-                                                                       ESP_GATT_PERM_READ,
-                                                                       HIDD_LE_REPORT_MAX_LEN, 0,
-                                                                       NULL}},
+                                                                       (ESP_GATT_PERM_READ|ESP_GATT_PERM_WRITE),
+                                                                       HIDD_LE_REPORT_MAX_LEN, sizeof(hidMouseFeature),
+                                                                       &hidMouseFeature}},
     // Report Characteristic - Report Reference Descriptor
     [HIDD_LE_IDX_REPORT_REP_REF]               = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_ref_descr_uuid,
                                                                        ESP_GATT_PERM_READ,
@@ -560,16 +593,42 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         }
         case ESP_GATTS_CONF_EVT: {
+            // Also reported for notifications, once they are handed to the controller
+            for (int i = 0; i < HID_NUM_REPORTS; i++) {
+                if (hid_rpt_map[i].handle == param->conf.handle && hid_rpt_map[i].type == HID_REPORT_TYPE_INPUT) {
+                    esp_hidd_cb_param_t cb_param = {0};
+                    cb_param.report_conf.conn_id = param->conf.conn_id;
+                    cb_param.report_conf.report_id = hid_rpt_map[i].id;
+                    cb_param.report_conf.status = param->conf.status;
+                    cb_param.report_conf.tag = hid_dev_confirm(param->conf.handle);
+                    if (hidd_le_env.hidd_cb != NULL) {
+                        (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_REPORT_CONF_EVT, &cb_param);
+                    }
+                    break;
+                }
+            }
             break;
         }
         case ESP_GATTS_CREATE_EVT:
             break;
+        case ESP_GATTS_CONGEST_EVT:
+            ESP_LOGD(HID_LE_PRF_TAG, "Congested %d", param->congest.congested);
+            hid_dev_set_congested(param->congest.congested);
+            break;
         case ESP_GATTS_CONNECT_EVT: {
             esp_hidd_cb_param_t cb_param = {0};
 			ESP_LOGI(HID_LE_PRF_TAG, "HID connection establish, conn_id = %x",param->connect.conn_id);
 			memcpy(cb_param.connect.remote_bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
             cb_param.connect.conn_id = param->connect.conn_id;
             hidd_clcb_alloc(param->connect.conn_id, param->connect.remote_bda);
+            hid_dev_reset_tx();
+            // Every connection starts in report protocol with the wheel at 1x
+            hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
+            hidMouseFeature = 0;
+            hidd_set_attr_value(hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_PROTO_MODE_VAL],
+                                sizeof(hidProtocolMode), &hidProtocolMode);
+            hidd_set_attr_value(hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_VAL],
+                                sizeof(hidMouseFeature), &hidMouseFeature);
             esp_ble_set_encryption(param->connect.remote_bda, ESP_BLE_SEC_ENCRYPT_NO_MITM);
             if(hidd_le_env.hidd_cb != NULL) {
                 (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_CONNECT, &cb_param);
@@ -580,6 +639,7 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
 			 if(hidd_le_env.hidd_cb != NULL) {
                     (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_DISCONNECT, NULL);
              }
+            hid_dev_reset_tx();
             hidd_clcb_dealloc(param->disconnect.conn_id);
             break;
         }
@@ -587,6 +647,19 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         case ESP_GATTS_WRITE_EVT: {
             esp_hidd_cb_param_t cb_param = {0};
+            // The stack keeps its own copy of written values, mirror the ones the reports depend on
+            if (param->write.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_PROTO_MODE_VAL] &&
+                param->write.len == HID_PROTOCOL_MODE_LEN) {
+                hidProtocolMode = param->write.value[0] == HID_PROTOCOL_MODE_BOOT ?
+                                  HID_PROTOCOL_MODE_BOOT : HID_PROTOCOL_MODE_REPORT;
+                ESP_LOGI(HID_LE_PRF_TAG, "Protocol mode %s",
+                         hidProtocolMode == HID_PROTOCOL_MODE_BOOT ? "boot" : "report");
+            }
+            if (param->write.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_VAL] &&
+                param->write.len >= 1) {
+                hidMouseFeature = param->write.value[0] & 0x03;
+                ESP_LOGI(HID_LE_PRF_TAG, "Wheel resolution multiplier %d", hidMouseFeature);
+            }
             if (param->write.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_LED_OUT_VAL]) {
                 cb_param.led_write.conn_id = param->write.conn_id;
                 cb_param.led_write.report_id = HID_RPT_ID_LED_OUT;
@@ -16,6 +16,10 @@
 #include "hid_dev.h"
 
 #define SUPPORT_REPORT_VENDOR                 false
+// 16-bit X/Y and a high resolution wheel in the mouse report, false = 8-bit
+#define HID_MOUSE_HIRES                       true
+// Wheel units per detent once the host enables the Resolution Multiplier
+#define HID_MOUSE_WHEEL_MULTIPLIER            8
 //HID BLE profile log tag
 #define HID_LE_PRF_TAG                        "HID_LE_PRF"
 
@@ -41,7 +45,11 @@
 #define HID_RPT_ID_CC_IN         3   //Consumer Control input report ID
 #define HID_RPT_ID_VENDOR_OUT    4   // Vendor output report ID
 #define HID_RPT_ID_LED_OUT       2  // LED output report ID
+#if (HID_MOUSE_HIRES == true)
+#define HID_RPT_ID_FEATURE       1  // Feature report ID, mouse wheel Resolution Multiplier
+#else
 #define HID_RPT_ID_FEATURE       0  // Feature report ID
+#endif
 
 #define HIDD_APP_ID			0x1812//ATT_SVC_HID
 
@@ -317,6 +325,7 @@ typedef struct {
 
 extern hidd_le_env_t hidd_le_env;
 extern uint8_t hidProtocolMode;
+extern uint8_t hidMouseFeature;
 
 
 void hidd_clcb_alloc (uint16_t conn_id, esp_bd_addr_t bda);
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -13,6 +14,9 @@
 #include "esp_err.h"
 #include "esp_check.h"
 #include "esp_timer.h"
+#include "driver/gpio.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
@@ -22,10 +26,21 @@
 #include "esp_bt_device.h"
 #include "esp_hidd_prf_api.h"
 #include "hid_dev.h"
+#include "pointer_curve.h"
+#include "mouse_agg.h"
+#include "conn_tune.h"
+#include "reconnect.h"
+#include "spsc_ring.h"
+#include "esp_console.h"
 
 // IMU includes
 #include "i2cdev.h"
 #include "icm42670.h"
+#include "imu_filter.h"
+#include "imu_fusion.h"
+#include "imu_calib.h"
+#include "imu_gesture.h"
+#include "lat_trace.h"
 
 static const char *TAG = "LAB4_3";
 
@@ -36,9 +51,117 @@ static const char *TAG = "LAB4_3";
 #define ADDR_GND      ICM42670_I2C_ADDR_GND   // 0x68
 #define ADDR_VCC      ICM42670_I2C_ADDR_VCC   // 0x69
 
-// BLE HID State
+// IMU interrupt: INT1 pulses on every ODR tick while the FIFO holds at least
+// IMU_FIFO_WATERMARK samples, and the ISR wakes imu_mouse_task.
+#define IMU_INT_GPIO        6      // ICM-42670 INT1 (wire to a free GPIO if not routed)
+#define IMU_ODR             ICM42670_ACCEL_ODR_200HZ
+#define IMU_GYRO_ODR        ICM42670_GYRO_ODR_200HZ
+#define IMU_SAMPLE_US       5000   // 1 / 200 Hz
+#define IMU_FIFO_WATERMARK  1      // samples per wake-up, 1 = lowest latency
+#define IMU_INT_TIMEOUT_MS  50     // drain anyway if INT1 stays quiet (pin not wired)
+#define IMU_FIFO_BATCH      32     // samples drained per read
+
+// Pointer input: accel + gyro fused into pitch/roll. The gyro carries fast
+// moves, so the deadband can be much tighter than with the bare accelerometer
+// (0.12 g ~ 6.9 deg) without the cursor creeping from hand tremor.
+#define FUSION_TAU_MS          500    // accel correction time constant
+#define FUSION_ACCEL_GATE_MG   100    // skip accel correction while the hand accelerates
+// Tilt -> speed curve: pointer_curve_defaults (4 deg deadband), replaced by
+// a curve stored in NVS; re-read on every BLE connection
+#define POINTER_NVS_NS         "pointer"
+// 1: move the cursor with the angular rate instead (pointing like a laser)
+#define POINTER_USE_RATE       0
+#define RATE_DEADBAND_MDPS     2000
+#define RATE_COUNTS_PER_DEG    15
+
+// Calibration: gyro bias from any 1 s window the device sits still (at boot
+// and while in use), saved to NVS when it drifts. Accelerometer offset/scale
+// come from lab4_1's six-position routine, stored under the same namespace
+// (both use the +-4 g range).
+#define CALIB_NVS_NS           "imu_calib"
+#define CALIB_BOOT_TIMEOUT_MS  3000
+#define STILL_WINDOW           200    // samples, 1 s
+#define STILL_GYRO_P2P         40     // ~1.2 dps at 32.8 LSB/dps
+#define STILL_ACCEL_P2P        100    // ~12 mg at 8192 LSB/g
+#define GYRO_BIAS_SAVE_LSB     8      // ~0.25 dps
+
+// Gestures (counts at 200 Hz, accel 8192 LSB/g, gyro 32.8 LSB/dps):
+// tap = left click, or drop a drag; double tap = start a drag;
+// flick about X = scroll; twist about Z = right click
+#define TAP_JERK               2400   // ~0.3 g change between samples
+#define TAP_GYRO_MAX           3000   // ~90 dps summed over axes
+#define TAP_MAX_LEN            4      // 20 ms
+#define TAP_QUIET              10     // 50 ms
+#define DOUBLE_TAP_GAP         60     // 300 ms
+#define GESTURE_DECIMATE       2      // DTW at 100 Hz
+#define GESTURE_TEMPLATE_LEN   16     // 160 ms out-and-back
+#define GESTURE_PEAK           6560   // 200 dps
+#define GESTURE_DTW_THRESHOLD  2500   // per step, standing still scores ~4200
+#define WHEEL_STEP             2      // detents per flick
+
+enum { GESTURE_FLICK_UP = 1, GESTURE_FLICK_DOWN, GESTURE_TWIST };
+
+#define MOUSE_BTN_LEFT         0x01
+#define MOUSE_BTN_RIGHT        0x02
+
+// Reports are merged to one per connection interval; until the central
+// reports its parameters assume a typical HID interval
+#define CONN_INTERVAL_DEFAULT_US  15000
+
+// Connection parameters: 7.5-15 ms without slave latency while the cursor
+// moves, 60-75 ms with latency 4 once it has rested for CONN_RELAX_MS
+#define CONN_ACTIVE_MIN_INT    6      // 1.25 ms units
+#define CONN_ACTIVE_MAX_INT    12
+#define CONN_IDLE_MIN_INT      48
+#define CONN_IDLE_MAX_INT      60
+#define CONN_IDLE_LATENCY      4
+#define CONN_TIMEOUT           400    // 10 ms units, 4 s
+#define CONN_RELAX_MS          2000
+#define CONN_RETRY_MS          2000   // first request after connecting, and between requests
+#define CONN_LOG_S             10
+
+// Reconnect: high duty directed advertising to the last bonded host, then
+// fast undirected (hidd_adv_params) for RECONNECT_FAST_MS, then slow
+#define RECONNECT_NVS_NS       "reconnect"
+#define RECONNECT_DIRECTED_MS  1200   // under the controller's 1.28 s high duty directed limit
+#define RECONNECT_FAST_MS      30000
+#define ADV_SLOW_INT_MIN       0x0320 // 500 ms
+#define ADV_SLOW_INT_MAX       0x0400 // 640 ms
+
+// Idle policy: after IDLE_TIMEOUT_S without cursor movement the accelerometer
+// drops to low-power wake-on-motion, the task stops reporting and waits for
+// INT1, and the CPU is free to enter automatic light sleep. The same state is
+// held from boot until a host connects, and again while advertising after a
+// link loss; streaming starts only once connected. The WoM status is
+// also polled every IDLE_POLL_MS, so motion still wakes the mouse when INT1
+// is not wired (or a pulse was missed), at the cost of that much latency.
+// Resuming is not immediate either way: WoM compares samples at IDLE_ODR and
+// the gyro needs tens of ms to start up, so the first reports after a wake
+// carry accel-only samples or none at all.
+#define IDLE_TIMEOUT_S      30
+#define IDLE_ODR            ICM42670_ACCEL_ODR_50HZ
+#define IDLE_POLL_MS        200
+#define WOM_THRESHOLD       13     // ~50 mg change between samples (3.9 mg/LSB)
+
+// Motion goes from the IMU task to the HID task through a lock-free ring,
+// so a slow notification never delays the next FIFO read. The HID task runs
+// below the IMU task and owns the aggregator and the connection tuning.
+#define MOUSE_RING_SIZE        32     // events, one per FIFO batch at most
+#define HID_TASK_PRIO          4      // below imu_mouse (5)
+#define HID_TX_POLL_MS         100    // wake-up without events: pacing, link upkeep
+
+// Latency tracing: every FIFO batch starts a trace at INT1 (data ready) and
+// the report carrying its motion ends it at the notification confirm; the
+// `lat` console command prints p50/p99 per point
+#define LAT_BUCKET_US          250    // histogram resolution, 16 ms range
+
+enum { LAT_READY, LAT_READ, LAT_FILTER, LAT_ENQUEUE, LAT_NOTIFY, LAT_CONFIRM, LAT_POINTS };
+
+// BLE HID State; hid_conn_id is published by the store to `connected`
 static uint16_t hid_conn_id = 0;
-static bool connected = false;
+static atomic_bool connected = false;
+static conn_tune_t conn;
+static reconnect_t reconnect;
 
 #define HIDD_DEVICE_NAME "ESP32 Air Mouse"
 
@@ -72,101 +195,224 @@ static esp_ble_adv_params_t hidd_adv_params = {
     .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
-// Inclination levels for speed control
-typedef enum {
-    TILT_NONE = 0,
-    TILT_A_BIT,     // Small tilt - slow movement
-    TILT_A_LOT      // Large tilt - fast movement
-} tilt_level_t;
+static const esp_ble_adv_params_t hidd_adv_slow_params = {
+    .adv_int_min = ADV_SLOW_INT_MIN,
+    .adv_int_max = ADV_SLOW_INT_MAX,
+    .adv_type = ADV_TYPE_IND,
+    .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+    .channel_map = ADV_CHNL_ALL,
+    .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
 
-// Direction state for acceleration tracking
+// One batch worth of input for the HID task
 typedef struct {
-    int64_t start_time_ms;  // When this direction started
-    tilt_level_t level;
-    bool active;
-} direction_state_t;
-
-static direction_state_t dir_x = {0};
-static direction_state_t dir_y = {0};
-
-// Moving average filter (from lab4_1)
-typedef struct { float bx[8], by[8], bz[8]; int idx, n; } sma8_t;
-static void sma8_init(sma8_t *f){ memset(f,0,sizeof(*f)); }
-static void sma8_push(sma8_t *f, float x, float y, float z){
-    f->bx[f->idx]=x; f->by[f->idx]=y; f->bz[f->idx]=z;
-    f->idx=(f->idx+1)&7; if(f->n<8) f->n++;
-}
-static void sma8_get(const sma8_t *f, float *x, float *y, float *z){
-    int n=f->n?f->n:1; float sx=0,sy=0,sz=0;
-    for(int i=0;i<n;i++){ sx+=f->bx[i]; sy+=f->by[i]; sz+=f->bz[i]; }
-    *x=sx/n; *y=sy/n; *z=sz/n;
-}
+    int32_t dx_q16;
+    int32_t dy_q16;
+    int16_t wheel;          // detents
+    uint8_t buttons;
+    uint8_t flags;
+    uint32_t trace;         // latency trace of the oldest batch merged in
+} mouse_event_t;
+
+#define MOUSE_EV_BUTTONS       0x01   // `buttons` is a new state
+#define MOUSE_EV_RESET         0x02   // new connection: drop pending motion, buttons up
 
-static inline float lsb_per_g(icm42670_accel_fsr_t r){
+SPSC_RING_DEFINE(mouse_ring, mouse_event_t, MOUSE_RING_SIZE)
+static mouse_ring_t mouse_ring;
+
+static const char *const lat_names[LAT_POINTS] = {
+    "data ready", "sample read", "filter out", "enqueue", "notify", "confirm",
+};
+static lat_trace_t lat;
+// INT1 time from the ISR: the low 32 bits of esp_timer (one store, cannot
+// tear on the 32-bit core), widened again by the task
+static atomic_uint imu_int_us;
+// INT1 is a level wake-up source (idle): the ISR masks it until the task
+// has read the interrupt status, or it would fire for as long as INT1 is high
+static atomic_bool imu_int_level;
+
+// Tilt pointer: compiled curve and per-axis hold time / sub-count remainder,
+// the button state and the event being built; all owned by the IMU task
+static pointer_curve_t curve;
+static pointer_axis_t ptr_x, ptr_y;
+static uint8_t mouse_buttons;
+static mouse_event_t mouse_pending;
+static uint32_t batch_trace;
+static atomic_uint mouse_ring_full;
+static atomic_bool new_connection = true;
+
+// Report aggregator, owned by the HID task
+static mouse_agg_t mouse_agg;
+static TaskHandle_t hid_task_handle = NULL;
+static uint32_t report_trace;
+
+static TaskHandle_t imu_task_handle = NULL;
+static imu_gesture_t gestures;
+
+#if CONFIG_PM_ENABLE
+// Held while streaming: a posedge on INT1 cannot wake the chip from light sleep.
+// Not held while idle or while no host is connected
+static esp_pm_lock_handle_t imu_pm_lock;
+#endif
+
+// Rate mode smoothing: strong at rest, little lag on quick flicks
+IMU_ONE_EURO_DEFINE(rate_euro, float, 2)
+
+static inline uint16_t lsb_per_g(icm42670_accel_fsr_t r){
     switch(r){
-        case ICM42670_ACCEL_RANGE_2G:  return 16384.0f;
-        case ICM42670_ACCEL_RANGE_4G:  return 8192.0f;
-        case ICM42670_ACCEL_RANGE_8G:  return 4096.0f;
-        default /*16G*/:               return 2048.0f;
+        case ICM42670_ACCEL_RANGE_2G:  return 16384;
+        case ICM42670_ACCEL_RANGE_4G:  return 8192;
+        case ICM42670_ACCEL_RANGE_8G:  return 4096;
+        default /*16G*/:               return 2048;
     }
 }
 
-// Determine tilt level from acceleration value
-static tilt_level_t get_tilt_level(float g_value) {
-    float abs_g = fabsf(g_value);
+static inline uint16_t gyro_lsb_per_dps_x10(icm42670_gyro_fsr_t r){
+    switch(r){
+        case ICM42670_GYRO_RANGE_250DPS:  return 1310;
+        case ICM42670_GYRO_RANGE_500DPS:  return 655;
+        case ICM42670_GYRO_RANGE_1000DPS: return 328;
+        default /*2000DPS*/:              return 164;
+    }
+}
 
-    if (abs_g < 0.12f) {
-        return TILT_NONE;  // Deadband
-    } else if (abs_g < 0.35f) {
-        return TILT_A_BIT;  // Small tilt
-    } else {
-        return TILT_A_LOT;  // Large tilt
+static void pointer_curve_reload(void)
+{
+    pointer_curve_config_t cfg = pointer_curve_defaults;
+    if (pointer_curve_load(&cfg, POINTER_NVS_NS) == ESP_OK) {
+        ESP_LOGI(TAG, "Pointer curve loaded from NVS (%d points)", cfg.n_points);
+    }
+    if (pointer_curve_build(&curve, &cfg) != ESP_OK) {
+        pointer_curve_build(&curve, &pointer_curve_defaults);
     }
+    pointer_axis_reset(&ptr_x);
+    pointer_axis_reset(&ptr_y);
 }
 
-// Calculate mouse delta with acceleration
-static int8_t calculate_mouse_delta(direction_state_t *dir, float g_value) {
-    tilt_level_t new_level = get_tilt_level(g_value);
-    int64_t now_ms = esp_timer_get_time() / 1000;
+// HID task: send every report the aggregator has due; returns how many were due
+static int flush_mouse_reports(void)
+{
+    mouse_report_t r;
+    int n = 0, sent = 0;
 
-    // Check if direction changed or stopped
-    if (new_level == TILT_NONE || !dir->active) {
-        dir->active = (new_level != TILT_NONE);
-        dir->level = new_level;
-        dir->start_time_ms = now_ms;
-        return 0;
+    mouse_agg_set_interval(&mouse_agg, atomic_load_explicit(&conn.interval_us, memory_order_relaxed));
+    mouse_agg_set_limit(&mouse_agg, esp_hidd_mouse_max_delta());
+    while (mouse_agg_pop(&mouse_agg, esp_timer_get_time(), &r)) {
+        if (atomic_load(&connected)) {
+            // hid_dev records the trace before the notification goes out and
+            // hands it back with the confirm; a held or merged report keeps it.
+            // Only notifications that went out count towards the rate
+            if (esp_hidd_send_mouse_hires_value(hid_conn_id, r.buttons, r.x, r.y, r.wheel, report_trace)) {
+                if (report_trace) {
+                    lat_trace_mark(&lat, report_trace, LAT_NOTIFY, esp_timer_get_time());
+                }
+                sent++;
+            }
+        }
+        report_trace = 0;
+        n++;
     }
+    conn_tune_count_notify(&conn, sent, esp_timer_get_time());
+    return n;
+}
 
-    // Update level if changed
-    if (new_level != dir->level) {
-        dir->level = new_level;
-        dir->start_time_ms = now_ms;
+// IMU task: hand the pending event to the HID task. On a full ring it stays
+// pending and later motion merges into it, the sampling loop never waits.
+static void post_mouse_event(void)
+{
+    if (!mouse_pending.dx_q16 && !mouse_pending.dy_q16 && !mouse_pending.wheel && !mouse_pending.flags) {
+        return;
+    }
+    if (!mouse_pending.trace) {
+        mouse_pending.trace = batch_trace;
+    }
+    if (mouse_ring_push(&mouse_ring, &mouse_pending)) {
+        lat_trace_mark(&lat, mouse_pending.trace, LAT_ENQUEUE, esp_timer_get_time());
+        memset(&mouse_pending, 0, sizeof(mouse_pending));
+        xTaskNotifyGive(hid_task_handle);
+    } else {
+        atomic_fetch_add_explicit(&mouse_ring_full, 1, memory_order_relaxed);
     }
+}
 
-    // Calculate time held in this direction (in ms)
-    int64_t duration_ms = now_ms - dir->start_time_ms;
+static void set_mouse_buttons(uint8_t buttons)
+{
+    // Motion so far goes first, so the click lands where the cursor was
+    post_mouse_event();
+    if (mouse_pending.flags & MOUSE_EV_BUTTONS) {
+        ESP_LOGW(TAG, "Mouse ring full, button state 0x%02x lost", mouse_pending.buttons);
+    }
+    mouse_buttons = buttons;
+    mouse_pending.buttons = buttons;
+    mouse_pending.flags |= MOUSE_EV_BUTTONS;
+    post_mouse_event();
+}
 
-    // Base speed depends on tilt level
-    int base_speed = (dir->level == TILT_A_BIT) ? 3 : 8;
+static void send_mouse_click(uint8_t button)
+{
+    set_mouse_buttons(mouse_buttons | button);
+    set_mouse_buttons(mouse_buttons & ~button);
+}
 
-    // Acceleration multiplier based on duration
-    int accel_mult = 1;
-    if (duration_ms > 500) {
-        accel_mult = 3;  // 3x after 500ms
-    } else if (duration_ms > 200) {
-        accel_mult = 2;  // 2x after 200ms
+// Out-and-back gyro pulse on one axis, the shape of a flick or twist
+static void gesture_template(imu_gesture_template_t *tpl, uint8_t id, int axis, int peak)
+{
+    memset(tpl, 0, sizeof(*tpl));
+    tpl->id = id;
+    tpl->len = GESTURE_TEMPLATE_LEN;
+    tpl->threshold = GESTURE_DTW_THRESHOLD;
+    for (int i = 0; i < tpl->len; i++) {
+        tpl->seq[i][axis] = (int16_t)lrintf(peak * sinf(2 * (float)M_PI * i / (tpl->len - 1)));
     }
+}
 
-    int delta = base_speed * accel_mult;
+static void gesture_init(void)
+{
+    const imu_gesture_config_t cfg = {
+        .tap_jerk = TAP_JERK,
+        .tap_gyro_max = TAP_GYRO_MAX,
+        .tap_max_len = TAP_MAX_LEN,
+        .tap_quiet = TAP_QUIET,
+        .double_tap_gap = DOUBLE_TAP_GAP,
+        .decimate = GESTURE_DECIMATE,
+    };
+    imu_gesture_template_t tpl;
 
-    // Apply direction (negative for left/down)
-    return (g_value > 0) ? delta : -delta;
+    ESP_ERROR_CHECK(imu_gesture_init(&gestures, &cfg));
+    gesture_template(&tpl, GESTURE_FLICK_UP, 0, GESTURE_PEAK);
+    ESP_ERROR_CHECK(imu_gesture_add_template(&gestures, &tpl));
+    gesture_template(&tpl, GESTURE_FLICK_DOWN, 0, -GESTURE_PEAK);
+    ESP_ERROR_CHECK(imu_gesture_add_template(&gestures, &tpl));
+    gesture_template(&tpl, GESTURE_TWIST, 2, GESTURE_PEAK);
+    ESP_ERROR_CHECK(imu_gesture_add_template(&gestures, &tpl));
 }
 
-static void send_mouse_move(int8_t x, int8_t y)
+static void handle_gesture(const imu_gesture_event_t *ev)
 {
-    if (connected) {
-        esp_hidd_send_mouse_value(hid_conn_id, 0, x, y);
+    switch (ev->type) {
+    case IMU_GESTURE_TAP:
+        if (mouse_buttons & MOUSE_BTN_LEFT) {
+            ESP_LOGI(TAG, "Drag end");
+            set_mouse_buttons(mouse_buttons & ~MOUSE_BTN_LEFT);
+        } else {
+            send_mouse_click(MOUSE_BTN_LEFT);
+        }
+        break;
+    case IMU_GESTURE_DOUBLE_TAP:
+        ESP_LOGI(TAG, "Drag start");
+        set_mouse_buttons(mouse_buttons | MOUSE_BTN_LEFT);
+        break;
+    case IMU_GESTURE_TEMPLATE:
+        if (ev->id == GESTURE_FLICK_UP) {
+            mouse_pending.wheel += WHEEL_STEP;
+        } else if (ev->id == GESTURE_FLICK_DOWN) {
+            mouse_pending.wheel -= WHEEL_STEP;
+        } else if (ev->id == GESTURE_TWIST) {
+            send_mouse_click(MOUSE_BTN_RIGHT);
+        }
+        break;
+    default:
+        break;
     }
 }
 
@@ -183,16 +429,24 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
     case ESP_HIDD_EVENT_BLE_CONNECT: {
         ESP_LOGI(TAG, "BLE HID Connected");
         hid_conn_id = param->connect.conn_id;
-        connected = true;
-        // Reset direction states on new connection
-        dir_x.active = false;
-        dir_y.active = false;
+        reconnect_connected(&reconnect);
+        conn_tune_connected(&conn, param->connect.remote_bda);
+        atomic_store(&connected, true);
+        // Pick up a new curve, start the axes from rest and release buttons
+        atomic_store(&new_connection, true);
         break;
     }
     case ESP_HIDD_EVENT_BLE_DISCONNECT: {
-        connected = false;
+        atomic_store(&connected, false);
+        conn_tune_disconnected(&conn);
         ESP_LOGI(TAG, "BLE HID Disconnected");
-        esp_ble_gap_start_advertising(&hidd_adv_params);
+        reconnect_start(&reconnect);
+        break;
+    }
+    case ESP_HIDD_EVENT_BLE_REPORT_CONF_EVT: {
+        if (param->report_conf.report_id == HID_RPT_ID_MOUSE_IN && param->report_conf.tag) {
+            lat_trace_mark(&lat, param->report_conf.tag, LAT_CONFIRM, esp_timer_get_time());
+        }
         break;
     }
     default:
@@ -202,20 +456,179 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
 
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
+    reconnect_on_gap_event(&reconnect, event, param);
+
     switch (event) {
     case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-        esp_ble_gap_start_advertising(&hidd_adv_params);
+        reconnect_start(&reconnect);
         break;
     case ESP_GAP_BLE_SEC_REQ_EVT:
         esp_ble_gap_security_rsp(param->ble_security.ble_req.bd_addr, true);
         break;
     case ESP_GAP_BLE_AUTH_CMPL_EVT:
         break;
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        conn_tune_on_update(&conn, param);
+        break;
     default:
         break;
     }
 }
 
+static void IRAM_ATTR imu_int_isr_handler(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    atomic_store_explicit(&imu_int_us, (uint32_t)esp_timer_get_time(), memory_order_relaxed);
+    if (atomic_load_explicit(&imu_int_level, memory_order_relaxed)) {
+        gpio_intr_disable(IMU_INT_GPIO);  // re-enabled by imu_exit_idle()
+    }
+    vTaskNotifyGiveFromISR(imu_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void imu_int_gpio_init(void)
+{
+    gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_POSEDGE,
+        .mode = GPIO_MODE_INPUT,
+        .pin_bit_mask = 1ULL << IMU_INT_GPIO,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+    };
+    gpio_config(&io_conf);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(IMU_INT_GPIO, imu_int_isr_handler, NULL);
+}
+
+// Accel + gyro into the FIFO at IMU_ODR, FIFO watermark routed to INT1
+static esp_err_t imu_configure(icm42670_t *imu, icm42670_accel_fsr_t range, icm42670_gyro_fsr_t gyro_range)
+{
+    const icm42670_fifo_config_t fifo_cfg = {
+        .mode = ICM42670_FIFO_MODE_STREAM,
+        .packet = ICM42670_FIFO_PACKET_ACCEL_GYRO,
+        .watermark = IMU_FIFO_WATERMARK,
+        .timestamp_resolution = ICM42670_TMST_RES_1US,
+    };
+    const icm42670_int_config_t int_cfg = {
+        .mode = ICM42670_INT_MODE_PULSED,
+        .drive = ICM42670_INT_DRIVE_PUSH_PULL,
+        .polarity = ICM42670_INT_POLARITY_ACTIVE_HIGH,
+    };
+    const icm42670_int_source_t int_src = { .fifo_threshold = true };
+    const icm42670_wom_config_t wom_cfg = {
+        .trigger = ICM42670_WOM_INT_DUR_FIRST,
+        .logical_mode = ICM42670_WOM_INT_MODE_ALL_OR,
+        .reference = ICM42670_WOM_MODE_REF_LAST,
+        .wom_x_threshold = WOM_THRESHOLD,
+        .wom_y_threshold = WOM_THRESHOLD,
+        .wom_z_threshold = WOM_THRESHOLD,
+    };
+
+    ESP_RETURN_ON_ERROR(icm42670_enable_wom(imu, false), TAG, "wom disable");
+    ESP_RETURN_ON_ERROR(icm42670_config_wom(imu, wom_cfg), TAG, "wom");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_fsr(imu, range), TAG, "accel fsr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_avg(imu, ICM42670_ACCEL_AVG_8X), TAG, "accel avg");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_odr(imu, IMU_ODR), TAG, "accel odr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_fsr(imu, gyro_range), TAG, "gyro fsr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_odr(imu, IMU_GYRO_ODR), TAG, "gyro odr");
+    ESP_RETURN_ON_ERROR(icm42670_config_fifo(imu, fifo_cfg), TAG, "fifo");
+    ESP_RETURN_ON_ERROR(icm42670_config_int_pin(imu, 1, int_cfg), TAG, "int pin");
+    ESP_RETURN_ON_ERROR(icm42670_set_int_sources(imu, 1, int_src), TAG, "int sources");
+    ESP_RETURN_ON_ERROR(icm42670_enable_fifo(imu, true), TAG, "fifo enable");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_pwr_mode(imu, ICM42670_ACCEL_ENABLE_LN_MODE), TAG, "accel pwr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_pwr_mode(imu, ICM42670_GYRO_ENABLE_LN_MODE), TAG, "gyro pwr");
+    return ESP_OK;
+}
+
+// Streaming -> low-power wake-on-motion, INT1 now pulses on motion only.
+// The PM lock goes first so that it stays balanced with imu_exit_idle()
+// even when the IMU does not answer
+static esp_err_t imu_enter_idle(icm42670_t *imu)
+{
+    const icm42670_int_source_t int_src = { .wom_x = true, .wom_y = true, .wom_z = true };
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(imu_pm_lock);
+#endif
+    ESP_RETURN_ON_ERROR(icm42670_enable_fifo(imu, false), TAG, "fifo bypass");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_pwr_mode(imu, ICM42670_GYRO_DISABLE), TAG, "gyro pwr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_odr(imu, IDLE_ODR), TAG, "accel odr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_pwr_mode(imu, ICM42670_ACCEL_ENABLE_LP_MODE), TAG, "accel pwr");
+    ESP_RETURN_ON_ERROR(icm42670_set_int_sources(imu, 1, int_src), TAG, "int sources");
+    ESP_RETURN_ON_ERROR(icm42670_enable_wom(imu, true), TAG, "wom enable");
+
+    // Light sleep only wakes on GPIO levels; the first ISR masks the level
+    // interrupt so the 100 us INT1 pulse is taken once
+    atomic_store(&imu_int_level, true);
+    gpio_wakeup_enable(IMU_INT_GPIO, GPIO_INTR_HIGH_LEVEL);
+    return ESP_OK;
+}
+
+// Wake-on-motion -> streaming; the FIFO configuration is kept from imu_configure()
+static esp_err_t imu_exit_idle(icm42670_t *imu)
+{
+    const icm42670_int_source_t int_src = { .fifo_threshold = true };
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(imu_pm_lock);
+#endif
+    gpio_wakeup_disable(IMU_INT_GPIO);
+    gpio_set_intr_type(IMU_INT_GPIO, GPIO_INTR_POSEDGE);
+    atomic_store(&imu_int_level, false);
+
+    // Clear the WoM status before the edge interrupt is unmasked again
+    bool wom;
+    esp_err_t err = icm42670_enable_wom(imu, false);
+    if (err == ESP_OK) {
+        err = icm42670_get_wom_status(imu, &wom);
+    }
+    gpio_intr_enable(IMU_INT_GPIO);
+    ESP_RETURN_ON_ERROR(err, TAG, "wom disable");
+    ESP_RETURN_ON_ERROR(icm42670_set_int_sources(imu, 1, int_src), TAG, "int sources");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_odr(imu, IMU_ODR), TAG, "accel odr");
+    ESP_RETURN_ON_ERROR(icm42670_set_accel_pwr_mode(imu, ICM42670_ACCEL_ENABLE_LN_MODE), TAG, "accel pwr");
+    ESP_RETURN_ON_ERROR(icm42670_set_gyro_pwr_mode(imu, ICM42670_GYRO_ENABLE_LN_MODE), TAG, "gyro pwr");
+    ESP_RETURN_ON_ERROR(icm42670_enable_fifo(imu, true), TAG, "fifo enable");
+    return ESP_OK;
+}
+
+// Still window -> fresh gyro bias, persisted only when it moved noticeably
+static void imu_recheck_bias(imu_calib_t *cal, const imu_still_t *still)
+{
+    if (imu_calib_update_gyro_bias(cal, still, GYRO_BIAS_SAVE_LSB)) {
+        ESP_LOGI(TAG, "Gyro bias %d %d %d LSB", cal->gyro_bias[0], cal->gyro_bias[1], cal->gyro_bias[2]);
+        if (imu_calib_save(cal, CALIB_NVS_NS) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save calibration");
+        }
+    }
+}
+
+// Boot-time gyro bias: wait up to CALIB_BOOT_TIMEOUT_MS for one still window,
+// otherwise keep the stored bias and let the in-use recheck catch up
+static void imu_boot_calibrate(icm42670_t *imu, imu_calib_t *cal, imu_still_t *still,
+                               icm42670_fifo_sample_t *samples)
+{
+    int64_t deadline_us = esp_timer_get_time() + CALIB_BOOT_TIMEOUT_MS * 1000LL;
+
+    icm42670_flush_fifo(imu);
+    while (esp_timer_get_time() < deadline_us) {
+        vTaskDelay(pdMS_TO_TICKS(IMU_INT_TIMEOUT_MS));
+
+        size_t n = 0;
+        if (icm42670_read_fifo(imu, samples, IMU_FIFO_BATCH, &n) != ESP_OK) continue;
+        for (size_t i = 0; i < n; i++) {
+            if (!samples[i].accel_valid || !samples[i].gyro_valid) continue;
+            const int16_t accel[3] = { samples[i].accel.x, samples[i].accel.y, samples[i].accel.z };
+            const int16_t gyro[3] = { samples[i].gyro.x, samples[i].gyro.y, samples[i].gyro.z };
+            if (imu_calib_still_feed(still, accel, gyro)) {
+                imu_recheck_bias(cal, still);
+                return;
+            }
+        }
+    }
+    ESP_LOGW(TAG, "Not still at boot, using stored gyro bias");
+}
+
 static esp_err_t imu_try_init(icm42670_t *imu, uint8_t addr){
     icm42670_free_desc(imu);
     ESP_RETURN_ON_ERROR(
@@ -245,32 +658,122 @@ static void imu_mouse_task(void *arg)
     }
     ESP_LOGI(TAG, "ICM-42670 detected @0x%02X", addr);
 
-    // Configure accelerometer (ignore errors, will retry on I2C failures later)
+    // Configure accelerometer and gyro (ignore errors, will retry on I2C failures later)
     const icm42670_accel_fsr_t RANGE = ICM42670_ACCEL_RANGE_4G;
-    icm42670_set_accel_fsr(&imu, RANGE);
-    icm42670_set_accel_avg(&imu, ICM42670_ACCEL_AVG_8X);
-    icm42670_set_accel_odr(&imu, ICM42670_ACCEL_ODR_200HZ);
-    icm42670_set_accel_pwr_mode(&imu, ICM42670_ACCEL_ENABLE_LN_MODE);
+    const icm42670_gyro_fsr_t GYRO_RANGE = ICM42670_GYRO_RANGE_1000DPS;
+    imu_configure(&imu, RANGE, GYRO_RANGE);
+    imu_int_gpio_init();
+
+    // Streaming through the boot calibration; the loop below idles the IMU
+    // and releases the lock until a host connects
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "imu_stream", &imu_pm_lock);
+    esp_pm_lock_acquire(imu_pm_lock);
+#endif
+    esp_sleep_enable_gpio_wakeup();
 
-    const float inv_lsb_g = 1.0f / lsb_per_g(RANGE);
-    sma8_t filt;
-    sma8_init(&filt);
+    const imu_fusion_config_t fusion_cfg = {
+        .algo = IMU_FUSION_COMPLEMENTARY,
+        .accel_lsb_per_g = lsb_per_g(RANGE),
+        .gyro_lsb_per_dps_x10 = gyro_lsb_per_dps_x10(GYRO_RANGE),
+        .tau_ms = FUSION_TAU_MS,
+        .accel_gate_mg = FUSION_ACCEL_GATE_MG,
+        .beta = 0.1f,
+    };
+    imu_fusion_t fusion;
+    ESP_ERROR_CHECK(imu_fusion_init(&fusion, &fusion_cfg));
+    uint64_t last_sample_us = 0;
+    static icm42670_fifo_sample_t samples[IMU_FIFO_BATCH];
 
-    ESP_LOGI(TAG, "Waiting for BLE connection...");
-    while (!connected) {
-        vTaskDelay(pdMS_TO_TICKS(100));
+    imu_calib_t cal;
+    imu_calib_init(&cal);
+    if (imu_calib_load(&cal, CALIB_NVS_NS) == ESP_OK) {
+        ESP_LOGI(TAG, "Loaded calibration (flags 0x%x)", cal.flags);
     }
-    ESP_LOGI(TAG, "BLE connected! Air mouse active!");
+    imu_still_t still;
+    imu_calib_still_init(&still, STILL_WINDOW, STILL_GYRO_P2P, STILL_ACCEL_P2P);
+    imu_boot_calibrate(&imu, &cal, &still, samples);
+    gesture_init();
+
+    rate_euro_t rate_filt;
+    rate_euro_init(&rate_filt, 1.0f, 0.005f, 1.0f);
 
     int consecutive_fail = 0;
+    bool int_seen = false;
+    int64_t last_motion_us = esp_timer_get_time();
 
     while (1) {
-        int16_t rx=0, ry=0, rz=0;
-        esp_err_t e = ESP_OK;
+        if (atomic_exchange(&new_connection, false)) {
+            pointer_curve_reload();
+            mouse_buttons = 0;
+            memset(&mouse_pending, 0, sizeof(mouse_pending));
+            mouse_pending.flags = MOUSE_EV_RESET;
+            post_mouse_event();
+        }
 
-        e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_X1, &rx);
-        if (e == ESP_OK) e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_Y1, &ry);
-        if (e == ESP_OK) e = icm42670_read_raw_data(&imu, ICM42670_REG_ACCEL_DATA_Z1, &rz);
+        // No host (boot, or advertising after a link loss) or no motion: the
+        // IMU drops to wake-on-motion and the CPU may light sleep. Without a
+        // host only the connection ends it, there is nobody to report to
+        bool link_down = !atomic_load(&connected);
+        if (link_down || esp_timer_get_time() - last_motion_us > IDLE_TIMEOUT_S * 1000000LL) {
+            if (link_down) {
+                ESP_LOGI(TAG, "Waiting for BLE connection...");
+            } else {
+                ESP_LOGI(TAG, "No motion for %d s, idling until wake-on-motion", IDLE_TIMEOUT_S);
+            }
+            bool idle = imu_enter_idle(&imu) == ESP_OK;
+            ulTaskNotifyTake(pdTRUE, 0);  // drop FIFO wake-ups still pending
+            if (link_down) {
+                while (!atomic_load(&connected)) {
+                    vTaskDelay(pdMS_TO_TICKS(100));
+                }
+                ESP_LOGI(TAG, "BLE connected! Air mouse active!");
+            } else if (idle) {
+                bool wom = false;
+                while (!wom && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_POLL_MS)) == 0) {
+                    if (icm42670_get_wom_status(&imu, &wom) != ESP_OK) {
+                        wom = false;
+                    }
+                }
+                ESP_LOGI(TAG, "Motion detected, resuming");
+            }
+            // Streaming restarts from an empty FIFO: enabling it resets it
+            if (imu_exit_idle(&imu) != ESP_OK) {
+                imu_configure(&imu, RANGE, GYRO_RANGE);
+            }
+            ulTaskNotifyTake(pdTRUE, 0);
+            pointer_axis_reset(&ptr_x);
+            pointer_axis_reset(&ptr_y);
+            imu_fusion_reset(&fusion);
+            last_sample_us = 0;
+            imu_calib_still_init(&still, STILL_WINDOW, STILL_GYRO_P2P, STILL_ACCEL_P2P);
+            imu_gesture_reset(&gestures);
+            last_motion_us = esp_timer_get_time();
+            continue;
+        }
+
+        // Sleep until INT1 reports the FIFO watermark; the timeout only
+        // matters when the interrupt line is not connected
+        int64_t ready_us;
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IMU_INT_TIMEOUT_MS)) > 0) {
+            int_seen = true;
+            ready_us = esp_timer_get_time();
+            ready_us -= (uint32_t)((uint32_t)ready_us - atomic_load_explicit(&imu_int_us, memory_order_relaxed));
+        } else {
+            if (int_seen) {
+                ESP_LOGW(TAG, "IMU interrupt timeout, draining FIFO");
+                int_seen = false;
+            }
+            ready_us = esp_timer_get_time();
+        }
+
+        size_t n = 0;
+        esp_err_t e = icm42670_read_fifo(&imu, samples, IMU_FIFO_BATCH, &n);
+        batch_trace = 0;
+        if (e == ESP_OK && n > 0) {
+            batch_trace = lat_trace_begin(&lat, ready_us);
+            lat_trace_mark(&lat, batch_trace, LAT_READ, esp_timer_get_time());
+        }
 
         if (e != ESP_OK) {
             if (++consecutive_fail >= 5) {
@@ -280,10 +783,7 @@ static void imu_mouse_task(void *arg)
                     uint8_t other = (addr==ADDR_GND)?ADDR_VCC:ADDR_GND;
                     if (imu_try_init(&imu, other) == ESP_OK) addr = other;
                 }
-                icm42670_set_accel_fsr(&imu, RANGE);
-                icm42670_set_accel_avg(&imu, ICM42670_ACCEL_AVG_8X);
-                icm42670_set_accel_odr(&imu, ICM42670_ACCEL_ODR_200HZ);
-                icm42670_set_accel_pwr_mode(&imu, ICM42670_ACCEL_ENABLE_LN_MODE);
+                imu_configure(&imu, RANGE, GYRO_RANGE);
                 consecutive_fail = 0;
             }
             vTaskDelay(pdMS_TO_TICKS(20));
@@ -292,30 +792,179 @@ static void imu_mouse_task(void *arg)
 
         consecutive_fail = 0;
 
-        // Convert to g values
-        float gx = rx * inv_lsb_g;
-        float gy = ry * inv_lsb_g;
-        float gz = rz * inv_lsb_g;
+        // Every sample goes through the fusion once, no duplicates or gaps
+        for (size_t i = 0; i < n; i++) {
+            const icm42670_fifo_sample_t *smp = &samples[i];
+            if (!smp->accel_valid || !smp->gyro_valid) continue;
 
-        // Apply smoothing filter
-        sma8_push(&filt, gx, gy, gz);
-        float fx, fy, fz;
-        sma8_get(&filt, &fx, &fy, &fz);
+            // Integrate over the sensor's own sample spacing when available
+            uint32_t dt_us = IMU_SAMPLE_US;
+            if (smp->timestamp_valid) {
+                if (last_sample_us && smp->time_us > last_sample_us
+                        && smp->time_us - last_sample_us < 4 * IMU_SAMPLE_US) {
+                    dt_us = (uint32_t)(smp->time_us - last_sample_us);
+                }
+                last_sample_us = smp->time_us;
+            }
+
+            int16_t accel[3] = { smp->accel.x, smp->accel.y, smp->accel.z };
+            int16_t gyro[3] = { smp->gyro.x, smp->gyro.y, smp->gyro.z };
+
+            // Bias is estimated on raw samples, the fusion sees corrected ones
+            if (imu_calib_still_feed(&still, accel, gyro)) {
+                imu_recheck_bias(&cal, &still);
+            }
+            imu_calib_apply(&cal, accel, gyro);
 
-        // Calculate mouse movement with acceleration
-        // Note: fx = left/right tilt, fy = up/down tilt
-        int8_t mouse_x = calculate_mouse_delta(&dir_x, fx);
-        int8_t mouse_y = calculate_mouse_delta(&dir_y, -fy);  // Negate for natural direction
+            imu_fusion_output_t o;
+            imu_fusion_update(&fusion, accel, gyro, dt_us, &o);
 
-        // Send mouse movement if connected
-        if (connected && (mouse_x != 0 || mouse_y != 0)) {
-            send_mouse_move(mouse_x, mouse_y);
+            imu_gesture_event_t ev[IMU_GESTURE_MAX_EVENTS];
+            int n_ev = imu_gesture_update(&gestures, accel, gyro, ev, IMU_GESTURE_MAX_EVENTS);
+            for (int k = 0; k < n_ev; k++) {
+                handle_gesture(&ev[k]);
+            }
+            if (n_ev) {
+                last_motion_us = esp_timer_get_time();
+            }
+
+#if POINTER_USE_RATE
+            // Pitch rate (about Y) moves X, roll rate (about X) moves Y
+            float rate[2] = { -o.rate_mdps[1], -o.rate_mdps[0] }, r[2];
+            rate_euro_update(&rate_filt, rate, dt_us * 1e-6f, r);
+            for (int a = 0; a < 2; a++) {
+                if (fabsf(r[a]) < RATE_DEADBAND_MDPS) r[a] = 0;
+            }
+            const float q16_per_mdps = dt_us * 1e-9f * RATE_COUNTS_PER_DEG * 65536;
+            mouse_pending.dx_q16 += lrintf(r[0] * q16_per_mdps);
+            mouse_pending.dy_q16 += lrintf(r[1] * q16_per_mdps);
+#else
+            // Tilt through the acceleration curve, integrated over dt_us
+            // Note: pitch = left/right tilt, roll = up/down tilt
+            mouse_pending.dx_q16 += pointer_curve_step(&curve, &ptr_x, -o.pitch_mdeg, dt_us);
+            mouse_pending.dy_q16 += pointer_curve_step(&curve, &ptr_y, -o.roll_mdeg, dt_us);
+#endif
         }
 
-        vTaskDelay(pdMS_TO_TICKS(20));  // 50Hz update rate
+        lat_trace_mark(&lat, batch_trace, LAT_FILTER, esp_timer_get_time());
+
+        // Whatever the batch added goes to the HID task as one event
+        if (mouse_pending.dx_q16 || mouse_pending.dy_q16 || mouse_pending.wheel) {
+            last_motion_us = esp_timer_get_time();
+        }
+        post_mouse_event();
     }
 }
 
+// HID task - merges IMU events into reports paced to the connection interval
+static void hid_tx_task(void *arg)
+{
+    int64_t last_motion_us = esp_timer_get_time();
+    int64_t last_conn_log_us = last_motion_us;
+    uint32_t ring_full_logged = 0;
+    mouse_event_t ev;
+
+    mouse_agg_init(&mouse_agg, atomic_load_explicit(&conn.interval_us, memory_order_relaxed));
+
+    while (1) {
+        // Woken per IMU batch; held-back motion is retried on the next tick
+        ulTaskNotifyTake(pdTRUE, mouse_agg_pending(&mouse_agg) ? 1 : pdMS_TO_TICKS(HID_TX_POLL_MS));
+
+        while (mouse_ring_pop(&mouse_ring, &ev)) {
+            if (ev.flags & MOUSE_EV_RESET) {
+                mouse_agg_init(&mouse_agg, atomic_load_explicit(&conn.interval_us, memory_order_relaxed));
+                report_trace = 0;
+            }
+            if (!report_trace) {
+                report_trace = ev.trace;
+            }
+            if (ev.dx_q16 || ev.dy_q16) {
+                mouse_agg_add_motion(&mouse_agg, ev.dx_q16, ev.dy_q16);
+            }
+            if (ev.wheel) {
+                mouse_agg_add_wheel(&mouse_agg, ev.wheel * esp_hidd_mouse_wheel_resolution());
+            }
+            if (ev.flags & MOUSE_EV_BUTTONS) {
+                // Each button state gets its own report, a click is never merged away
+                mouse_agg_set_buttons(&mouse_agg, ev.buttons);
+                flush_mouse_reports();
+            }
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (flush_mouse_reports() > 0) {
+            last_motion_us = now_us;
+        }
+
+        // Short interval while moving, relaxed one at rest
+        conn_tune_poll(&conn, now_us - last_motion_us < CONN_RELAX_MS * 1000LL, now_us);
+        if (atomic_load(&connected) && now_us - last_conn_log_us > CONN_LOG_S * 1000000LL) {
+            conn_tune_info_t ci;
+            conn_tune_get(&conn, &ci);
+            ESP_LOGI(TAG, "Link %s: interval %lu us, latency %d, %lu reports/s (%lu updates, %lu rejected)",
+                     ci.active ? "active" : "idle", (unsigned long)ci.interval_us, ci.latency,
+                     (unsigned long)ci.notify_per_s, (unsigned long)ci.updates, (unsigned long)ci.rejects);
+            hid_dev_tx_stats_t tx;
+            hid_dev_get_tx_stats(&tx);
+            if (tx.congestions) {
+                ESP_LOGI(TAG, "Congested %lu times: %lu reports held, %lu merged, %lu dropped",
+                         (unsigned long)tx.congestions, (unsigned long)tx.held,
+                         (unsigned long)tx.merged, (unsigned long)tx.dropped);
+            }
+            if (atomic_load_explicit(&mouse_ring_full, memory_order_relaxed) != ring_full_logged) {
+                ring_full_logged = atomic_load_explicit(&mouse_ring_full, memory_order_relaxed);
+                ESP_LOGW(TAG, "Mouse ring was full %lu times", (unsigned long)ring_full_logged);
+            }
+            last_conn_log_us = now_us;
+        }
+    }
+}
+
+// `lat` prints the latency from data ready to each trace point, `lat reset` clears it
+static int lat_cmd(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        lat_trace_reset(&lat);
+        return 0;
+    }
+
+    printf("%-12s %8s %8s %8s %8s\n", "point", "count", "p50 us", "p99 us", "max us");
+    for (int p = LAT_READ; p < LAT_POINTS; p++) {
+        lat_trace_stats_t st;
+        lat_trace_stats(&lat, p, &st);
+        printf("%-12s %8lu %8lu %8lu %8lu\n", lat_names[p], (unsigned long)st.count,
+               (unsigned long)st.p50_us, (unsigned long)st.p99_us, (unsigned long)st.max_us);
+    }
+    return 0;
+}
+
+static void console_init(void)
+{
+#if CONFIG_ESP_CONSOLE_UART || CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "airmouse>";
+#if CONFIG_ESP_CONSOLE_UART
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&uart_config, &repl_config, &repl));
+#else
+    esp_console_dev_usb_serial_jtag_config_t usbjtag_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&usbjtag_config, &repl_config, &repl));
+#endif
+
+    const esp_console_cmd_t cmd = {
+        .command = "lat",
+        .help = "Input latency from IMU data ready, p50/p99 per stage ('lat reset' clears)",
+        .hint = "[reset]",
+        .func = &lat_cmd,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+#else
+    ESP_LOGW(TAG, "No console, latency stats unavailable");
+#endif
+}
+
 void app_main(void)
 {
     esp_err_t ret;
@@ -330,6 +979,18 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    const conn_tune_params_t conn_active = {
+        .min_int = CONN_ACTIVE_MIN_INT, .max_int = CONN_ACTIVE_MAX_INT, .latency = 0, .timeout = CONN_TIMEOUT,
+    };
+    const conn_tune_params_t conn_idle = {
+        .min_int = CONN_IDLE_MIN_INT, .max_int = CONN_IDLE_MAX_INT, .latency = CONN_IDLE_LATENCY,
+        .timeout = CONN_TIMEOUT,
+    };
+    conn_tune_init(&conn, &conn_active, &conn_idle, CONN_INTERVAL_DEFAULT_US, CONN_RETRY_MS * 1000);
+    lat_trace_init(&lat, lat_names, LAT_POINTS, LAT_BUCKET_US);
+    ESP_ERROR_CHECK(reconnect_init(&reconnect, &hidd_adv_params, &hidd_adv_slow_params,
+                                   RECONNECT_DIRECTED_MS, RECONNECT_FAST_MS, RECONNECT_NVS_NS));
+
     ESP_LOGI(TAG, "Initializing Bluetooth...");
 
     // Release classic BT memory
@@ -397,6 +1058,22 @@ void app_main(void)
 
     ESP_LOGI(TAG, "BLE HID initialized. Device name: %s", HIDD_DEVICE_NAME);
 
+#if CONFIG_PM_ENABLE
+    // Automatic light sleep whenever all tasks block (idle mode, between BLE events)
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = 40,
+        .light_sleep_enable = true,
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif
+
+    // HID transmit task first: the IMU task notifies it from its first batch
+    mouse_ring_init(&mouse_ring);
+    xTaskCreatePinnedToCore(hid_tx_task, "hid_tx", 4096, NULL, HID_TASK_PRIO, &hid_task_handle, 0);
+
     // Create IMU mouse control task
-    xTaskCreatePinnedToCore(imu_mouse_task, "imu_mouse", 4096, NULL, 5, NULL, 0);
+    xTaskCreatePinnedToCore(imu_mouse_task, "imu_mouse", 4096, NULL, 5, &imu_task_handle, 0);
+
+    console_init();
 }
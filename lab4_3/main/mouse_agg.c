@@ -0,0 +1,92 @@
+// Mouse report aggregator, see mouse_agg.h
+
+#include <string.h>
+#include "mouse_agg.h"
+
+static inline int32_t sat_add32(int32_t a, int32_t b)
+{
+    int64_t s = (int64_t)a + b;
+    return s > INT32_MAX ? INT32_MAX : (s < INT32_MIN ? INT32_MIN : (int32_t)s);
+}
+
+static inline int32_t clamp(int32_t v, int32_t limit)
+{
+    return v > limit ? limit : (v < -limit ? -limit : v);
+}
+
+void mouse_agg_init(mouse_agg_t *agg, uint32_t interval_us)
+{
+    memset(agg, 0, sizeof(*agg));
+    agg->interval_us = interval_us;
+    agg->limit = INT8_MAX;
+}
+
+void mouse_agg_reset(mouse_agg_t *agg)
+{
+    agg->x_q16 = 0;
+    agg->y_q16 = 0;
+    agg->wheel = 0;
+    agg->buttons = 0;
+    agg->sent_buttons = 0;
+    agg->last_send_us = 0;
+}
+
+void mouse_agg_set_interval(mouse_agg_t *agg, uint32_t interval_us)
+{
+    agg->interval_us = interval_us;
+}
+
+void mouse_agg_set_limit(mouse_agg_t *agg, int16_t limit)
+{
+    agg->limit = limit > 0 ? limit : 1;
+}
+
+void mouse_agg_add_motion(mouse_agg_t *agg, int32_t dx_q16, int32_t dy_q16)
+{
+    agg->x_q16 = sat_add32(agg->x_q16, dx_q16);
+    agg->y_q16 = sat_add32(agg->y_q16, dy_q16);
+    agg->adds++;
+}
+
+void mouse_agg_add_wheel(mouse_agg_t *agg, int32_t clicks)
+{
+    agg->wheel = sat_add32(agg->wheel, clicks);
+}
+
+void mouse_agg_set_buttons(mouse_agg_t *agg, uint8_t buttons)
+{
+    agg->buttons = buttons;
+}
+
+bool mouse_agg_pending(const mouse_agg_t *agg)
+{
+    return agg->x_q16 / 65536 || agg->y_q16 / 65536 || agg->wheel || agg->buttons != agg->sent_buttons;
+}
+
+bool mouse_agg_pop(mouse_agg_t *agg, int64_t now_us, mouse_report_t *report)
+{
+    // whole counts only, the fraction stays behind (truncation towards zero)
+    int32_t x = agg->x_q16 / 65536;
+    int32_t y = agg->y_q16 / 65536;
+
+    bool buttons_changed = agg->buttons != agg->sent_buttons;
+    bool has_motion = x || y || agg->wheel;
+    bool slot_free = now_us - agg->last_send_us >= (int64_t)agg->interval_us;
+
+    if (!buttons_changed && !(has_motion && slot_free)) {
+        return false;
+    }
+
+    report->buttons = agg->buttons;
+    report->x = (int16_t)clamp(x, agg->limit);
+    report->y = (int16_t)clamp(y, agg->limit);
+    report->wheel = (int8_t)clamp(agg->wheel, INT8_MAX);
+
+    agg->x_q16 -= report->x * 65536;
+    agg->y_q16 -= report->y * 65536;
+    agg->wheel -= report->wheel;
+    agg->sent_buttons = agg->buttons;
+    agg->last_send_us = now_us;
+    agg->reports++;
+    return true;
+}
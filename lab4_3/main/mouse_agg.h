@@ -0,0 +1,65 @@
+// Mouse report aggregator
+//
+// Sits between motion generation and the HID send call. Motion is added in
+// 16.16 counts and only whole counts leave, so fractions are never lost.
+// Pending motion is merged into at most one report per connection interval,
+// clamped to the report's X/Y range, and whatever does not fit stays for the
+// next report. Button changes are due at once so clicks are never merged
+// away.
+
+#ifndef MOUSE_AGG_H__
+#define MOUSE_AGG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t wheel;
+} mouse_report_t;
+
+typedef struct {
+    int32_t x_q16;
+    int32_t y_q16;
+    int32_t wheel;
+    uint8_t buttons;
+    uint8_t sent_buttons;
+    uint32_t interval_us;
+    int16_t limit;          // largest |x|, |y| per report
+    int64_t last_send_us;
+    uint32_t adds;          // motion additions, adds - reports were merged
+    uint32_t reports;
+} mouse_agg_t;
+
+void mouse_agg_init(mouse_agg_t *agg, uint32_t interval_us);
+
+// Drop pending motion and release all buttons (e.g. on a new connection)
+void mouse_agg_reset(mouse_agg_t *agg);
+
+// Reports are paced to one per interval, normally the connection interval
+void mouse_agg_set_interval(mouse_agg_t *agg, uint32_t interval_us);
+
+// X/Y range of the report in use, 127 (the default) for 8-bit reports
+void mouse_agg_set_limit(mouse_agg_t *agg, int16_t limit);
+
+void mouse_agg_add_motion(mouse_agg_t *agg, int32_t dx_q16, int32_t dy_q16);
+void mouse_agg_add_wheel(mouse_agg_t *agg, int32_t clicks);
+void mouse_agg_set_buttons(mouse_agg_t *agg, uint8_t buttons);
+
+// Whole counts, wheel or a button change still waiting for a report
+bool mouse_agg_pending(const mouse_agg_t *agg);
+
+// Next report if one is due at now_us; call until it returns false
+bool mouse_agg_pop(mouse_agg_t *agg, int64_t now_us, mouse_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MOUSE_AGG_H__ */
@@ -0,0 +1,209 @@
+// Pointer acceleration curve, see pointer_curve.h
+
+#include <string.h>
+#include <math.h>
+#include "nvs.h"
+#include "pointer_curve.h"
+
+#define NVS_KEY         "curve"
+#define NVS_VERSION     1
+
+typedef struct {
+    uint8_t version;
+    pointer_curve_config_t cfg;
+} curve_blob_t;
+
+const pointer_curve_config_t pointer_curve_defaults = {
+    .deadband_mdeg = 4000,
+    .max_mdeg = 45000,
+    .n_points = 6,
+    .points = {
+        {  4000,   0 },
+        {  6000, 110 },
+        { 12000, 170 },
+        { 20500, 400 },
+        { 30000, 650 },
+        { 45000, 900 },
+    },
+    .ramp_ms = 600,
+    .ramp_gain_q8 = 768,
+};
+
+static esp_err_t check_config(const pointer_curve_config_t *cfg)
+{
+    if (!cfg->max_mdeg || !cfg->ramp_ms || !cfg->ramp_gain_q8
+            || cfg->n_points < 2 || cfg->n_points > POINTER_CURVE_MAX_POINTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 1; i < cfg->n_points; i++) {
+        if (cfg->points[i].mdeg <= cfg->points[i - 1].mdeg) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+// Monotone cubic through the control points (Fritsch-Carlson), so the
+// curve never overshoots between points and speed never drops with tilt
+static void build_speed(pointer_curve_t *curve, const pointer_curve_config_t *cfg)
+{
+    const pointer_curve_point_t *p = cfg->points;
+    int n = cfg->n_points;
+    float delta[POINTER_CURVE_MAX_POINTS], m[POINTER_CURVE_MAX_POINTS];
+
+    for (int i = 0; i < n - 1; i++) {
+        delta[i] = (float)(p[i + 1].cps - p[i].cps) / (p[i + 1].mdeg - p[i].mdeg);
+    }
+    m[0] = delta[0];
+    m[n - 1] = delta[n - 2];
+    for (int i = 1; i < n - 1; i++) {
+        m[i] = (delta[i - 1] * delta[i] <= 0) ? 0 : (delta[i - 1] + delta[i]) / 2;
+    }
+    for (int i = 0; i < n - 1; i++) {
+        if (delta[i] == 0) {
+            m[i] = m[i + 1] = 0;
+            continue;
+        }
+        float a = m[i] / delta[i], b = m[i + 1] / delta[i];
+        float s = a * a + b * b;
+        if (s > 9) {
+            float t = 3 / sqrtf(s);
+            m[i] = t * a * delta[i];
+            m[i + 1] = t * b * delta[i];
+        }
+    }
+
+    int seg = 0;
+    for (int k = 0; k < POINTER_CURVE_SPEED_LUT; k++) {
+        float x = (float)k * cfg->max_mdeg / (POINTER_CURVE_SPEED_LUT - 1);
+        float y;
+
+        if (x <= p[0].mdeg) {
+            y = p[0].cps;
+        } else if (x >= p[n - 1].mdeg) {
+            y = p[n - 1].cps;
+        } else {
+            while (x > p[seg + 1].mdeg) {
+                seg++;
+            }
+            float h = p[seg + 1].mdeg - p[seg].mdeg;
+            float t = (x - p[seg].mdeg) / h;
+            float t2 = t * t, t3 = t2 * t;
+            y = (2 * t3 - 3 * t2 + 1) * p[seg].cps + (t3 - 2 * t2 + t) * h * m[seg]
+                + (-2 * t3 + 3 * t2) * p[seg + 1].cps + (t3 - t2) * h * m[seg + 1];
+        }
+        y = y < 0 ? 0 : (y > UINT16_MAX ? UINT16_MAX : y);
+        curve->speed[k] = (uint16_t)(y + 0.5f);
+    }
+}
+
+// 1x at the start of a hold, easing (smoothstep) into ramp_gain_q8
+static void build_gain(pointer_curve_t *curve, const pointer_curve_config_t *cfg)
+{
+    for (int k = 0; k < POINTER_CURVE_GAIN_LUT; k++) {
+        float t = (float)k / (POINTER_CURVE_GAIN_LUT - 1);
+        float s = t * t * (3 - 2 * t);
+        curve->gain[k] = (uint16_t)(256 + (cfg->ramp_gain_q8 - 256) * s + 0.5f);
+    }
+}
+
+esp_err_t pointer_curve_build(pointer_curve_t *curve, const pointer_curve_config_t *cfg)
+{
+    esp_err_t err = check_config(cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    curve->deadband_mdeg = cfg->deadband_mdeg;
+    curve->speed_idx_q16 = (uint32_t)(((uint64_t)(POINTER_CURVE_SPEED_LUT - 1) << 16) / cfg->max_mdeg);
+    curve->gain_step_us = (uint32_t)cfg->ramp_ms * 1000 / (POINTER_CURVE_GAIN_LUT - 1);
+    build_speed(curve, cfg);
+    build_gain(curve, cfg);
+    return ESP_OK;
+}
+
+esp_err_t pointer_curve_load(pointer_curve_config_t *cfg, const char *nvs_namespace)
+{
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READONLY, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    curve_blob_t blob;
+    size_t len = sizeof(blob);
+    err = nvs_get_blob(h, NVS_KEY, &blob, &len);
+    nvs_close(h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (len != sizeof(blob) || blob.version != NVS_VERSION || check_config(&blob.cfg) != ESP_OK) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *cfg = blob.cfg;
+    return ESP_OK;
+}
+
+esp_err_t pointer_curve_save(const pointer_curve_config_t *cfg, const char *nvs_namespace)
+{
+    esp_err_t err = check_config(cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    curve_blob_t blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = NVS_VERSION;
+    blob.cfg = *cfg;
+
+    nvs_handle_t h;
+    err = nvs_open(nvs_namespace, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(h, NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK) {
+        err = nvs_commit(h);
+    }
+    nvs_close(h);
+    return err;
+}
+
+void pointer_axis_reset(pointer_axis_t *axis)
+{
+    axis->sign = 0;
+    axis->held_us = 0;
+}
+
+int32_t pointer_curve_step(const pointer_curve_t *curve, pointer_axis_t *axis, int32_t mdeg, uint32_t dt_us)
+{
+    int8_t sign = mdeg < 0 ? -1 : 1;
+    uint32_t tilt = (uint32_t)(mdeg < 0 ? -mdeg : mdeg);
+
+    if (tilt < curve->deadband_mdeg) {
+        pointer_axis_reset(axis);
+        return 0;
+    }
+
+    // Direction change restarts the hold ramp
+    if (sign != axis->sign) {
+        axis->sign = sign;
+        axis->held_us = 0;
+    } else if (axis->held_us < UINT32_MAX - dt_us) {
+        axis->held_us += dt_us;
+    }
+
+    uint32_t si = (uint32_t)(((uint64_t)tilt * curve->speed_idx_q16) >> 16);
+    uint32_t gi = axis->held_us / curve->gain_step_us;
+    if (si >= POINTER_CURVE_SPEED_LUT) {
+        si = POINTER_CURVE_SPEED_LUT - 1;
+    }
+    if (gi >= POINTER_CURVE_GAIN_LUT) {
+        gi = POINTER_CURVE_GAIN_LUT - 1;
+    }
+
+    // counts/s * Q8 gain * us -> counts in Q16
+    int64_t d = ((int64_t)curve->speed[si] * curve->gain[gi] * dt_us << 8) / 1000000;
+    return sign * (int32_t)d;
+}
@@ -0,0 +1,75 @@
+// Pointer acceleration curve for the air mouse
+//
+// Tilt maps to a cursor speed (counts per second) through a smooth curve
+// given by a few control points, and the time the tilt has been held in one
+// direction scales that speed through a ramp. Both are compiled into lookup
+// tables, so a step costs two table reads and one multiply. Movement is
+// integrated over the real sample spacing and returned in 16.16 counts; the
+// caller's accumulator (mouse_agg) keeps the fraction, so the cursor speed
+// does not depend on the sample or report rate and slow tilts still move
+// smoothly.
+
+#ifndef POINTER_CURVE_H__
+#define POINTER_CURVE_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POINTER_CURVE_MAX_POINTS  8
+#define POINTER_CURVE_SPEED_LUT   256   // entries over 0 .. max_mdeg
+#define POINTER_CURVE_GAIN_LUT    64    // entries over 0 .. ramp_ms
+
+typedef struct {
+    uint16_t mdeg;      // tilt
+    uint16_t cps;       // cursor speed, counts per second
+} pointer_curve_point_t;
+
+// Curve definition, stored in NVS as-is
+typedef struct {
+    uint16_t deadband_mdeg;     // no movement (and no hold time) below this tilt
+    uint16_t max_mdeg;          // tilt where the speed curve ends, flat beyond
+    uint8_t n_points;
+    pointer_curve_point_t points[POINTER_CURVE_MAX_POINTS]; // increasing mdeg
+    uint16_t ramp_ms;           // hold time to reach full gain
+    uint16_t ramp_gain_q8;      // gain after ramp_ms, 256 = 1x
+} pointer_curve_config_t;
+
+// Compiled curve
+typedef struct {
+    uint16_t deadband_mdeg;
+    uint32_t speed_idx_q16;     // LUT index per mdeg, Q16
+    uint32_t gain_step_us;      // hold time per gain LUT entry
+    uint16_t speed[POINTER_CURVE_SPEED_LUT];    // counts per second
+    uint16_t gain[POINTER_CURVE_GAIN_LUT];      // Q8
+} pointer_curve_t;
+
+// Per-axis state
+typedef struct {
+    int8_t sign;                // direction being held, 0 = in the deadband
+    uint32_t held_us;
+} pointer_axis_t;
+
+// Built-in curve: roughly the old 3 / 8 counts per 20 ms levels, smoothed,
+// with the 1x -> 3x hold ramp spread over 600 ms
+extern const pointer_curve_config_t pointer_curve_defaults;
+
+esp_err_t pointer_curve_build(pointer_curve_t *curve, const pointer_curve_config_t *cfg);
+
+// ESP_ERR_NVS_NOT_FOUND if nothing valid is stored, cfg untouched
+esp_err_t pointer_curve_load(pointer_curve_config_t *cfg, const char *nvs_namespace);
+esp_err_t pointer_curve_save(const pointer_curve_config_t *cfg, const char *nvs_namespace);
+
+void pointer_axis_reset(pointer_axis_t *axis);
+
+// Movement for this step in 16.16 counts, fraction included
+int32_t pointer_curve_step(const pointer_curve_t *curve, pointer_axis_t *axis, int32_t mdeg, uint32_t dt_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POINTER_CURVE_H__ */
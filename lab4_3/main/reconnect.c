@@ -0,0 +1,240 @@
+// Reconnect advertising policy, see reconnect.h
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "reconnect.h"
+
+static const char *TAG = "RECONNECT";
+
+#define NVS_KEY         "peer"
+#define NVS_VERSION     1
+
+// The controller ends high duty directed advertising by itself after
+// 1.28 s and Bluedroid reports no ADV_STOP_COMPLETE for that; the stage
+// timer must fire first so the stage always ends with our own stop
+#define DIRECTED_MAX_MS 1200
+
+typedef struct {
+    uint8_t version;
+    uint8_t addr_type;
+    esp_bd_addr_t addr;
+} peer_blob_t;
+
+static const char *const stage_names[] = { "idle", "directed", "fast", "slow" };
+
+static void load_peer(reconnect_t *r)
+{
+    nvs_handle_t h;
+    if (nvs_open(r->nvs_namespace, NVS_READONLY, &h) != ESP_OK) {
+        return;
+    }
+
+    peer_blob_t blob;
+    size_t len = sizeof(blob);
+    esp_err_t err = nvs_get_blob(h, NVS_KEY, &blob, &len);
+    nvs_close(h);
+    if (err != ESP_OK || len != sizeof(blob) || blob.version != NVS_VERSION) {
+        return;
+    }
+
+    memcpy(r->peer, blob.addr, sizeof(esp_bd_addr_t));
+    r->peer_type = blob.addr_type;
+    r->have_peer = true;
+}
+
+static void save_peer(reconnect_t *r, const esp_bd_addr_t addr, esp_ble_addr_type_t type)
+{
+    // Encryption completes on every connection, only a new host costs a write
+    if (r->have_peer && r->peer_type == type && !memcmp(r->peer, addr, sizeof(esp_bd_addr_t))) {
+        return;
+    }
+    memcpy(r->peer, addr, sizeof(esp_bd_addr_t));
+    r->peer_type = type;
+    r->have_peer = true;
+
+    peer_blob_t blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = NVS_VERSION;
+    blob.addr_type = type;
+    memcpy(blob.addr, addr, sizeof(esp_bd_addr_t));
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(r->nvs_namespace, NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(h, NVS_KEY, &blob, sizeof(blob));
+        if (err == ESP_OK) {
+            err = nvs_commit(h);
+        }
+        nvs_close(h);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Saving the last host failed: %s", esp_err_to_name(err));
+    }
+}
+
+// Directed advertising target: the remembered host if it is still bonded,
+// addressed by its identity address when it shared one
+static bool bonded_target(const reconnect_t *r, esp_bd_addr_t addr, esp_ble_addr_type_t *type)
+{
+    int num = esp_ble_get_bond_device_num();
+    if (!r->have_peer || num <= 0) {
+        return false;
+    }
+    esp_ble_bond_dev_t *list = malloc(sizeof(esp_ble_bond_dev_t) * num);
+    if (!list) {
+        return false;
+    }
+
+    bool found = false;
+    if (esp_ble_get_bond_device_list(&num, list) == ESP_OK) {
+        for (int i = 0; i < num && !found; i++) {
+            const esp_ble_bond_key_info_t *key = &list[i].bond_key;
+            bool has_id = key->key_mask & ESP_LE_KEY_PID;
+
+            if (!memcmp(list[i].bd_addr, r->peer, sizeof(esp_bd_addr_t))
+                    || (has_id && !memcmp(key->pid_key.static_addr, r->peer, sizeof(esp_bd_addr_t)))) {
+                if (has_id) {
+                    memcpy(addr, key->pid_key.static_addr, sizeof(esp_bd_addr_t));
+                    *type = key->pid_key.addr_type;
+                } else {
+                    memcpy(addr, r->peer, sizeof(esp_bd_addr_t));
+                    *type = r->peer_type;
+                }
+                found = true;
+            }
+        }
+    }
+    free(list);
+    return found;
+}
+
+static void arm_timer(reconnect_t *r, uint32_t ms)
+{
+    esp_timer_stop(r->timer);
+    esp_timer_start_once(r->timer, (uint64_t)ms * 1000);
+}
+
+static void start_stage(reconnect_t *r, reconnect_stage_t stage)
+{
+    r->stage = stage;
+    switch (stage) {
+    case RECONNECT_DIRECTED: {
+        esp_ble_adv_params_t p = r->fast;
+        p.adv_type = ADV_TYPE_DIRECT_IND_HIGH;
+        p.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+        if (!bonded_target(r, p.peer_addr, &p.peer_addr_type)) {
+            start_stage(r, RECONNECT_FAST);
+            return;
+        }
+        ESP_LOGI(TAG, "Directed advertising to " ESP_BD_ADDR_STR, ESP_BD_ADDR_HEX(p.peer_addr));
+        arm_timer(r, r->directed_ms);
+        esp_ble_gap_start_advertising(&p);
+        break;
+    }
+    case RECONNECT_FAST:
+        arm_timer(r, r->fast_ms);
+        esp_ble_gap_start_advertising(&r->fast);
+        break;
+    case RECONNECT_SLOW:
+        ESP_LOGI(TAG, "No host after %lu ms, slow advertising",
+                 (unsigned long)((esp_timer_get_time() - r->down_us) / 1000));
+        esp_ble_gap_start_advertising(&r->slow);
+        break;
+    default:
+        break;
+    }
+}
+
+// Stage over: stop advertising, the next stage starts on ADV_STOP_COMPLETE
+static void stage_timeout(void *arg)
+{
+    reconnect_t *r = arg;
+    if (r->stage == RECONNECT_DIRECTED || r->stage == RECONNECT_FAST) {
+        esp_ble_gap_stop_advertising();
+    }
+}
+
+esp_err_t reconnect_init(reconnect_t *r, const esp_ble_adv_params_t *fast, const esp_ble_adv_params_t *slow,
+                         uint32_t directed_ms, uint32_t fast_ms, const char *nvs_namespace)
+{
+    memset(r, 0, sizeof(*r));
+    r->fast = *fast;
+    r->slow = *slow;
+    r->directed_ms = directed_ms < DIRECTED_MAX_MS ? directed_ms : DIRECTED_MAX_MS;
+    r->fast_ms = fast_ms;
+    r->nvs_namespace = nvs_namespace;
+    load_peer(r);
+
+    const esp_timer_create_args_t args = {
+        .callback = stage_timeout,
+        .arg = r,
+        .name = "reconnect",
+    };
+    return esp_timer_create(&args, &r->timer);
+}
+
+void reconnect_start(reconnect_t *r)
+{
+    r->down_us = esp_timer_get_time();
+    start_stage(r, RECONNECT_DIRECTED);
+}
+
+void reconnect_connected(reconnect_t *r)
+{
+    reconnect_stage_t stage = r->stage;
+
+    esp_timer_stop(r->timer);
+    r->stage = RECONNECT_IDLE;
+    if (stage == RECONNECT_IDLE) {
+        return;
+    }
+
+    int64_t ms = (esp_timer_get_time() - r->down_us) / 1000;
+    r->info.last_ms = ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+    if (r->info.last_ms > r->info.max_ms) {
+        r->info.max_ms = r->info.last_ms;
+    }
+    r->info.last_stage = stage;
+    r->info.by_stage[stage]++;
+    r->info.attempts++;
+    ESP_LOGI(TAG, "Connected %lu ms after link loss (%s advertising)",
+             (unsigned long)r->info.last_ms, stage_names[stage]);
+}
+
+void reconnect_on_gap_event(reconnect_t *r, esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+        if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+            ESP_LOGW(TAG, "Starting %s advertising failed, status %d",
+                     stage_names[r->stage], param->adv_start_cmpl.status);
+            if (r->stage == RECONNECT_DIRECTED) {
+                start_stage(r, RECONNECT_FAST);
+            }
+        }
+        break;
+    case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+        // The status does not matter: the controller may have ended directed
+        // advertising a moment before the stop reached it
+        if (r->stage == RECONNECT_DIRECTED) {
+            start_stage(r, RECONNECT_FAST);
+        } else if (r->stage == RECONNECT_FAST) {
+            start_stage(r, RECONNECT_SLOW);
+        }
+        break;
+    case ESP_GAP_BLE_AUTH_CMPL_EVT:
+        if (param->ble_security.auth_cmpl.success) {
+            save_peer(r, param->ble_security.auth_cmpl.bd_addr, param->ble_security.auth_cmpl.addr_type);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void reconnect_get(const reconnect_t *r, reconnect_info_t *info)
+{
+    *info = r->info;
+}
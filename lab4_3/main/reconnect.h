@@ -0,0 +1,87 @@
+// Reconnect advertising policy
+//
+// When the link drops (or at boot) the host that was connected last is the
+// one that wants the mouse back. Instead of plain undirected advertising
+// this tries, in order:
+//
+//   1. high duty cycle directed advertising to the last bonded host, which
+//      a host that is scanning for it answers within a few connection
+//      attempts (the controller stops it after 1.28 s at most, so the
+//      stage is capped at 1.2 s and always ended by the stage timer);
+//   2. fast undirected advertising for fast_ms, for hosts that use a
+//      resolvable address or were never bonded;
+//   3. slow undirected advertising until someone connects.
+//
+// The last host is remembered in NVS when pairing or encryption completes
+// and is only used while it is still in the bond list. The time from link
+// loss to the next connection is logged with the stage that got it.
+//
+// All calls except the stage timer come from the Bluedroid callback task;
+// the timer only asks the stack to stop advertising and the stage moves on
+// in the resulting ADV_STOP_COMPLETE event.
+
+#ifndef RECONNECT_H__
+#define RECONNECT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_gap_ble_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    RECONNECT_IDLE,         // connected, or not started
+    RECONNECT_DIRECTED,
+    RECONNECT_FAST,
+    RECONNECT_SLOW,
+} reconnect_stage_t;
+
+typedef struct {
+    uint32_t attempts;      // reconnect_start() calls that led to a connection
+    uint32_t last_ms;       // link loss to connection, last time
+    uint32_t max_ms;
+    reconnect_stage_t last_stage;
+    uint32_t by_stage[RECONNECT_SLOW + 1];
+} reconnect_info_t;
+
+typedef struct {
+    esp_ble_adv_params_t fast;
+    esp_ble_adv_params_t slow;
+    uint32_t directed_ms;
+    uint32_t fast_ms;
+    const char *nvs_namespace;
+    esp_timer_handle_t timer;
+
+    volatile reconnect_stage_t stage;
+    int64_t down_us;
+    bool have_peer;             // peer / peer_type hold the last bonded host
+    esp_bd_addr_t peer;
+    esp_ble_addr_type_t peer_type;
+    reconnect_info_t info;
+} reconnect_t;
+
+// fast and slow are the undirected advertising parameters; directed_ms is
+// capped at 1200; the last host is read from nvs_namespace
+esp_err_t reconnect_init(reconnect_t *r, const esp_ble_adv_params_t *fast, const esp_ble_adv_params_t *slow,
+                         uint32_t directed_ms, uint32_t fast_ms, const char *nvs_namespace);
+
+// Link is down (or advertising data is set at boot): start advertising
+void reconnect_start(reconnect_t *r);
+
+// From the HID connect event; logs the time since reconnect_start()
+void reconnect_connected(reconnect_t *r);
+
+// Feed every GAP event: advertising start / stop and authentication complete
+void reconnect_on_gap_event(reconnect_t *r, esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param);
+
+void reconnect_get(const reconnect_t *r, reconnect_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECONNECT_H__ */
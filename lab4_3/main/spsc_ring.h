@@ -0,0 +1,77 @@
+// Lock-free single-producer / single-consumer ring
+//
+// One task pushes, one other task pops, neither ever blocks or takes a
+// lock: each side only writes its own index, and the release store of that
+// index publishes the slot to the other side. A full ring makes push fail
+// instead of waiting, so the producer keeps its cadence whatever the
+// consumer is doing.
+//
+// SPSC_RING_DEFINE generates a ring type and its functions for one element
+// type and a power-of-two capacity:
+//
+//     SPSC_RING_DEFINE(ev_ring, mouse_event_t, 32)  // ev_ring_t, ev_ring_init(), ev_ring_push(), ev_ring_pop()
+//
+// Use it at file scope; the generated functions are `static inline`.
+
+#ifndef SPSC_RING_H__
+#define SPSC_RING_H__
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPSC_RING_DEFINE(name, type, capacity)                                                       \
+    _Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0, "power of two capacity"); \
+    typedef struct {                                                                                 \
+        atomic_uint head;       /* next slot to write, producer only */                              \
+        atomic_uint tail;       /* next slot to read, consumer only */                               \
+        type buf[(capacity)];                                                                        \
+    } name##_t;                                                                                      \
+                                                                                                     \
+    static inline void name##_init(name##_t *r)                                                      \
+    {                                                                                                \
+        atomic_init(&r->head, 0);                                                                    \
+        atomic_init(&r->tail, 0);                                                                    \
+    }                                                                                                \
+                                                                                                     \
+    /* Producer side; false if the ring is full */                                                   \
+    static inline bool name##_push(name##_t *r, const type *v)                                       \
+    {                                                                                                \
+        unsigned h = atomic_load_explicit(&r->head, memory_order_relaxed);                           \
+        unsigned t = atomic_load_explicit(&r->tail, memory_order_acquire);                           \
+        if (h - t >= (capacity)) {                                                                   \
+            return false;                                                                            \
+        }                                                                                            \
+        r->buf[h & ((capacity) - 1)] = *v;                                                           \
+        atomic_store_explicit(&r->head, h + 1, memory_order_release);                                \
+        return true;                                                                                 \
+    }                                                                                                \
+                                                                                                     \
+    /* Consumer side; false if the ring is empty */                                                  \
+    static inline bool name##_pop(name##_t *r, type *v)                                              \
+    {                                                                                                \
+        unsigned t = atomic_load_explicit(&r->tail, memory_order_relaxed);                           \
+        unsigned h = atomic_load_explicit(&r->head, memory_order_acquire);                           \
+        if (h == t) {                                                                                \
+            return false;                                                                            \
+        }                                                                                            \
+        *v = r->buf[t & ((capacity) - 1)];                                                           \
+        atomic_store_explicit(&r->tail, t + 1, memory_order_release);                                \
+        return true;                                                                                 \
+    }                                                                                                \
+                                                                                                     \
+    /* Elements waiting, exact on either side, a snapshot anywhere else */                           \
+    static inline unsigned name##_count(name##_t *r)                                                 \
+    {                                                                                                \
+        return atomic_load_explicit(&r->head, memory_order_acquire)                                  \
+             - atomic_load_explicit(&r->tail, memory_order_acquire);                                 \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPSC_RING_H__ */
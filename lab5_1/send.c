@@ -3,11 +3,16 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <gpiod.h>
 
 #define LED_PIN 17  // GPIO pin for LED (can be changed)
 #define DOT_DURATION 100000  // Duration of a dot in microseconds (100ms - fast mode)
 #define GPIO_CHIP "gpiochip0"  // Raspberry Pi GPIO chip
+#define RT_PRIORITY 80  // SCHED_FIFO priority with -r
 
 // GPIO line
 static struct gpiod_chip *chip = NULL;
@@ -113,66 +118,145 @@ const char* get_morse_code(char c) {
     return NULL;
 }
 
-// Function to send a dot
-void send_dot() {
-    gpio_write(0);  // Turn LED ON (active-low)
-    usleep(DOT_DURATION);
-    gpio_write(1);  // Turn LED OFF (active-low)
-    usleep(DOT_DURATION);  // Gap between symbols
+// One level change of the LED, at an offset from the start of the message
+typedef struct {
+    long long t_ns;
+    int value;
+} edge_t;
+
+// Precomputed edge timeline of one message
+static edge_t *edges = NULL;
+static size_t n_edges = 0;
+static long long message_ns = 0;  // duration including the trailing letter gap
+
+// Lateness of every edge played (actual write time - deadline)
+static long long *late_ns = NULL;
+static size_t n_late = 0;
+
+static long long ts_to_ns(const struct timespec *ts) {
+    return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
 }
 
-// Function to send a dash (3 times dot duration)
-void send_dash() {
-    gpio_write(0);  // Turn LED ON (active-low)
-    usleep(DOT_DURATION * 3);
-    gpio_write(1);  // Turn LED OFF (active-low)
-    usleep(DOT_DURATION);  // Gap between symbols
+static struct timespec ns_to_ts(long long ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
 }
 
-// Function to send a character in morse code
-void send_morse_char(const char* morse) {
-    if (strcmp(morse, "/") == 0) {
-        // Word separator (7 units total: 3 after last letter + 4 more = 7)
-        // We already have 3 units from letter gap, add 4 more
-        usleep(DOT_DURATION * 4);
-        return;
-    }
+// Build the edge timeline of a message (in dot units, then scaled)
+int build_timeline(const char* message) {
+    size_t max_edges = strlen(message) * 10;  // at most 5 symbols, 2 edges each
+    long long units = 0;
 
-    for (int i = 0; morse[i] != '\0'; i++) {
-        if (morse[i] == '.') {
-            send_dot();
-        } else if (morse[i] == '-') {
-            send_dash();
-        }
+    edges = malloc((max_edges ? max_edges : 1) * sizeof(edge_t));
+    if (!edges) {
+        perror("Failed to allocate timeline");
+        return -1;
     }
-    // Gap between letters (3 units total, we already have 1 from symbol gap)
-    usleep(DOT_DURATION * 2);
-}
+    n_edges = 0;
 
-// Function to send a message in morse code
-void send_message(const char* message) {
     printf("%s\n", message);
-
     for (int i = 0; message[i] != '\0'; i++) {
         const char* morse = get_morse_code(message[i]);
-        if (morse) {
-            printf("%s ", morse);
-            fflush(stdout);
-            send_morse_char(morse);
+        if (!morse) {
+            continue;
+        }
+        printf("%s ", morse);
+        if (strcmp(morse, "/") == 0) {
+            // Word separator (7 units total: 3 after last letter + 4 more = 7)
+            units += 4;
+            continue;
+        }
+        for (int j = 0; morse[j] != '\0'; j++) {
+            edges[n_edges++] = (edge_t){ units * DOT_DURATION * 1000LL, 0 };  // LED ON (active-low)
+            units += morse[j] == '-' ? 3 : 1;
+            edges[n_edges++] = (edge_t){ units * DOT_DURATION * 1000LL, 1 };  // LED OFF
+            units += 1;  // Gap between symbols
         }
+        // Gap between letters (3 units total, we already have 1 from symbol gap)
+        units += 2;
     }
     printf("\n");
-    fflush(stdout);
+    message_ns = units * DOT_DURATION * 1000LL;
+    return 0;
+}
+
+// Lock memory and run under SCHED_FIFO so the playback is not preempted
+void enable_realtime(void) {
+    struct sched_param sp = { .sched_priority = RT_PRIORITY };
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall failed, continuing without");
+    }
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+        perror("SCHED_FIFO failed, continuing without");
+    }
+}
+
+// Play the timeline with every edge at start_ns + its offset, so a late
+// wakeup delays that edge only and not everything after it
+void play_timeline(long long start_ns) {
+    for (size_t i = 0; i < n_edges; i++) {
+        struct timespec deadline = ns_to_ts(start_ns + edges[i].t_ns);
+        struct timespec now;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+        gpio_write(edges[i].value);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        late_ns[n_late++] = ts_to_ns(&now) - ts_to_ns(&deadline);
+    }
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Per-edge lateness: how far each GPIO write landed after its deadline
+void print_jitter_stats(void) {
+    if (n_late == 0) {
+        return;
+    }
+
+    long long sum = 0;
+    for (size_t i = 0; i < n_late; i++) {
+        sum += late_ns[i];
+    }
+    qsort(late_ns, n_late, sizeof(late_ns[0]), cmp_ll);
+
+    printf("Edge timing (%zu edges, lateness in us): mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+           n_late, (double)sum / n_late / 1e3, late_ns[n_late / 2] / 1e3,
+           late_ns[(n_late * 99) / 100] / 1e3, late_ns[n_late - 1] / 1e3);
+}
+
+void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-r] <repetitions> <message>\n", prog);
+    fprintf(stderr, "  -r  real-time: SCHED_FIFO and locked memory\n");
+    fprintf(stderr, "Example: %s 4 \"hello ESP32\"\n", prog);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <repetitions> <message>\n", argv[0]);
-        fprintf(stderr, "Example: %s 4 \"hello ESP32\"\n", argv[0]);
+    int realtime = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        switch (opt) {
+        case 'r':
+            realtime = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        print_usage(argv[0]);
         return 1;
     }
+    const char* message = argv[optind + 1];
 
-    int repetitions = atoi(argv[1]);
+    int repetitions = atoi(argv[optind]);
     if (repetitions <= 0) {
         fprintf(stderr, "Error: repetitions must be a positive integer\n");
         return 1;
@@ -183,26 +267,43 @@ int main(int argc, char* argv[]) {
     if (gpio_init(LED_PIN) < 0) {
         fprintf(stderr, "Error: Failed to initialize GPIO\n");
         fprintf(stderr, "Make sure you run this program with sudo:\n");
-        fprintf(stderr, "  sudo %s %d \"%s\"\n", argv[0], repetitions, argv[2]);
+        fprintf(stderr, "  sudo %s %d \"%s\"\n", argv[0], repetitions, message);
+        return 1;
+    }
+
+    if (build_timeline(message) < 0) {
+        gpio_cleanup();
         return 1;
     }
+    late_ns = malloc((n_edges ? n_edges : 1) * repetitions * sizeof(late_ns[0]));
+    if (!late_ns) {
+        perror("Failed to allocate timing statistics");
+        gpio_cleanup();
+        return 1;
+    }
+    if (realtime) {
+        enable_realtime();
+    }
 
     printf("Starting transmission...\n");
     gpio_write(1);  // Start with LED off (active-low)
 
-    // Send the message multiple times
+    // Send the message multiple times, each repetition at an absolute time
+    // too: the message, then a 7 unit gap between messages
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long start_ns = ts_to_ns(&now) + DOT_DURATION * 1000LL;
     for (int i = 0; i < repetitions; i++) {
-        send_message(argv[2]);
-
-        // Gap between repetitions (longer pause)
-        if (i < repetitions - 1) {
-            usleep(DOT_DURATION * 7);  // 7 unit gap between messages
-        }
+        play_timeline(start_ns);
+        start_ns += message_ns + DOT_DURATION * 7 * 1000LL;
     }
+    print_jitter_stats();
 
     // Cleanup
     printf("Cleaning up...\n");
     gpio_cleanup();
+    free(late_ns);
+    free(edges);
 
     return 0;
 }
@@ -3,38 +3,80 @@
  *
  * This program reads light signals from a photodiode connected to an ADC pin
  * and decodes Morse code messages transmitted by the Raspberry Pi LED.
+ *
+ * Two sampling modes (RECEIVER_USE_DMA):
+ * - DMA: the adc_continuous driver samples at ADC_SAMPLE_FREQ_HZ into DMA
+ *   frames, which are scanned in blocks for threshold crossings. Edges are
+ *   timed from the sample index, so timing is good to 1/ADC_SAMPLE_FREQ_HZ.
+ * - Oneshot: adc_oneshot_read() every SAMPLE_RATE_MS from a delayed task,
+ *   which limits timing to SAMPLE_RATE_MS and the usable speed with it.
+ *
+ * The light threshold is not fixed: the dark (ambient) and lit levels are
+ * tracked and the threshold sits between them with hysteresis, so room
+ * light and LED distance can change without recalibrating.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
 
 static const char *TAG = "morse_receiver";
 
+// Receiver mode: 1 = adc_continuous (DMA), 0 = adc_oneshot polling
+#define RECEIVER_USE_DMA    1
+
 // ADC Configuration
 #define ADC_UNIT            ADC_UNIT_1
 #define ADC_CHANNEL         ADC_CHANNEL_1  // GPIO1 on ESP32-C3
 #define ADC_ATTEN           ADC_ATTEN_DB_6  // 6dB attenuation for 0-2450mV range (better sensitivity)
 #define ADC_BITWIDTH        ADC_BITWIDTH_12
 
-// Morse code timing parameters (in milliseconds) - Fast mode
-#define DOT_DURATION        100     // Base duration for a dot (fast: ~15 WPM)
-#define DASH_MIN_DURATION   250     // Minimum duration for a dash (2.5x dot)
-#define SYMBOL_GAP_MAX      200     // Max gap between symbols in same letter
-#define LETTER_GAP_MIN      250     // Min gap between letters
-#define WORD_GAP_MIN        600     // Min gap between words
-#define TIMEOUT_MS          1000    // Timeout to print buffered letter if no new signals
-
-// Light detection threshold
-#define LIGHT_THRESHOLD     22      // 22mV threshold
-#define SAMPLE_RATE_MS      10      // Sample every 10ms (prevents watchdog, still fast enough)
+// Continuous (DMA) sampling
+#define ADC_SAMPLE_FREQ_HZ  20000   // 50 us per sample
+#define ADC_FRAME_BYTES     256     // one DMA frame, 64 samples on ESP32-C3
+#define ADC_POOL_BYTES      4096    // driver buffer between ISR and task
+#define ADC_READ_TIMEOUT_MS 20      // idle checks run at least this often
+#define SCAN_BLOCK          16      // samples checked at once for a crossing
+#define DEBOUNCE_SAMPLES    4       // a new level must hold this many samples
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define ADC_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define ADC_GET_CHANNEL(p)  ((p)->type1.channel)
+#define ADC_GET_DATA(p)     ((p)->type1.data)
+#else
+#define ADC_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define ADC_GET_CHANNEL(p)  ((p)->type2.channel)
+#define ADC_GET_DATA(p)     ((p)->type2.data)
+#endif
+
+// Morse code timing parameters (in microseconds), all from the dot length.
+// With DMA sampling the dot can be made much shorter (10 ms for the Lab 5.3
+// sender at 10 chars/sec); oneshot polling needs about 10 samples per dot
+#define DOT_DURATION_US     100000                      // Base duration for a dot (fast: ~15 WPM)
+#define DASH_MIN_US         (DOT_DURATION_US * 5 / 2)   // Minimum duration for a dash (2.5x dot)
+#define DOT_MIN_US          (DOT_DURATION_US / 2)       // Shorter pulses are noise
+#define DASH_MAX_US         (DOT_DURATION_US * 6)       // Longer pulses are not symbols
+#define LETTER_GAP_MIN_US   (DOT_DURATION_US * 5 / 2)   // Min gap between letters
+#define WORD_GAP_MIN_US     (DOT_DURATION_US * 6)       // Min gap between words
+#define TIMEOUT_US          (DOT_DURATION_US * 10)      // Timeout to print buffered letter if no new signals
+
+// Light detection: adaptive slicer
+#define LIGHT_MIN_SWING     22      // Smallest lit - dark difference (mV) that counts as light
+#define SLICER_LEVEL_SHIFT  4       // Level tracking: move 1/16 of the way per update
+#define SLICER_NOISE_SHIFT  6       // Noise tracking: 1/64 per update
+#define SLICER_DECAY_SHIFT  12      // Lit level sinks back toward dark this slowly without light
+#define SLICER_REPORT_US    5000000 // Log levels and SNR this often (while light is seen)
+#define SLICER_STUCK_US     (DOT_DURATION_US * 10)  // "Light" this long is a brighter room, not the LED
+#define SAMPLE_RATE_MS      10      // Oneshot mode: sample every 10ms (prevents watchdog)
 
 // Morse code table
 const char* morse_table[] = {
@@ -77,9 +119,39 @@ const char* morse_table[] = {
 };
 
 // ADC handles
+#if RECEIVER_USE_DMA
+static adc_continuous_handle_t adc_handle;
+static volatile uint32_t adc_overflows;
+#else
 static adc_oneshot_unit_handle_t adc_handle;
+#endif
 static adc_cali_handle_t adc_cali_handle = NULL;
 
+// Adaptive slicer. Levels are in sample units (raw counts with DMA, mV with
+// oneshot) and kept x16 so the averages do not need floating point, which
+// the ESP32-C3 does not have
+typedef struct {
+    bool valid;             // dark level initialised
+    bool lit_seen;          // lit level measured since the last report
+    int min_swing;          // LIGHT_MIN_SWING in sample units
+    int32_t dark_x16;
+    int32_t lit_x16;
+    int32_t noise_x16;      // peak-to-peak noise on a steady level
+    int thr_high;           // dark -> lit above this
+    int thr_low;            // lit -> dark below this
+    int64_t last_report_us;
+} light_slicer_t;
+
+// Decoder state, fed with light on/off edges
+typedef struct {
+    char morse_buffer[10];  // Buffer to store current morse pattern
+    int morse_idx;
+    bool light_on;
+    int64_t light_start_us;
+    int64_t gap_start_us;
+    int64_t last_activity_us;
+} morse_decoder_t;
+
 // Function to decode morse code pattern to character
 char decode_morse(const char* pattern) {
     if (pattern == NULL || strlen(pattern) == 0) {
@@ -103,6 +175,359 @@ char decode_morse(const char* pattern) {
     return '?';  // Unknown pattern
 }
 
+// Decode the buffered pattern and print it, followed by sep if not 0
+static void decoder_flush(morse_decoder_t *d, char sep) {
+    d->morse_buffer[d->morse_idx] = '\0';
+    char decoded = decode_morse(d->morse_buffer);
+    if (sep) {
+        printf("%c%c", decoded, sep);
+    } else {
+        printf("%c", decoded);
+    }
+    fflush(stdout);
+    d->morse_idx = 0;
+}
+
+// Light turned on (on = true) or off at time t_us
+static void decoder_edge(morse_decoder_t *d, bool on, int64_t t_us) {
+    d->light_on = on;
+    d->last_activity_us = t_us;
+
+    if (on) {
+        d->light_start_us = t_us;
+
+        // Check if gap before this was long enough for letter/word boundary
+        if (d->gap_start_us > 0 && d->morse_idx > 0) {
+            int64_t gap_us = t_us - d->gap_start_us;
+
+            if (gap_us > WORD_GAP_MIN_US) {
+                // Word boundary - decode and print character, then add space
+                decoder_flush(d, ' ');
+            } else if (gap_us > LETTER_GAP_MIN_US) {
+                // Letter boundary - decode and print character
+                decoder_flush(d, 0);
+            }
+        }
+    } else {
+        d->gap_start_us = t_us;
+
+        // Determine if it was a dot or dash
+        int64_t pulse_us = t_us - d->light_start_us;
+        char symbol = 0;
+
+        if (pulse_us > DASH_MAX_US) {
+            symbol = 0;
+        } else if (pulse_us >= DASH_MIN_US) {
+            symbol = '-';
+        } else if (pulse_us >= DOT_MIN_US) {
+            symbol = '.';
+        }
+        if (symbol && d->morse_idx < sizeof(d->morse_buffer) - 1) {
+            d->morse_buffer[d->morse_idx++] = symbol;
+        }
+    }
+}
+
+// Timeout - print buffered letter and newline to end message
+static void decoder_idle(morse_decoder_t *d, int64_t now_us) {
+    if (d->morse_idx > 0 && d->last_activity_us > 0 && now_us - d->last_activity_us > TIMEOUT_US) {
+        decoder_flush(d, '\n');
+        d->last_activity_us = 0;
+    }
+}
+
+static void slicer_init(light_slicer_t *sl, int min_swing) {
+    memset(sl, 0, sizeof(*sl));
+    sl->min_swing = min_swing;
+    sl->thr_high = INT32_MAX;  // nothing is light until the dark level is known
+    sl->thr_low = INT32_MAX;
+}
+
+// The lit level never counts as closer to dark than the minimum swing or
+// twice the noise, so noise alone cannot look like light
+static int32_t slicer_lit_floor_x16(const light_slicer_t *sl) {
+    int32_t swing_x16 = sl->min_swing * 16;
+    if (sl->noise_x16 * 2 > swing_x16) {
+        swing_x16 = sl->noise_x16 * 2;
+    }
+    return sl->dark_x16 + swing_x16;
+}
+
+// Threshold halfway between the levels, with hysteresis of half the noise
+// (at least an eighth of the swing, at most a quarter) on each side
+static void slicer_set_thresholds(light_slicer_t *sl) {
+    int32_t swing_x16 = sl->lit_x16 - sl->dark_x16;
+    int32_t hyst_x16 = sl->noise_x16 / 2;
+
+    if (hyst_x16 < swing_x16 / 8) {
+        hyst_x16 = swing_x16 / 8;
+    }
+    if (hyst_x16 > swing_x16 / 4) {
+        hyst_x16 = swing_x16 / 4;
+    }
+    int32_t mid_x16 = sl->dark_x16 + swing_x16 / 2;
+    sl->thr_high = (mid_x16 + hyst_x16) / 16;
+    sl->thr_low = (mid_x16 - hyst_x16) / 16;
+}
+
+// Feed a steady stretch of samples (no crossing in it): its mean, its
+// peak-to-peak range, and whether the light was on
+static void slicer_update(light_slicer_t *sl, int mean, int range, bool lit) {
+    if (!sl->valid) {
+        sl->valid = true;
+        sl->dark_x16 = mean * 16;
+        sl->noise_x16 = range * 16;
+        sl->lit_x16 = slicer_lit_floor_x16(sl);
+        slicer_set_thresholds(sl);
+        return;
+    }
+
+    sl->noise_x16 += (range * 16 - sl->noise_x16) >> SLICER_NOISE_SHIFT;
+    if (lit) {
+        sl->lit_x16 += (mean * 16 - sl->lit_x16) >> SLICER_LEVEL_SHIFT;
+        sl->lit_seen = true;
+    } else {
+        // The LED adds to the ambient light, so the lit level follows the
+        // dark one
+        int32_t step_x16 = (mean * 16 - sl->dark_x16) >> SLICER_LEVEL_SHIFT;
+        sl->dark_x16 += step_x16;
+        sl->lit_x16 += step_x16;
+        // A weaker LED (moved away) must still be detected: without light
+        // the lit level drifts down toward the floor
+        // (rounded up, or the last 1/4096 of the way would never go)
+        int32_t above_floor_x16 = sl->lit_x16 - slicer_lit_floor_x16(sl);
+        if (above_floor_x16 > 0) {
+            sl->lit_x16 -= (above_floor_x16 + (1 << SLICER_DECAY_SHIFT) - 1) >> SLICER_DECAY_SHIFT;
+        }
+    }
+    if (sl->lit_x16 < slicer_lit_floor_x16(sl)) {
+        sl->lit_x16 = slicer_lit_floor_x16(sl);
+    }
+    slicer_set_thresholds(sl);
+}
+
+// The light has been "on" for SLICER_STUCK_US: the room got brighter. The
+// level it is at now becomes the dark level and the lit one is learnt again
+static void slicer_rebase(light_slicer_t *sl) {
+    ESP_LOGW(TAG, "Light steady at %ld for too long, taking it as the new dark level",
+             (long)(sl->lit_x16 / 16));
+    sl->dark_x16 = sl->lit_x16;
+    sl->lit_x16 = slicer_lit_floor_x16(sl);
+    sl->lit_seen = false;
+    slicer_set_thresholds(sl);
+}
+
+// Log the levels and the SNR (swing over peak-to-peak noise) now and then,
+// only while light keeps being seen: a quiet link goes quiet in the log too
+static void slicer_report(light_slicer_t *sl, int64_t now_us) {
+    if (!sl->lit_seen || now_us - sl->last_report_us < SLICER_REPORT_US) {
+        return;
+    }
+    sl->last_report_us = now_us;
+    sl->lit_seen = false;
+
+    int32_t swing_x16 = sl->lit_x16 - sl->dark_x16;
+    int32_t noise_x16 = sl->noise_x16 > 0 ? sl->noise_x16 : 1;
+    ESP_LOGI(TAG, "Light: dark %ld, lit %ld, threshold %d/%d, noise %ld p-p, SNR %.1f dB",
+             (long)(sl->dark_x16 / 16), (long)(sl->lit_x16 / 16), sl->thr_low, sl->thr_high,
+             (long)(sl->noise_x16 / 16), 20.0 * log10((double)swing_x16 / noise_x16));
+}
+
+// Calibration for mV readings; without it the levels are in raw counts
+static void init_adc_calibration(void) {
+    adc_cali_curve_fitting_config_t cali_config = {
+        .unit_id = ADC_UNIT,
+        .atten = ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH,
+    };
+
+    esp_err_t ret = adc_cali_create_scheme_curve_fitting(&cali_config, &adc_cali_handle);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "ADC calibration enabled");
+    } else {
+        ESP_LOGW(TAG, "ADC calibration not supported, using raw values");
+        adc_cali_handle = NULL;
+    }
+}
+
+#if RECEIVER_USE_DMA
+
+// Largest raw reading at or below threshold_mv. Calibrating every sample at
+// 20 kHz is too slow, so the slicer works in raw counts and the minimum
+// swing is converted once instead (the curve is monotonic, a binary search
+// finds the crossing)
+static int mv_to_raw(int threshold_mv) {
+    if (adc_cali_handle == NULL) {
+        return threshold_mv;
+    }
+
+    int lo = 0, hi = (1 << ADC_BITWIDTH) - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int mv = 0;
+        adc_cali_raw_to_voltage(adc_cali_handle, mid, &mv);
+        if (mv > threshold_mv) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo - 1;
+}
+
+static bool IRAM_ATTR adc_pool_ovf(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data) {
+    adc_overflows++;
+    return false;
+}
+
+// Initialize ADC in continuous mode
+static void init_adc(void) {
+    ESP_LOGI(TAG, "Initializing ADC (continuous, %d Hz)...", ADC_SAMPLE_FREQ_HZ);
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = ADC_POOL_BYTES,
+        .conv_frame_size = ADC_FRAME_BYTES,
+    };
+    ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &adc_handle));
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN,
+        .channel = ADC_CHANNEL,
+        .unit = ADC_UNIT,
+        .bit_width = ADC_BITWIDTH,
+    };
+    adc_continuous_config_t config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = ADC_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_OUTPUT_TYPE,
+    };
+    ESP_ERROR_CHECK(adc_continuous_config(adc_handle, &config));
+
+    adc_continuous_evt_cbs_t cbs = {
+        .on_pool_ovf = adc_pool_ovf,
+    };
+    ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(adc_handle, &cbs, NULL));
+
+    init_adc_calibration();
+
+    ESP_LOGI(TAG, "ADC initialized on channel %d", ADC_CHANNEL);
+}
+
+// Threshold crossing detector over the sample stream
+typedef struct {
+    light_slicer_t slicer;
+    bool above;             // debounced level
+    int pending;            // samples the other level has held
+    uint64_t pending_start; // sample index where it started
+    uint64_t sample_no;     // index of the next sample
+} edge_scanner_t;
+
+static inline int64_t sample_to_us(uint64_t sample_no) {
+    return (int64_t)(sample_no * 1000000ULL / ADC_SAMPLE_FREQ_HZ);
+}
+
+// Scan a batch of samples. Most blocks are all dark or all lit, so each
+// block of SCAN_BLOCK samples is first checked with a branch-free min/max
+// pass and skipped whole when it stays on the current level; those blocks
+// also feed the slicer. Only blocks with a crossing are walked sample by
+// sample
+static void scan_samples(edge_scanner_t *s, morse_decoder_t *d, const uint16_t *x, size_t n) {
+    light_slicer_t *sl = &s->slicer;
+    size_t i = 0;
+
+    while (i < n) {
+        if (s->pending == 0 && i + SCAN_BLOCK <= n) {
+            uint16_t lo = x[i], hi = x[i];
+            uint32_t sum = x[i];
+            for (int k = 1; k < SCAN_BLOCK; k++) {
+                uint16_t v = x[i + k];
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+                sum += v;
+            }
+            if (s->above ? lo >= sl->thr_low : hi <= sl->thr_high) {
+                slicer_update(sl, sum / SCAN_BLOCK, hi - lo, s->above);
+                i += SCAN_BLOCK;
+                continue;
+            }
+        }
+
+        // Hysteresis: going up needs thr_high, going down thr_low
+        bool above = s->above ? x[i] >= sl->thr_low : x[i] > sl->thr_high;
+        if (above == s->above) {
+            s->pending = 0;
+        } else {
+            if (s->pending == 0) {
+                s->pending_start = s->sample_no + i;
+            }
+            if (++s->pending >= DEBOUNCE_SAMPLES) {
+                // The edge is where the new level started, not where it was confirmed
+                s->above = above;
+                s->pending = 0;
+                decoder_edge(d, above, sample_to_us(s->pending_start));
+            }
+        }
+        i++;
+    }
+    s->sample_no += n;
+
+    int64_t now_us = sample_to_us(s->sample_no);
+    if (s->above && s->pending == 0 && now_us - d->light_start_us > SLICER_STUCK_US) {
+        slicer_rebase(sl);
+        s->above = false;
+        decoder_edge(d, false, now_us);
+    }
+}
+
+// Main Morse code receiver task (continuous mode)
+static void morse_receiver_task(void *arg) {
+    static uint8_t frame[ADC_FRAME_BYTES];
+    static uint16_t samples[ADC_FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES];
+    morse_decoder_t decoder = { 0 };
+    edge_scanner_t scanner = { 0 };
+    uint32_t overflows_seen = 0;
+
+    // Swing in raw counts, measured mid-range where the curve is typical
+    int min_swing = mv_to_raw(1000 + LIGHT_MIN_SWING) - mv_to_raw(1000);
+    slicer_init(&scanner.slicer, min_swing > 1 ? min_swing : 1);
+    ESP_LOGI(TAG, "Morse code receiver ready (Adaptive threshold, min swing: %d mV = raw %d, Sample: %d Hz)",
+             LIGHT_MIN_SWING, scanner.slicer.min_swing, ADC_SAMPLE_FREQ_HZ);
+    printf("\n=== RECEIVED MESSAGE ===\n");
+    fflush(stdout);
+
+    ESP_ERROR_CHECK(adc_continuous_start(adc_handle));
+
+    while (1) {
+        uint32_t len = 0;
+        esp_err_t ret = adc_continuous_read(adc_handle, frame, sizeof(frame), &len, ADC_READ_TIMEOUT_MS);
+
+        if (ret == ESP_OK) {
+            size_t n = 0;
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&frame[i];
+                if (ADC_GET_CHANNEL(p) == ADC_CHANNEL) {
+                    samples[n++] = ADC_GET_DATA(p);
+                }
+            }
+            scan_samples(&scanner, &decoder, samples, n);
+        }
+
+        // Timeouts run on sample time, which keeps counting while it is dark
+        int64_t now_us = sample_to_us(scanner.sample_no);
+        decoder_idle(&decoder, now_us);
+        slicer_report(&scanner.slicer, now_us);
+
+        if (adc_overflows != overflows_seen) {
+            overflows_seen = adc_overflows;
+            ESP_LOGW(TAG, "ADC buffer overflow (%lu), samples were dropped", (unsigned long)overflows_seen);
+        }
+    }
+}
+
+#else
+
 // Initialize ADC
 static void init_adc(void) {
     ESP_LOGI(TAG, "Initializing ADC...");
@@ -121,20 +546,7 @@ static void init_adc(void) {
     };
     ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, ADC_CHANNEL, &config));
 
-    // Configure ADC calibration
-    adc_cali_curve_fitting_config_t cali_config = {
-        .unit_id = ADC_UNIT,
-        .atten = ADC_ATTEN,
-        .bitwidth = ADC_BITWIDTH,
-    };
-
-    esp_err_t ret = adc_cali_create_scheme_curve_fitting(&cali_config, &adc_cali_handle);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "ADC calibration enabled");
-    } else {
-        ESP_LOGW(TAG, "ADC calibration not supported, using raw values");
-        adc_cali_handle = NULL;
-    }
+    init_adc_calibration();
 
     ESP_LOGI(TAG, "ADC initialized on channel %d", ADC_CHANNEL);
 }
@@ -154,92 +566,48 @@ static int read_adc(void) {
     return adc_raw;
 }
 
-// Main Morse code receiver task
+// Main Morse code receiver task (oneshot mode)
 static void morse_receiver_task(void *arg) {
-    char morse_buffer[10];  // Buffer to store current morse pattern
-    int morse_idx = 0;
+    morse_decoder_t decoder = { 0 };
+    light_slicer_t slicer;
 
-    bool light_on = false;
-    int64_t light_start_time = 0;
-    int64_t gap_start_time = 0;
-    int64_t last_activity_time = 0;
-
-    ESP_LOGI(TAG, "Morse code receiver ready (Threshold: %d mV, Sample: %d ms)", LIGHT_THRESHOLD, SAMPLE_RATE_MS);
+    slicer_init(&slicer, LIGHT_MIN_SWING);
+    ESP_LOGI(TAG, "Morse code receiver ready (Adaptive threshold, min swing: %d mV, Sample: %d ms)",
+             LIGHT_MIN_SWING, SAMPLE_RATE_MS);
     printf("\n=== RECEIVED MESSAGE ===\n");
     fflush(stdout);
 
     while (1) {
         int adc_value = read_adc();
-        int64_t current_time = esp_timer_get_time() / 1000;  // Convert to milliseconds
+        int64_t current_time = esp_timer_get_time();
 
         // Check for timeout - if no activity and we have buffered morse code
-        if (morse_idx > 0 && last_activity_time > 0) {
-            int64_t idle_time = current_time - last_activity_time;
-            if (idle_time > TIMEOUT_MS) {
-                // Timeout - print buffered letter and newline to end message
-                morse_buffer[morse_idx] = '\0';
-                char decoded = decode_morse(morse_buffer);
-                printf("%c\n", decoded);
-                fflush(stdout);
-                morse_idx = 0;
-                last_activity_time = 0;
-            }
-        }
+        decoder_idle(&decoder, current_time);
 
-        // Detect light state change
-        if (adc_value > LIGHT_THRESHOLD && !light_on) {
-            // Light turned ON
-            light_on = true;
-            light_start_time = current_time;
-            last_activity_time = current_time;
-
-            // Check if gap before this was long enough for letter/word boundary
-            if (gap_start_time > 0) {
-                int gap_duration = current_time - gap_start_time;
-
-                if (gap_duration > WORD_GAP_MIN && morse_idx > 0) {
-                    // Word boundary - decode and print character, then add space
-                    morse_buffer[morse_idx] = '\0';
-                    char decoded = decode_morse(morse_buffer);
-                    printf("%c ", decoded);
-                    fflush(stdout);
-                    morse_idx = 0;
-                } else if (gap_duration > LETTER_GAP_MIN && morse_idx > 0) {
-                    // Letter boundary - decode and print character
-                    morse_buffer[morse_idx] = '\0';
-                    char decoded = decode_morse(morse_buffer);
-                    printf("%c", decoded);
-                    fflush(stdout);
-                    morse_idx = 0;
-                }
-            }
-
-        } else if (adc_value <= LIGHT_THRESHOLD && light_on) {
-            // Light turned OFF
-            light_on = false;
-            gap_start_time = current_time;
-            last_activity_time = current_time;
-
-            // Determine if it was a dot or dash
-            int pulse_duration = current_time - light_start_time;
+        if (decoder.light_on && current_time - decoder.light_start_us > SLICER_STUCK_US) {
+            slicer_rebase(&slicer);
+            decoder_edge(&decoder, false, current_time);
+        }
 
-            if (pulse_duration >= DASH_MIN_DURATION) {
-                // It was a dash
-                if (morse_idx < sizeof(morse_buffer) - 1) {
-                    morse_buffer[morse_idx++] = '-';
-                }
-            } else if (pulse_duration >= DOT_DURATION / 2) {
-                // It was a dot
-                if (morse_idx < sizeof(morse_buffer) - 1) {
-                    morse_buffer[morse_idx++] = '.';
-                }
-            }
+        // Detect light state change (with hysteresis)
+        bool on = decoder.light_on ? adc_value >= slicer.thr_low : adc_value > slicer.thr_high;
+        if (on != decoder.light_on) {
+            decoder_edge(&decoder, on, current_time);
+        } else {
+            // A single sample has no range; its distance from the level it
+            // belongs to stands in for the noise
+            int32_t level_x16 = on ? slicer.lit_x16 : slicer.dark_x16;
+            int range = abs(adc_value * 16 - level_x16) * 2 / 16;
+            slicer_update(&slicer, adc_value, slicer.valid ? range : 0, on);
         }
+        slicer_report(&slicer, current_time);
 
         vTaskDelay(pdMS_TO_TICKS(SAMPLE_RATE_MS));
     }
 }
 
+#endif
+
 void app_main(void) {
     ESP_LOGI(TAG, "Lab 5.2 - Morse Code Receiver");
     ESP_LOGI(TAG, "============================");
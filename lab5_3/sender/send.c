@@ -3,7 +3,11 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <gpiod.h>
 
 #define LED_PIN 17  // GPIO pin for LED
@@ -12,6 +16,9 @@
 // Default speed: 10 characters per second (optimized for Lab 5.3)
 #define DEFAULT_SPEED 10.0
 
+#define RT_PRIORITY 80        // SCHED_FIFO priority with -r
+#define LEAD_IN_US 1000       // first edge this long after the timeline is set up
+
 // GPIO line
 static struct gpiod_chip *chip = NULL;
 static struct gpiod_line *line = NULL;
@@ -63,8 +70,9 @@ const char* morse_table[] = {
     "----."  // 9
 };
 
-// Calculate timing parameters based on desired speed (chars/sec)
-void calculate_timing(double speed) {
+// Calculate timing parameters based on desired speed (chars/sec), logging
+// them to out
+void calculate_timing(double speed, FILE *out) {
     // Average Morse code character has about 10 time units
     // (including intra-character gaps)
     // 1 time unit = dot duration
@@ -82,19 +90,11 @@ void calculate_timing(double speed) {
     letter_gap_us = dot_duration_us * 3;  // Gap between letters
     word_gap_us = dot_duration_us * 7;    // Gap between words
 
-    printf("Speed: %.2f chars/sec\n", speed);
-    printf("Timing (us): dot=%d, dash=%d, symbol_gap=%d, letter_gap=%d, word_gap=%d\n",
+    fprintf(out, "Speed: %.2f chars/sec\n", speed);
+    fprintf(out, "Timing (us): dot=%d, dash=%d, symbol_gap=%d, letter_gap=%d, word_gap=%d\n",
            dot_duration_us, dash_duration_us, symbol_gap_us, letter_gap_us, word_gap_us);
 }
 
-// High-precision sleep using nanosleep
-void precise_sleep_us(int microseconds) {
-    struct timespec ts;
-    ts.tv_sec = microseconds / 1000000;
-    ts.tv_nsec = (microseconds % 1000000) * 1000;
-    nanosleep(&ts, NULL);
-}
-
 // Initialize GPIO using libgpiod
 int gpio_init(int pin) {
     chip = gpiod_chip_open_by_name(GPIO_CHIP);
@@ -152,129 +152,326 @@ const char* get_morse_code(char c) {
     return NULL;
 }
 
-// Function to send a dot
-void send_dot() {
-    gpio_write(1);
-    precise_sleep_us(dot_duration_us);
-    gpio_write(0);
-    precise_sleep_us(symbol_gap_us);
+// One run of the LED output: held at value (1 = on) for duration_us.
+// Runs alternate, so the start of every run is an edge
+typedef struct {
+    int value;
+    long long duration_us;
+} run_t;
+
+// Encoded transmission: the message, its repetitions and the gaps between
+static run_t *runs = NULL;
+static size_t n_runs = 0;
+static long long total_us = 0;
+static long long repeat_gap_us = 0;  // sum of the pauses between repetitions
+
+// Lateness of every edge played (actual write time - deadline)
+static long long *late_ns = NULL;
+static size_t n_late = 0;
+
+static long long ts_to_ns(const struct timespec *ts) {
+    return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
 }
 
-// Function to send a dash
-void send_dash() {
-    gpio_write(1);
-    precise_sleep_us(dash_duration_us);
-    gpio_write(0);
-    precise_sleep_us(symbol_gap_us);
+static struct timespec ns_to_ts(long long ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
 }
 
-// Function to send a character in morse code
-void send_morse_char(const char* morse) {
-    if (strcmp(morse, "/") == 0) {
-        // Word separator (additional gap)
-        precise_sleep_us(word_gap_us - letter_gap_us);
+// Append a run, merging it into the last one when the level is the same
+// (gaps after a letter, a word and a repetition add up to one OFF run)
+static void add_run(int value, long long duration_us) {
+    if (duration_us <= 0) {
         return;
     }
+    if (n_runs > 0 && runs[n_runs - 1].value == value) {
+        runs[n_runs - 1].duration_us += duration_us;
+    } else {
+        runs[n_runs++] = (run_t){ value, duration_us };
+    }
+    total_us += duration_us;
+}
+
+// Encode a message into the run list. gap_scale stretches the letter, word
+// and repetition gaps (Farnsworth style) while the symbols keep their speed
+int encode_message(const char* message, int repetitions, double gap_scale) {
+    size_t len = strlen(message);
+    // At most 5 symbols per character, an ON and an OFF run each
+    size_t max_runs = (size_t)repetitions * (len * 10 + 1);
 
-    for (int i = 0; morse[i] != '\0'; i++) {
-        if (morse[i] == '.') {
-            send_dot();
-        } else if (morse[i] == '-') {
-            send_dash();
+    runs = malloc((max_runs ? max_runs : 1) * sizeof(run_t));
+    if (!runs) {
+        perror("Failed to allocate edge schedule");
+        return -1;
+    }
+    n_runs = 0;
+    total_us = 0;
+    repeat_gap_us = 0;
+
+    long long letter_extra_us = (long long)(letter_gap_us * gap_scale) - symbol_gap_us;
+    long long word_extra_us = (long long)((word_gap_us - letter_gap_us) * gap_scale);
+
+    for (int r = 0; r < repetitions; r++) {
+        for (size_t i = 0; i < len; i++) {
+            const char* morse = get_morse_code(message[i]);
+            if (!morse) {
+                continue;
+            }
+            if (strcmp(morse, "/") == 0) {
+                // Word separator: the letter gap is already there
+                add_run(0, word_extra_us);
+                continue;
+            }
+            for (int j = 0; morse[j] != '\0'; j++) {
+                add_run(1, morse[j] == '-' ? dash_duration_us : dot_duration_us);
+                add_run(0, symbol_gap_us);
+            }
+            // Gap between letters
+            add_run(0, letter_extra_us);
+        }
+        if (r < repetitions - 1) {
+            long long gap_us = (long long)(word_gap_us * 2 * gap_scale);
+            add_run(0, gap_us);
+            repeat_gap_us += gap_us;
         }
     }
-    // Gap between letters
-    precise_sleep_us(letter_gap_us - symbol_gap_us);
+    return 0;
 }
 
-// Function to send a message in morse code
-void send_message(const char* message) {
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+// Dry run: write the schedule as one line per edge, time from the start,
+// level (1 = LED on) and how long it is held. "-" writes to stdout
+int write_timeline(const char* path, const char* message, int repetitions, double speed, double gap_scale) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        perror("Failed to open timeline file");
+        return -1;
+    }
 
-    for (int i = 0; message[i] != '\0'; i++) {
-        const char* morse = get_morse_code(message[i]);
-        if (morse) {
-            printf("%s ", morse);
-            fflush(stdout);
-            send_morse_char(morse);
+    fprintf(f, "# morse timeline: speed=%.2f dot_us=%d gap_scale=%.2f repetitions=%d\n",
+            speed, dot_duration_us, gap_scale, repetitions);
+    fprintf(f, "# message: %s\n", message);
+    fprintf(f, "# t_us level duration_us\n");
+
+    long long t_us = 0;
+    for (size_t i = 0; i < n_runs; i++) {
+        fprintf(f, "%lld %d %lld\n", t_us, runs[i].value, runs[i].duration_us);
+        t_us += runs[i].duration_us;
+    }
+
+    if (f != stdout && fclose(f) != 0) {
+        perror("Failed to write timeline file");
+        return -1;
+    }
+    return 0;
+}
+
+// Lock memory and run under SCHED_FIFO so the playback is not preempted
+void enable_realtime(void) {
+    struct sched_param sp = { .sched_priority = RT_PRIORITY };
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall failed, continuing without");
+    }
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+        perror("SCHED_FIFO failed, continuing without");
+    } else {
+        printf("Real-time: SCHED_FIFO priority %d, memory locked\n", RT_PRIORITY);
+    }
+}
+
+// Play the run list: every edge waits for an absolute deadline, the sum of
+// the runs before it, so a late wakeup delays that edge only
+void play_schedule(long long start_ns) {
+    long long deadline_ns = start_ns;
+
+    for (size_t i = 0; i < n_runs; i++) {
+        struct timespec deadline = ns_to_ts(deadline_ns);
+        struct timespec now;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
         }
+        gpio_write(runs[i].value);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        late_ns[n_late++] = ts_to_ns(&now) - deadline_ns;
+        deadline_ns += runs[i].duration_us * 1000;
     }
-    printf("\n");
-    fflush(stdout);
+}
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    double elapsed = (end.tv_sec - start.tv_sec) +
-                     (end.tv_nsec - start.tv_nsec) / 1e9;
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
 
-    // Count non-space characters
-    int char_count = 0;
-    for (int i = 0; message[i] != '\0'; i++) {
-        if (message[i] != ' ') char_count++;
+// Per-edge lateness: how far each GPIO write landed after its deadline
+void print_jitter_stats(void) {
+    if (n_late == 0) {
+        return;
     }
 
-    double actual_speed = char_count / elapsed;
-    printf("Transmission time: %.3f seconds\n", elapsed);
-    printf("Characters sent: %d\n", char_count);
-    printf("Actual speed: %.2f chars/sec\n", actual_speed);
+    long long sum = 0, limit = (long long)dot_duration_us * 1000 / 10;
+    size_t over = 0;
+    for (size_t i = 0; i < n_late; i++) {
+        sum += late_ns[i];
+        if (late_ns[i] > limit) {
+            over++;
+        }
+    }
+    qsort(late_ns, n_late, sizeof(late_ns[0]), cmp_ll);
+
+    printf("Edge timing (%zu edges, lateness in us): min %.1f, mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+           n_late, late_ns[0] / 1e3, (double)sum / n_late / 1e3, late_ns[n_late / 2] / 1e3,
+           late_ns[(n_late * 99) / 100] / 1e3, late_ns[n_late - 1] / 1e3);
+    printf("Edges later than 10%% of a dot: %zu\n", over);
+}
+
+void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <repetitions> <message> [speed_chars_per_sec]\n", prog);
+    fprintf(stderr, "  -r, --realtime         SCHED_FIFO and locked memory (needs root)\n");
+    fprintf(stderr, "  -g, --gap-scale X      stretch letter/word gaps by X (default 1.0)\n");
+    fprintf(stderr, "  -n, --dry-run FILE     write the edge timeline to FILE (- = stdout)\n");
+    fprintf(stderr, "                         instead of driving the GPIO\n");
+    fprintf(stderr, "Example: %s 1 \"hello ESP32\" 10\n", prog);
+    fprintf(stderr, "         %s 1 \"test\" 15\n", prog);
+    fprintf(stderr, "         %s --dry-run hello.txt 1 \"hello\" 10\n", prog);
+    fprintf(stderr, "\nSpeed recommendations:\n");
+    fprintf(stderr, "  Lab 5.2 baseline: 1 chars/sec\n");
+    fprintf(stderr, "  Lab 5.3 optimized: 10-20 chars/sec\n");
+    fprintf(stderr, "  Challenge mode: 20+ chars/sec\n");
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <repetitions> <message> [speed_chars_per_sec]\n", argv[0]);
-        fprintf(stderr, "Example: %s 1 \"hello ESP32\" 10\n", argv[0]);
-        fprintf(stderr, "         %s 1 \"test\" 15\n", argv[0]);
-        fprintf(stderr, "\nSpeed recommendations:\n");
-        fprintf(stderr, "  Lab 5.2 baseline: 1 chars/sec\n");
-        fprintf(stderr, "  Lab 5.3 optimized: 10-20 chars/sec\n");
-        fprintf(stderr, "  Challenge mode: 20+ chars/sec\n");
+    static const struct option long_opts[] = {
+        { "realtime",  no_argument,       NULL, 'r' },
+        { "gap-scale", required_argument, NULL, 'g' },
+        { "dry-run",   required_argument, NULL, 'n' },
+        { NULL, 0, NULL, 0 }
+    };
+    int realtime = 0;
+    double gap_scale = 1.0;
+    const char* dry_run = NULL;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "rg:n:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'r':
+            realtime = 1;
+            break;
+        case 'g':
+            gap_scale = atof(optarg);
+            if (gap_scale < 1.0) {
+                fprintf(stderr, "Error: gap scale must be at least 1.0\n");
+                return 1;
+            }
+            break;
+        case 'n':
+            dry_run = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        print_usage(argv[0]);
         return 1;
     }
+    const char* message = argv[optind + 1];
 
-    int repetitions = atoi(argv[1]);
+    int repetitions = atoi(argv[optind]);
     if (repetitions <= 0) {
         fprintf(stderr, "Error: repetitions must be a positive integer\n");
         return 1;
     }
 
     double speed = DEFAULT_SPEED;
-    if (argc >= 4) {
-        speed = atof(argv[3]);
+    if (argc - optind >= 3) {
+        speed = atof(argv[optind + 2]);
         if (speed <= 0) {
             fprintf(stderr, "Error: speed must be positive\n");
             return 1;
         }
     }
 
-    // Calculate timing based on speed
-    calculate_timing(speed);
+    // Calculate timing based on speed; with a dry run to stdout only the
+    // timeline goes there
+    calculate_timing(speed, dry_run && strcmp(dry_run, "-") == 0 ? stderr : stdout);
+
+    // Encode stage: all lookups and timing maths happen before any output
+    if (encode_message(message, repetitions, gap_scale) < 0) {
+        return 1;
+    }
+
+    if (dry_run) {
+        int ret = write_timeline(dry_run, message, repetitions, speed, gap_scale);
+        if (ret == 0 && strcmp(dry_run, "-") != 0) {
+            printf("Timeline: %zu edges, %.3f seconds, written to %s\n", n_runs, total_us / 1e6, dry_run);
+        }
+        free(runs);
+        return ret == 0 ? 0 : 1;
+    }
 
     // Initialize GPIO
     printf("Initializing GPIO pin %d...\n", LED_PIN);
     if (gpio_init(LED_PIN) < 0) {
         fprintf(stderr, "Error: Failed to initialize GPIO\n");
         fprintf(stderr, "Make sure you run this program with sudo:\n");
-        fprintf(stderr, "  sudo %s %d \"%s\" %.1f\n", argv[0], repetitions, argv[2], speed);
+        fprintf(stderr, "  sudo %s %d \"%s\" %.1f\n", argv[0], repetitions, message, speed);
+        free(runs);
         return 1;
     }
 
-    printf("Starting high-speed transmission...\n");
+    late_ns = malloc((n_runs ? n_runs : 1) * sizeof(late_ns[0]));
+    if (!late_ns) {
+        perror("Failed to allocate timing statistics");
+        gpio_cleanup();
+        free(runs);
+        return 1;
+    }
+    if (realtime) {
+        enable_realtime();
+    }
+
+    int char_count = 0;
+    for (int i = 0; message[i] != '\0'; i++) {
+        const char* morse = get_morse_code(message[i]);
+        if (morse) {
+            printf("%s ", morse);
+        }
+        if (message[i] != ' ') char_count++;
+    }
+    printf("\n");
+
+    printf("Starting high-speed transmission (%d repetitions, %zu edges)...\n", repetitions, n_runs);
     gpio_write(0);
+    fflush(stdout);
 
-    // Send the message multiple times
-    for (int i = 0; i < repetitions; i++) {
-        printf("\n=== Transmission %d/%d ===\n", i + 1, repetitions);
-        send_message(argv[2]);
+    // Playback stage: nothing but sleeps and GPIO writes until it is over
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long start_ns = ts_to_ns(&now) + LEAD_IN_US * 1000LL;
+    play_schedule(start_ns);
+    gpio_write(0);
 
-        if (i < repetitions - 1) {
-            printf("Waiting between repetitions...\n");
-            precise_sleep_us(word_gap_us * 2);
-        }
+    // The last run is the trailing gap, which does not need waiting for
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (ts_to_ns(&now) - start_ns) / 1e9;
+    double sending = elapsed - repeat_gap_us / 1e6;
+    printf("Transmission time: %.3f seconds", elapsed);
+    if (repeat_gap_us > 0) {
+        printf(" (%.3f without the pauses between repetitions)", sending);
     }
+    printf("\n");
+    printf("Characters sent: %d\n", char_count * repetitions);
+    printf("Actual speed: %.2f chars/sec\n", char_count * repetitions / sending);
+    print_jitter_stats();
 
     // Cleanup
     printf("\nCleaning up...\n");
     gpio_cleanup();
+    free(late_ns);
+    free(runs);
 
     return 0;
 }